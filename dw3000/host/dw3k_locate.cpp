@@ -0,0 +1,256 @@
+#include "dw3k_locate.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+static constexpr int block_size = 64;  // Tags solved together
+static constexpr double light_m_per_s = 299792458.0;
+static constexpr double time40_hz = 499.2e6 * 128;  // As dw3k_time40_hz
+static constexpr uint64_t mask40 = (uint64_t(1) << 40) - 1;
+static constexpr float damping = 1e-3f;  // Levenberg, relative to diagonal
+
+DW3KLocator::DW3KLocator(DW3KLocateConfig const& c) : config(c) {
+  if (config.anchors.empty())
+    throw std::invalid_argument("DW3KLocator: No anchors");
+}
+
+int DW3KLocator::batch_index(uint32_t tag, uint32_t sequence) {
+  int const anchor_count = config.anchors.size();
+  auto const found = batch_by_tag.find(tag);
+  if (found != batch_by_tag.end()) {
+    int const i = found->second;
+    if (batch_sequences[i] != sequence) {  // Restart the tag
+      batch_sequences[i] = sequence;
+      batch_t40[i] = 0;
+      for (int a = 0; a < anchor_count; ++a) meas[a * stride + i] = NAN;
+    }
+    return i;
+  }
+
+  auto const slot = tag_slots.emplace(tag, int(known.size()));
+  if (slot.second) {
+    known_x.push_back(0);
+    known_y.push_back(0);
+    known_z.push_back(0);
+    known.push_back(false);
+  }
+
+  int const i = batch_tags.size();
+  if (i == stride) {  // Grow the measurement rows, keeping them aligned
+    int const new_stride = std::max(block_size, stride * 2);
+    std::vector<float> grown(anchor_count * new_stride, NAN);
+    for (int a = 0; a < anchor_count; ++a) {
+      std::copy_n(&meas[a * stride], stride, &grown[a * new_stride]);
+    }
+    meas.swap(grown);
+    stride = new_stride;
+  }
+
+  batch_by_tag[tag] = i;
+  batch_tags.push_back(tag);
+  batch_sequences.push_back(sequence);
+  batch_slots.push_back(slot.first->second);
+  batch_t40.push_back(0);
+  return i;
+}
+
+void DW3KLocator::add_range(
+    uint32_t tag, uint32_t sequence, int anchor, float meters) {
+  if (anchor < 0 || anchor >= int(config.anchors.size()))
+    throw std::invalid_argument("DW3KLocator: Bad anchor index");
+  int const i = batch_index(tag, sequence);
+  meas[anchor * stride + i] = meters;
+}
+
+void DW3KLocator::add_arrival(
+    uint32_t tag, uint32_t sequence, int anchor, uint64_t t40) {
+  if (anchor < 0 || anchor >= int(config.anchors.size()))
+    throw std::invalid_argument("DW3KLocator: Bad anchor index");
+  int const i = batch_index(tag, sequence);
+  if (!batch_t40[i]) batch_t40[i] = t40 | (uint64_t(1) << 63);  // Set flag
+  uint64_t const from_t40 = batch_t40[i] & mask40;
+
+  // Signed, fine across the 40-bit wrap
+  int64_t const span_t40 = int64_t(((t40 - from_t40) & mask40) << 24) >> 24;
+  meas[anchor * stride + i] = span_t40 / time40_hz * light_m_per_s;
+}
+
+// Gauss-Newton for tags [from, from + count) of the batch; every loop over
+// "i" is across tags, on arrays, so the compiler can vectorise it
+void DW3KLocator::solve_block(int from, int count) {
+  int const anchor_count = config.anchors.size();
+  bool const solve_z = isnan(config.fixed_z);
+  bool const arrivals = config.mode == DW3KLocateMode::Arrivals;
+  float const jz = solve_z ? 1 : 0, jb = arrivals ? 1 : 0;
+  int const unknowns = 2 + solve_z + arrivals;
+
+  float* __restrict const px = &x[from];
+  float* __restrict const py = &y[from];
+  float* __restrict const pz = &z[from];
+  float* __restrict const pb = &b[from];
+  int const* __restrict const n = &counts[from];
+
+  // Normal equations (J'J symmetric, J'r) and residual sum of squares
+  float a00[block_size], a01[block_size], a02[block_size], a03[block_size];
+  float a11[block_size], a12[block_size], a13[block_size];
+  float a22[block_size], a23[block_size], a33[block_size];
+  float g0[block_size], g1[block_size], g2[block_size], g3[block_size];
+  float sse[block_size], steps[block_size];
+
+  int iteration = 0;
+  while (iteration < config.max_iterations) {
+    ++iteration;
+    for (int i = 0; i < count; ++i) {
+      a00[i] = a01[i] = a02[i] = a03[i] = a11[i] = a12[i] = a13[i] = 0;
+      a22[i] = a23[i] = a33[i] = g0[i] = g1[i] = g2[i] = g3[i] = sse[i] = 0;
+    }
+
+    for (int a = 0; a < anchor_count; ++a) {
+      auto const& anchor = config.anchors[a];
+      float const* __restrict const m = &meas[a * stride + from];
+      for (int i = 0; i < count; ++i) {
+        bool const have = m[i] == m[i];  // Not NAN
+        float const w = have ? 1 : 0, value = have ? m[i] : 0;
+        float const dx = px[i] - anchor.x;
+        float const dy = py[i] - anchor.y;
+        float const dz = pz[i] - anchor.z;
+        float const d = sqrtf(dx * dx + dy * dy + dz * dz) + 1e-6f;
+        float const ux = w * dx / d, uy = w * dy / d, uz = w * jz * dz / d;
+        float const ub = w * jb;
+        float const r = w * (d + jb * pb[i] - value);
+        a00[i] += ux * ux; a01[i] += ux * uy; a02[i] += ux * uz;
+        a03[i] += ux * ub; a11[i] += uy * uy; a12[i] += uy * uz;
+        a13[i] += uy * ub; a22[i] += uz * uz; a23[i] += uz * ub;
+        a33[i] += ub * ub;
+        g0[i] += ux * r; g1[i] += uy * r; g2[i] += uz * r; g3[i] += ub * r;
+        sse[i] += r * r;
+      }
+    }
+
+    // Cholesky per tag (fixed unknowns get an identity row), then step
+    for (int i = 0; i < count; ++i) {
+      float const c00 = a00[i] * (1 + damping) + 1e-9f;
+      float const c11 = a11[i] * (1 + damping) + 1e-9f;
+      float const c22 = a22[i] * (1 + damping) + 1e-9f + (1 - jz);
+      float const c33 = a33[i] * (1 + damping) + 1e-9f + (1 - jb);
+      float const l00 = sqrtf(c00);
+      float const l10 = a01[i] / l00, l20 = a02[i] / l00, l30 = a03[i] / l00;
+      float const l11 = sqrtf(c11 - l10 * l10);
+      float const l21 = (a12[i] - l20 * l10) / l11;
+      float const l31 = (a13[i] - l30 * l10) / l11;
+      float const l22 = sqrtf(c22 - l20 * l20 - l21 * l21);
+      float const l32 = (a23[i] - l30 * l20 - l31 * l21) / l22;
+      float const l33 = sqrtf(c33 - l30 * l30 - l31 * l31 - l32 * l32);
+
+      float const y0 = g0[i] / l00;
+      float const y1 = (g1[i] - l10 * y0) / l11;
+      float const y2 = (g2[i] - l20 * y0 - l21 * y1) / l22;
+      float const y3 = (g3[i] - l30 * y0 - l31 * y1 - l32 * y2) / l33;
+      float const s3 = y3 / l33;
+      float const s2 = (y2 - l32 * s3) / l22;
+      float const s1 = (y1 - l21 * s2 - l31 * s3) / l11;
+      float const s0 = (y0 - l10 * s1 - l20 * s2 - l30 * s3) / l00;
+
+      float const use = n[i] >= unknowns ? 1 : 0;  // Else leave it be
+      px[i] -= use * s0;
+      py[i] -= use * s1;
+      pz[i] -= use * s2;
+      pb[i] -= use * s3;
+      steps[i] = use * (fabsf(s0) + fabsf(s1) + fabsf(s2));
+    }
+
+    float max_step = 0;
+    for (int i = 0; i < count; ++i) {
+      max_step = std::max(max_step, steps[i]);
+    }
+    if (!(max_step > config.tolerance_m)) break;  // (Or NAN somewhere)
+  }
+
+  for (int i = 0; i < count; ++i) {
+    rms[from + i] = sqrtf(sse[i] / n[i]);  // (NAN for none)
+  }
+  last_iterations = std::max(last_iterations, iteration);
+}
+
+std::vector<DW3KLocateFix> const& DW3KLocator::solve() {
+  int const n = batch_tags.size();
+  int const anchor_count = config.anchors.size();
+  bool const solve_z = isnan(config.fixed_z);
+
+  float cx = 0, cy = 0, cz = 0;  // Cold start from the anchors' centroid
+  for (auto const& a : config.anchors) {
+    cx += a.x / anchor_count;
+    cy += a.y / anchor_count;
+    cz += a.z / anchor_count;
+  }
+
+  x.resize(n);
+  y.resize(n);
+  z.resize(n);
+  b.assign(n, 0);
+  rms.resize(n);
+  counts.assign(n, 0);
+  for (int i = 0; i < n; ++i) {
+    int const slot = batch_slots[i];
+    x[i] = known[slot] ? known_x[slot] : cx;
+    y[i] = known[slot] ? known_y[slot] : cy;
+    z[i] = !solve_z ? config.fixed_z : known[slot] ? known_z[slot] : cz;
+  }
+
+  // Measurement counts, and the emission time (arrivals) from the start
+  for (int a = 0; a < anchor_count; ++a) {
+    auto const& anchor = config.anchors[a];
+    float const* const m = &meas[a * stride];
+    for (int i = 0; i < n; ++i) {
+      if (m[i] != m[i]) continue;
+      ++counts[i];
+      float const dx = x[i] - anchor.x, dy = y[i] - anchor.y;
+      float const dz = z[i] - anchor.z;
+      b[i] += m[i] - sqrtf(dx * dx + dy * dy + dz * dz);
+    }
+  }
+  for (int i = 0; i < n; ++i) {
+    b[i] = counts[i] ? b[i] / counts[i] : 0;
+  }
+
+  last_iterations = 0;
+  for (int from = 0; from < n; from += block_size) {
+    solve_block(from, std::min(block_size, n - from));
+  }
+
+  int const unknowns = 2 + solve_z + (config.mode == DW3KLocateMode::Arrivals);
+  fixes.resize(n);
+  for (int i = 0; i < n; ++i) {
+    auto& f = fixes[i];
+    f.tag = batch_tags[i];
+    f.sequence = batch_sequences[i];
+    f.x = x[i];
+    f.y = y[i];
+    f.z = z[i];
+    f.rms_m = rms[i];
+    f.anchors = counts[i];
+    // Exactly as many measurements as unknowns always fit (rms_m ~0),
+    // right or not, so it takes one more to trust the answer
+    f.valid = counts[i] > unknowns && f.rms_m <= config.max_rms_m &&
+        isfinite(x[i]) && isfinite(y[i]) && isfinite(z[i]);
+
+    int const slot = batch_slots[i];
+    if (f.valid) {
+      known_x[slot] = f.x;
+      known_y[slot] = f.y;
+      known_z[slot] = f.z;
+      known[slot] = true;
+    }
+  }
+
+  // Empty the batch for the next one
+  for (int a = 0; a < anchor_count; ++a) {
+    std::fill_n(&meas[a * stride], n, NAN);
+  }
+  batch_tags.clear();
+  batch_sequences.clear();
+  batch_slots.clear();
+  batch_t40.clear();
+  batch_by_tag.clear();
+  return fixes;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+
+#include <unordered_map>
+#include <vector>
+
+// Host-side position solver for tags seen by anchors at known positions,
+// either as distances (DS-TWR, dw3k_twr) or as arrival times in a common
+// timebase (TDOA, dw3k_tdoa, where the emission time is one more unknown).
+//
+// Measurements for many tags are collected into a batch and solved together
+// by Gauss-Newton. The batch is laid out as structure-of-arrays (one array
+// per unknown and per anchor's measurements, indexed by tag) and processed
+// in blocks of tags, so the inner loops run across tags and vectorise. Each
+// tag starts from its previous fix, so a moving tag takes two or three steps.
+
+enum class DW3KLocateMode { Ranges, Arrivals };
+
+struct DW3KLocateAnchor {
+  uint32_t id;
+  float x, y, z;  // Meters
+};
+
+struct DW3KLocateConfig {
+  DW3KLocateMode mode;
+  std::vector<DW3KLocateAnchor> anchors;
+  float fixed_z = NAN;        // Tag height if known (2D solve), or NAN
+  int max_iterations = 10;
+  float tolerance_m = 1e-4f;  // Done once no tag moves more than this
+  float max_rms_m = 0.5f;     // Fixes with a larger residual are not valid
+};
+
+struct DW3KLocateFix {
+  uint32_t tag;
+  uint32_t sequence;
+  float x, y, z;
+  float rms_m;  // Residual
+  int anchors;  // Measurements used
+  bool valid;   // More measurements than unknowns, a finite answer that
+                // fits them (rms_m up to max_rms_m)
+};
+
+class DW3KLocator {
+ public:
+  explicit DW3KLocator(DW3KLocateConfig const&);
+
+  // Adds to the next batch ("anchor" indexes config.anchors); a tag's
+  // measurements must share a sequence, a new one restarts the tag
+  void add_range(uint32_t tag, uint32_t sequence, int anchor, float meters);
+  void add_arrival(uint32_t tag, uint32_t sequence, int anchor, uint64_t t40);
+  int pending() const { return int(batch_tags.size()); }
+
+  // Solves the batch, giving fixes in the order the tags were first added
+  std::vector<DW3KLocateFix> const& solve();
+  int iterations() const { return last_iterations; }  // In the last solve()
+
+ private:
+  int batch_index(uint32_t tag, uint32_t sequence);
+  void solve_block(int from, int count);
+
+  DW3KLocateConfig config;
+  int last_iterations = 0;
+
+  // Last fix of every tag seen (warm start), by slot
+  std::unordered_map<uint32_t, int> tag_slots;
+  std::vector<float> known_x, known_y, known_z;
+  std::vector<bool> known;
+
+  // The batch: tags, then measurements by anchor (meas[anchor * stride + i],
+  // NAN where missing; arrivals in meters after the tag's first arrival)
+  std::vector<uint32_t> batch_tags, batch_sequences;
+  std::vector<int> batch_slots;
+  std::vector<uint64_t> batch_t40;  // Arrivals: first in the batch
+  std::unordered_map<uint32_t, int> batch_by_tag;
+  std::vector<float> meas;
+  int stride = 0;
+
+  // Working state per batch entry
+  std::vector<float> x, y, z, b, rms;
+  std::vector<int> counts;
+  std::vector<DW3KLocateFix> fixes;
+};
@@ -0,0 +1,111 @@
+#include <math.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include "dw3k_locate.h"
+
+// Solves simulated fixes for 1, 100 and 10000 tags per batch (walking about
+// a 30 x 30 x 4m room with eight anchors at its corners) by ranges and by
+// arrival times, and reports throughput, batch latency and accuracy
+
+using Clock = std::chrono::steady_clock;
+
+static constexpr double light_m_per_s = 299792458.0;
+static constexpr double time40_hz = 499.2e6 * 128;
+static constexpr uint64_t mask40 = (uint64_t(1) << 40) - 1;
+static constexpr float range_noise_m = 0.03f;
+static constexpr double arrival_noise_s = 0.1e-9;  // About 3cm
+static constexpr float step_m = 0.05f;  // Tag movement between fixes
+
+struct Tag {
+  float x, y, z;
+};
+
+static void bench(DW3KLocateMode mode, int tag_count) {
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<float> room_xy(1, 29), room_z(0.5f, 3.5f);
+  std::normal_distribution<float> range_noise(0, range_noise_m), walk(0, 1);
+  std::normal_distribution<double> arrival_noise(0, arrival_noise_s);
+  std::uniform_int_distribution<uint64_t> any_t40(0, mask40);
+
+  DW3KLocateConfig config = {};
+  config.mode = mode;
+  for (int i = 0; i < 8; ++i) {
+    config.anchors.push_back(
+        {uint32_t(0x0101 + i), i & 1 ? 30.0f : 0.0f, i & 2 ? 30.0f : 0.0f,
+         i & 4 ? 4.0f : 0.0f});
+  }
+  DW3KLocator locator(config);
+
+  std::vector<Tag> tags(tag_count);
+  for (auto& t : tags) t = {room_xy(rng), room_xy(rng), room_z(rng)};
+
+  int const batches = std::max(50, 1000000 / tag_count / 8);
+  double total_s = 0, max_s = 0, error_sq = 0;
+  long fixes = 0, iterations = 0;
+  for (int batch = 0; batch < batches; ++batch) {
+    // Measurements for this batch (not timed)
+    std::vector<float> ranges;
+    std::vector<uint64_t> arrivals;
+    for (auto& t : tags) {
+      t.x = std::clamp(t.x + step_m * walk(rng), 1.0f, 29.0f);
+      t.y = std::clamp(t.y + step_m * walk(rng), 1.0f, 29.0f);
+      t.z = std::clamp(t.z + step_m * walk(rng), 0.5f, 3.5f);
+      uint64_t const emit_t40 = any_t40(rng);
+      for (auto const& a : config.anchors) {
+        float const dx = t.x - a.x, dy = t.y - a.y, dz = t.z - a.z;
+        float const d = sqrtf(dx * dx + dy * dy + dz * dz);
+        ranges.push_back(d + range_noise(rng));
+        double const s = d / light_m_per_s + arrival_noise(rng);
+        arrivals.push_back((emit_t40 + uint64_t(s * time40_hz)) & mask40);
+      }
+    }
+
+    auto const start = Clock::now();
+    int const anchor_count = config.anchors.size();
+    for (int i = 0; i < tag_count; ++i) {
+      for (int a = 0; a < anchor_count; ++a) {
+        int const k = i * anchor_count + a;
+        if (mode == DW3KLocateMode::Ranges)
+          locator.add_range(i, batch, a, ranges[k]);
+        else
+          locator.add_arrival(i, batch, a, arrivals[k]);
+      }
+    }
+    auto const& result = locator.solve();
+    double const s =
+        std::chrono::duration<double>(Clock::now() - start).count();
+
+    if (batch == 0) continue;  // Cold start, not counted
+    total_s += s;
+    max_s = std::max(max_s, s);
+    iterations += locator.iterations();
+    for (int i = 0; i < tag_count; ++i) {
+      auto const& f = result[i];
+      float const dx = f.x - tags[i].x, dy = f.y - tags[i].y;
+      float const dz = f.z - tags[i].z;
+      error_sq += dx * dx + dy * dy + dz * dz;
+      fixes += f.valid;
+    }
+  }
+
+  int const counted = batches - 1;
+  printf(
+      "%-8s %6d tags: %10.0f fixes/s, latency %8.1fus mean %8.1fus max, "
+      "%4.1f iterations, %.3fm rms error\n",
+      mode == DW3KLocateMode::Ranges ? "ranges" : "arrivals", tag_count,
+      fixes / total_s, total_s / counted * 1e6, max_s * 1e6,
+      double(iterations) / counted,
+      sqrt(error_sq / (double(counted) * tag_count)));
+}
+
+int main() {
+  for (auto mode : {DW3KLocateMode::Ranges, DW3KLocateMode::Arrivals}) {
+    for (int tag_count : {1, 100, 10000}) bench(mode, tag_count);
+  }
+  return 0;
+}
@@ -0,0 +1,188 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <set>
+#include <vector>
+
+#include "dw3k_locate.h"
+
+// Solves tag positions from a text stream (stdin), one line each of
+//
+//   anchor <id> <x> <y> <z>              (meters; before any measurement)
+//   range <tag> <sequence> <anchor> <meters>           (test_twr_init)
+//   tdoa <tag> <sequence> <anchor> <ref_t40>           (test_tdoa_anchor)
+//
+// with ids and ref_t40 in hex, as the firmware prints them; other lines
+// (and anything after the last field) are ignored, so merged serial logs
+// work as they are. A tag's fix is solved once "window" later sequences of
+// it have come by (or at the end), in batches of up to "batch" tags:
+//
+//   fix <tag> <sequence> <x> <y> <z> rms=<meters> anchors=<count>
+//
+// A fix needs more measurements than unknowns (x, y, z unless --z, and the
+// emission time for tdoa) and a residual up to --max-rms (default 0.5m).
+
+static void usage(char const* argv0) {
+  fprintf(
+      stderr,
+      "usage: %s [--z height] [--batch tags] [--window sequences] "
+      "[--max-rms meters] < log\n",
+      argv0);
+  exit(2);
+}
+
+struct Measurement {
+  int anchor;
+  float meters;   // Ranges
+  uint64_t t40;   // Arrivals
+};
+
+struct Group {
+  uint32_t tag, sequence;
+  std::vector<Measurement> measurements;
+};
+
+struct Solver {
+  std::unique_ptr<DW3KLocator> locator;
+  std::set<uint32_t> pending_tags;
+};
+
+static DW3KLocateConfig config;
+static int batch_size = 100;
+static int window = 2;
+static long fix_count = 0, failed_count = 0;
+
+static void solve(Solver* s) {
+  if (!s->locator || s->pending_tags.empty()) return;
+  for (auto const& f : s->locator->solve()) {
+    if (!f.valid) {
+      printf(
+          "# no fix %04x %u (%d anchors, rms=%.3f)\n", f.tag, f.sequence,
+          f.anchors, f.rms_m);
+      ++failed_count;
+      continue;
+    }
+    printf(
+        "fix %04x %u %.3f %.3f %.3f rms=%.3f anchors=%d\n", f.tag,
+        f.sequence, f.x, f.y, f.z, f.rms_m, f.anchors);
+    ++fix_count;
+  }
+  s->pending_tags.clear();
+}
+
+static void add(Solver* s, DW3KLocateMode mode, Group const& g) {
+  if (!s->locator) {
+    config.mode = mode;
+    s->locator = std::make_unique<DW3KLocator>(config);
+  }
+  if (s->pending_tags.count(g.tag)) solve(s);  // One fix per tag per batch
+  for (auto const& m : g.measurements) {
+    if (mode == DW3KLocateMode::Ranges)
+      s->locator->add_range(g.tag, g.sequence, m.anchor, m.meters);
+    else
+      s->locator->add_arrival(g.tag, g.sequence, m.anchor, m.t40);
+  }
+  s->pending_tags.insert(g.tag);
+  if (int(s->pending_tags.size()) >= batch_size) solve(s);
+}
+
+int main(int argc, char** argv) {
+  for (int i = 1; i < argc; ++i) {
+    if (i + 1 < argc && !strcmp(argv[i], "--z")) {
+      config.fixed_z = atof(argv[++i]);
+    } else if (i + 1 < argc && !strcmp(argv[i], "--batch")) {
+      batch_size = atoi(argv[++i]);
+    } else if (i + 1 < argc && !strcmp(argv[i], "--window")) {
+      window = atoi(argv[++i]);
+    } else if (i + 1 < argc && !strcmp(argv[i], "--max-rms")) {
+      config.max_rms_m = atof(argv[++i]);
+    } else {
+      usage(argv[0]);
+    }
+  }
+  if (batch_size < 1 || window < 0) usage(argv[0]);
+
+  std::map<uint32_t, int> anchor_index;  // By id
+  Solver solvers[2];  // By mode
+  std::map<uint32_t, std::deque<Group>> open[2];  // Sequences, by tag
+
+  char line[256];
+  long line_number = 0;
+  while (fgets(line, sizeof(line), stdin)) {
+    ++line_number;
+    char kind[8];
+    unsigned id, tag, sequence, anchor;
+    float x, y, z, meters;
+    unsigned long long t40;
+    if (sscanf(line, "%7s", kind) != 1) continue;
+
+    Measurement m = {};
+    DW3KLocateMode mode;
+    if (!strcmp(kind, "anchor") &&
+        sscanf(line, "%*s %x %f %f %f", &id, &x, &y, &z) == 4) {
+      if (solvers[0].locator || solvers[1].locator) {
+        fprintf(stderr, "%ld: Anchor after measurements\n", line_number);
+        return 1;
+      }
+      anchor_index[id] = config.anchors.size();
+      config.anchors.push_back({id, x, y, z});
+      continue;
+    } else if (!strcmp(kind, "range") &&
+        sscanf(line, "%*s %x %u %x %f", &tag, &sequence, &anchor, &meters) ==
+            4) {
+      mode = DW3KLocateMode::Ranges;
+      m.meters = meters;
+    } else if (!strcmp(kind, "tdoa") &&
+        sscanf(line, "%*s %x %u %x %llx", &tag, &sequence, &anchor, &t40) ==
+            4) {
+      mode = DW3KLocateMode::Arrivals;
+      m.t40 = t40;
+    } else {
+      continue;
+    }
+
+    if (config.anchors.empty()) {
+      fprintf(stderr, "%ld: Measurement before any anchor\n", line_number);
+      return 1;
+    }
+    auto const found = anchor_index.find(anchor);
+    if (found == anchor_index.end()) {
+      fprintf(stderr, "%ld: Unknown anchor %04x\n", line_number, anchor);
+      continue;
+    }
+    m.anchor = found->second;
+
+    int const k = mode == DW3KLocateMode::Ranges ? 0 : 1;
+    auto& groups = open[k][tag];
+    Group* group = nullptr;
+    for (auto& g : groups) {
+      if (g.sequence == sequence) group = &g;
+    }
+    if (!group) {
+      groups.push_back({tag, sequence, {}});
+      group = &groups.back();
+      if (int(groups.size()) > window + 1) {
+        add(&solvers[k], mode, groups.front());
+        groups.pop_front();
+        group = &groups.back();
+      }
+    }
+    group->measurements.push_back(m);
+  }
+
+  // The rest, oldest first
+  for (int k = 0; k < 2; ++k) {
+    auto const mode = k ? DW3KLocateMode::Arrivals : DW3KLocateMode::Ranges;
+    for (auto& [tag, groups] : open[k]) {
+      for (auto const& g : groups) add(&solvers[k], mode, g);
+    }
+    solve(&solvers[k]);
+  }
+
+  fprintf(stderr, "%ld fixes, %ld failed\n", fix_count, failed_count);
+  return 0;
+}
@@ -0,0 +1,193 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "dw3k.h"
+#include "dw3k_telemetry.h"
+
+// Decodes binary telemetry (lib/dw3k/dw3k_telemetry.h) from a serial port
+// or file (or stdin) into text, one line per record:
+//
+//   status <micros> <status> status=<hex> state=<hex>
+//   stamp <micros> tx|rx <t40>
+//   range <address> <sequence> <peer> <meters>m q=<quality> <ppm>ppm
+//   counters <micros> <name>=<count> ...
+//   text <micros> <text>
+//   # lost <count> records
+//
+// Range lines match test_twr_init's own, so host/dw3k_locate reads them.
+// With --record, the raw stream is also saved, to be decoded again later.
+
+static void usage(char const* argv0) {
+  fprintf(stderr, "usage: %s [--record file] [port or file]\n", argv0);
+  exit(2);
+}
+
+// As DW3KStatus
+static char const* const status_names[] = {
+    "Invalid", "ResetActive", "ResetWaitIRQ", "ResetWaitPLL",
+    "CalibrationWait", "TransmitWait", "TransmitActive", "TransmitDone",
+    "TransmitTooLate", "ReceiveListen", "ReceiveAnalyze", "ReceiveDone",
+    "ReceiveTimeout", "ReceiveTooLate", "ReceiveContinuous", "Ready",
+    "ChipError", "CodeBug",
+};
+
+static_assert(
+    sizeof(status_names) / sizeof(status_names[0]) ==
+    int(DW3KStatus::CodeBug) + 1);
+
+static long record_count = 0, skipped_bytes = 0;
+
+// Prints the record; false if it doesn't make sense (so isn't one)
+static bool decode(uint8_t type, uint32_t micros, uint8_t const* p, int size) {
+  using T = DW3KTelemetryType;
+  switch (T(type)) {
+    case T::Status: {
+      DW3KTelemetryStatus r;
+      if (size != sizeof(r)) return false;
+      memcpy(&r, p, sizeof(r));
+      if (r.status > int(DW3KStatus::CodeBug)) return false;
+      printf(
+          "status %lu %s status=%012llx state=%08x\n", (unsigned long) micros,
+          status_names[r.status], (unsigned long long) r.sys_status,
+          unsigned(r.sys_state));
+      return true;
+    }
+
+    case T::Timestamp: {
+      DW3KTelemetryTimestamp r;
+      if (size != sizeof(r)) return false;
+      memcpy(&r, p, sizeof(r));
+      printf(
+          "stamp %lu %s %010llx\n", (unsigned long) micros,
+          r.kind == 'T' ? "tx" : "rx", (unsigned long long) r.t40);
+      return true;
+    }
+
+    case T::Range: {
+      DW3KTelemetryRange r;
+      if (size != sizeof(r)) return false;
+      memcpy(&r, p, sizeof(r));
+      printf(
+          "range %04x %u %04x %.3fm q=%.2f %.3fppm\n", r.address,
+          unsigned(r.sequence), r.peer, r.distance_m, r.quality,
+          r.clock_offset * 1e6);
+      return true;
+    }
+
+    case T::Counters: {
+      if (size != 2 * dw3k_evc_count) return false;
+      printf("counters %lu", (unsigned long) micros);
+      for (int c = 0; c < dw3k_evc_count; ++c) {
+        printf(
+            " %s=%u", dw3k_evc_names[c],
+            unsigned(p[2 * c] | p[2 * c + 1] << 8));
+      }
+      printf("\n");
+      return true;
+    }
+
+    case T::Text:
+      printf("text %lu %.*s\n", (unsigned long) micros, size, (char const*) p);
+      return true;
+
+    case T::Lost: {
+      uint32_t count;
+      if (size != sizeof(count)) return false;
+      memcpy(&count, p, sizeof(count));
+      printf("# lost %lu records\n", (unsigned long) count);
+      return true;
+    }
+  }
+  return false;
+}
+
+// Decodes whole records from the front of "data", dropping what it used
+// (and anything that isn't a record)
+static void decode_all(std::vector<uint8_t>* data) {
+  auto const& d = *data;
+  size_t at = 0;
+  while (at < d.size()) {
+    if (d[at] != dw3k_telemetry_magic) {
+      ++at;
+      ++skipped_bytes;
+      continue;
+    }
+    if (d.size() - at < size_t(dw3k_telemetry_header_size)) break;
+    int const size = d[at + 1];
+    size_t const total = dw3k_telemetry_header_size + size + 1;
+    if (d.size() - at < total) break;
+
+    uint8_t sum = 0;
+    for (size_t i = at + 1; i < at + total - 1; ++i) sum += d[i];
+    uint32_t micros;
+    memcpy(&micros, &d[at + 3], sizeof(micros));
+    if (sum != d[at + total - 1] ||
+        !decode(d[at + 2], micros, &d[at + dw3k_telemetry_header_size], size)) {
+      ++at;
+      ++skipped_bytes;
+      continue;
+    }
+    ++record_count;
+    at += total;
+  }
+  data->erase(data->begin(), data->begin() + at);
+}
+
+int main(int argc, char** argv) {
+  char const* input_path = nullptr;
+  char const* record_path = nullptr;
+  for (int i = 1; i < argc; ++i) {
+    if (i + 1 < argc && !strcmp(argv[i], "--record")) {
+      record_path = argv[++i];
+    } else if (argv[i][0] != '-' && !input_path) {
+      input_path = argv[i];
+    } else {
+      usage(argv[0]);
+    }
+  }
+
+  int fd = 0;
+  if (input_path) {
+    fd = open(input_path, O_RDONLY | O_NOCTTY);
+    if (fd < 0) {
+      perror(input_path);
+      return 1;
+    }
+  }
+  if (isatty(fd)) {  // Raw bytes from a serial port (USB ignores the baud)
+    termios t;
+    if (!tcgetattr(fd, &t)) {
+      cfmakeraw(&t);
+      tcsetattr(fd, TCSANOW, &t);
+    }
+  }
+
+  FILE* record = nullptr;
+  if (record_path && !(record = fopen(record_path, "wb"))) {
+    perror(record_path);
+    return 1;
+  }
+
+  setvbuf(stdout, nullptr, _IOLBF, 0);  // Live, e.g. into dw3k_locate
+  std::vector<uint8_t> data;
+  uint8_t buffer[4096];
+  for (;;) {
+    ssize_t const n = read(fd, buffer, sizeof(buffer));
+    if (n <= 0) break;
+    if (record) fwrite(buffer, 1, n, record);
+    data.insert(data.end(), buffer, buffer + n);
+    decode_all(&data);
+  }
+  skipped_bytes += data.size();  // A partial record at the end
+
+  if (record) fclose(record);
+  fprintf(
+      stderr, "%ld records, %ld other bytes\n", record_count, skipped_bytes);
+  return 0;
+}
@@ -1,25 +1,71 @@
 #include "dw3k.h"
 
 #include <Arduino.h>
+#include <math.h>
+#include <string.h>
 
 #include "dwm3k_pins.h"
+#include "dw3k_phy.h"
 #include "dw3k_registers.h"
 #include "dw3k_spi.h"
+#include "dw3k_telemetry.h"
+#include "dw3k_time.h"
 
 DW3KStatus last_status = DW3KStatus::Invalid;
 
 static char const* error_text = "[No error logged]";
 static unsigned long reset_millis;
 
-static uint32_t cache_tx_fctrl_lo;
-static uint16_t cache_chan_ctrl;
+static DW3KPhyProfile phy = dw3k_phy_ch5_default;
+
 static uint16_t tx_buffer_size;
+static bool tx_then_rx = false;  // Last TX was DTX_W4R, receiver follows
+static bool rx_delayed = false;  // Receiver turns on at DX_TIME (DRX)
+static uint32_t rx_errors = 0;
+
+// The frame received (single buffer), from the polls' SYS_STATUS bursts
+static uint32_t rx_finfo;
+static DW3KRxInfo rx_info;
+static bool rx_offset_known = false;
+
+// Continuous RX (double buffer) state
+static DW3KRxFrame* rx_ring = nullptr;
+static int rx_ring_count = 0;
+static int rx_ring_next = 0;     // Slot the next frame goes into
+static int rx_ring_used = 0;     // Frames queued and not yet released
+static int rx_queued = 0;        // Frames queued by this dw3k_poll()
+static uint32_t rx_dropped = 0;
+static int rx_host_buffer = 0;   // RX buffer (0/1) the host reads next
+
+static bool irq_mode = false;
+static bool irq_enabled = false;
+static DW3KCallbacks irq_callbacks = {};
+
+// SYS_ENABLE bits for IRQ mode: TXFRS, RXFR, RXFCG, RXFTO, RXOVRR (so
+// dw3k_rx_dropped() counts at once), HPDWARN + errors
+static constexpr uint64_t irq_event_mask = 0x8126080;
+static constexpr uint64_t irq_error_mask = 0xF00020C0000;
 
 static void bug(char const* text) {
   last_status = DW3KStatus::CodeBug;
   error_text = text;
 }
 
+// Writes the registers a profile switch on the same channel may change,
+// skipping those equal in "before" (if given)
+static void write_phy(DW3KPhyProfile const* before) {
+  if (!before || before->tx_fctrl != phy.tx_fctrl)
+    dw3k_maskset(DW3K_TX_FCTRL, 0x3FFu, phy.tx_fctrl);  // Keep TXFLEN
+  if (!before || before->chan_ctrl != phy.chan_ctrl)
+    dw3k_write(DW3K_CHAN_CTRL, phy.chan_ctrl);
+  if (!before || before->dtune0 != phy.dtune0)
+    dw3k_write(DW3K_DTUNE0, phy.dtune0);  // PAC (DT0B4 clear per manual)
+  if (!before || before->rx_sfd_toc != phy.rx_sfd_toc)
+    dw3k_write(DW3K_RX_SFD_TOC, phy.rx_sfd_toc);
+  if (!before || before->dtune3 != phy.dtune3)
+    dw3k_write(DW3K_DTUNE3, phy.dtune3);
+}
+
 void dw3k_reset() {
   digitalWrite(DW3K_RSTn_PIN, 0);
   digitalWrite(DW3K_WAKEUP_PIN, 0);
@@ -28,9 +74,64 @@ void dw3k_reset() {
   pinMode(DW3K_IRQ_PIN, INPUT);
   last_status = DW3KStatus::ResetActive;
   reset_millis = millis();
+  irq_enabled = false;
+  tx_then_rx = rx_delayed = false;
+  dw3k_cache_invalidate();
 }
 
-DW3KStatus dw3k_poll() {
+void dw3k_use_irq(DW3KCallbacks const& callbacks) {
+  irq_callbacks = callbacks;
+  irq_mode = true;
+}
+
+// Copy each filled RX buffer (in order) into the frame ring, or count it as
+// dropped if the ring is full, then hand the buffer back to the radio.
+// RDB_STATUS has a nibble per buffer: RXFCG, RXFR, CIADONE, CP_ERR.
+// See dwt_setdblrxbuffmode() and dwt_signal_rx_buff_free() in deca_driver.
+static void drain_rx_buffers() {
+  auto rdb_status = dw3k_read(DW3K_RDB_STATUS);
+  for (;;) {
+    int const shift = 4 * rx_host_buffer;
+    if (((rdb_status >> shift) & 0x5) != 0x5) return;  // RXFCG + CIADONE
+
+    uint32_t info[4];  // RX_FINFO, RX_TIME (40 bits), CIA_DIAG_0
+    auto const finfo = rx_host_buffer ? DW3K_BUF1_RX_FINFO : DW3K_BUF0_RX_FINFO;
+    dw3k_read(finfo, info, sizeof(info));
+    int const size_with_crc = info[0] & 0x3FF;
+    if (size_with_crc < 2 || size_with_crc > dw3k_packet_size + 2) {
+      last_status = DW3KStatus::ChipError;
+      error_text = "Chip: Bad RX_FINFO packet size";
+      return;
+    }
+
+    if (rx_ring_used >= rx_ring_count) {
+      ++rx_dropped;
+    } else {
+      auto& frame = rx_ring[rx_ring_next];
+      frame.size = size_with_crc - 2;
+      frame.rx_t40 = (uint64_t(info[2] & 0xFF) << 32) | info[1];
+      // COE_PPM, 2^-26 units; opposite in sign to DRX_CAR_INT, so this
+      // matches dw3k_rx_clock_offset() (deca_driver's DW3000 examples)
+      int32_t coe = info[3] & 0x1FFF;
+      if (coe & 0x1000) coe |= ~0x1FFF;
+      frame.clock_offset = coe * (1.0f / (1 << 26));
+      int const copy =
+          frame.size < frame.capacity ? frame.size : frame.capacity;
+      auto const buffer = rx_host_buffer ? DW3K_RX_BUFFER1 : DW3K_RX_BUFFER0;
+      if (copy > 0) dw3k_read(buffer, frame.data, copy);
+      rx_ring_next = (rx_ring_next + 1) % rx_ring_count;
+      ++rx_ring_used;
+      ++rx_queued;
+    }
+
+    dw3k_write(DW3K_RDB_STATUS, uint8_t(0xF << shift));  // Clear bits
+    dw3k_command(DW3K_DB_TOGGLE);  // Radio may fill this buffer again
+    rdb_status &= ~(0xF << shift);
+    rx_host_buffer ^= 1;
+  }
+}
+
+static DW3KStatus poll_status() {
   using DS = DW3KStatus;
   if (last_status == DS::ChipError || last_status == DS::CodeBug)
     return last_status;
@@ -55,7 +156,7 @@ DW3KStatus dw3k_poll() {
     dw3k_init_spi();
 
     // Verify DEV_ID (are we even talking to a DW3000)
-    auto const dev_id = dw3k_read<uint32_t>(DW3K_DEV_ID);
+    auto const dev_id = dw3k_read(DW3K_DEV_ID);
     if (dev_id != 0xDECA0302 && dev_id != 0xDECA0312) {
       last_status = DS::ChipError;
       error_text = "Chip: Bad device ID";
@@ -73,39 +174,68 @@ DW3KStatus dw3k_poll() {
       return last_status;
     }
 
-    dw3k_write(DW3K_OTP_CFG, uint16_t(0x15C0));  // OPS, BIAS, LDO, DGC (ch5)
-    // dw3k_write(DW3K_OTP_CFG, uint16_t(0x35C0));  // OPS, BIAS, LDO, DGC (ch9)
-    dw3k_maskset16(DW3K_BIAS_CTRL, ~0x1F, bias_tune);
+    dw3k_write(DW3K_OTP_CFG, phy.otp_cfg);  // OPS, BIAS, LDO, DGC
+    dw3k_maskset(DW3K_BIAS_CTRL, ~0x1F, bias_tune);
     dw3k_write(DW3K_XTAL, xtal_trim);
 
-    // Configure radio parameters
-    dw3k_write(DW3K_SYS_CFG, 0x00040498);
-    dw3k_write(DW3K_TX_FCTRL_64, (cache_tx_fctrl_lo = 0x1800));
+    // Configure radio parameters (see dw3k_phy.h for the profile's)
+    dw3k_write(DW3K_SYS_CFG, 0x00040498);  // Includes PHR_MODE (long frames)
     // dw3k_write(DW3K_TX_POWER, 0xFFFFFCFF);
-    dw3k_write(DW3K_CHAN_CTRL, (cache_chan_ctrl = 0x094E));  // ch5
-    // dw3k_write(DW3K_CHAN_CTRL, (cache_chan_ctrl = 0x094F));  // ch9
     dw3k_write(DW3K_DGC_CFG, uint16_t(0xE4F5));  // Change THR_64 per manual
-    dw3k_write(DW3K_DTUNE0, uint16_t(0x100C));  // Clear DT0B4 per manual
-    // dw3k_write(DW3K_DTUNE3, 0xAF5F35CC);  // from manual
-    dw3k_write(DW3K_DTUNE3, 0xAF5F584C);  // from deca_driver for !no-data
     dw3k_write(DW3K_RF_TX_CTRL1, uint8_t(0x0E));
-    dw3k_write(DW3K_RF_TX_CTRL2, 0x1C071134);  // ch5
-    // dw3k_write(DW3K_RF_TX_CTRL_2, 0x1C010034);  // ch9
+    dw3k_write(DW3K_PLL_CFG, phy.pll_cfg);
+    dw3k_write(DW3K_RF_TX_CTRL2, phy.rf_tx_ctrl2);
+    write_phy(nullptr);
     dw3k_write(DW3K_EVC_CTRL, 0x1);
 
     // Start PLL
     dw3k_write(DW3K_PLL_CAL, uint16_t(0x181));
-    dw3k_maskset32(DW3K_SEQ_CTRL, ~0u, 0x100);  // AINIT2IDLE, init PLL
+    dw3k_maskset(DW3K_SEQ_CTRL, ~0u, 0x100);  // AINIT2IDLE, init PLL
     last_status = DS::ResetWaitPLL;
   }
 
+  //
+  // In IRQ mode, once running, only talk to the chip for enabled events
+  // (except TransmitWait, where the HPDWARN errata below raises no IRQ)
+  //
+
+  if (irq_mode && last_status > DS::CalibrationWait) {
+    if (!irq_enabled) {
+      dw3k_write(DW3K_SYS_ENABLE_64, irq_event_mask | irq_error_mask);
+      dw3k_write(DW3K_SYS_STATUS, 0x1800000);  // Clear SPIRDY, RCINIT
+      irq_enabled = true;
+    }
+    if (last_status != DS::TransmitWait && !digitalRead(DW3K_IRQ_PIN))
+      return last_status;
+  }
+
   //
   // Error flag detection
   //
 
+  // While listening, one burst from SYS_STATUS through RX_STAMP (0x00:44-68)
+  // also picks up the frame's RX_FINFO and timestamp when it completes.
+  // After DTX_W4R that includes the TX states, as one late poll may see
+  // TXFRS and RXFR together and go all the way to ReceiveDone.
+  bool const may_receive =
+      last_status == DS::ReceiveListen || last_status == DS::ReceiveAnalyze ||
+      (tx_then_rx && (last_status == DS::TransmitWait ||
+                      last_status == DS::TransmitActive));
   uint64_t sys_status = 0;
-  dw3k_read(DW3K_SYS_STATUS_64, &sys_status, 6);
-  if (sys_status & 0xF00020C0000) {
+  if (may_receive) {
+    uint8_t head[0x69 - 0x44];
+    dw3k_read(DW3K_SYS_STATUS_64.address, head, sizeof(head));
+    memcpy(&sys_status, &head[0x44 - 0x44], 6);
+    memcpy(&rx_finfo, &head[0x4C - 0x44], sizeof(rx_finfo));
+    rx_info.rx_t40 = 0;
+    memcpy(&rx_info.rx_t40, &head[0x64 - 0x44], 5);
+    rx_info.sys_status = sys_status;
+    rx_offset_known = false;
+  } else {
+    sys_status = dw3k_read(DW3K_SYS_STATUS_64);
+  }
+
+  if (sys_status & irq_error_mask) {
     last_status = DS::ChipError;
     error_text = "Chip: Status error";
     if (sys_status & 0x00040000) error_text = "Chip: Impulse analyzer failure";
@@ -122,18 +252,18 @@ DW3KStatus dw3k_poll() {
 
   if (last_status == DS::ResetWaitPLL) {
     if (!(sys_status & 0x2)) return last_status;
-    if (dw3k_read<uint16_t>(DW3K_PLL_CAL) & 0x100) return last_status;
+    if (dw3k_read(DW3K_PLL_CAL) & 0x100) return last_status;
     dw3k_write(DW3K_LDO_CTRL, 0x105);      // VDDMS1, VDDMS3, VDDIF2
     dw3k_write(DW3K_RX_CAL, 0x00020011u);  // COMP_DLY, CAL_EN, CAL_MODE
     last_status = DS::CalibrationWait;
   }
 
   if (last_status == DS::CalibrationWait) {
-    if (!dw3k_read<uint8_t>(DW3K_RX_CAL_STS)) return last_status;
+    if (!dw3k_read(DW3K_RX_CAL_STS)) return last_status;
     dw3k_write(DW3K_LDO_CTRL, 0x0u);
     dw3k_write(DW3K_RX_CAL, 0x00030000u);  // COMP_DLY=2 + read (deca_driver)
-    auto const resi = dw3k_read<uint32_t>(DW3K_RX_CAL_RESI);
-    auto const resq = dw3k_read<uint32_t>(DW3K_RX_CAL_RESQ);
+    auto const resi = dw3k_read(DW3K_RX_CAL_RESI);
+    auto const resq = dw3k_read(DW3K_RX_CAL_RESQ);
     if (resi == 0x1FFFFFFF || resq == 0x1FFFFFFF) {
       last_status = DS::ChipError;
       error_text = "Chip: RX calibration failed";
@@ -146,14 +276,15 @@ DW3KStatus dw3k_poll() {
   // Handle TX/RX completion
   //
 
-  auto const sys_state = dw3k_read<uint32_t>(DW3K_SYS_STATE);
+  auto const sys_state = dw3k_read(DW3K_SYS_STATE);
   if (last_status == DS::TransmitWait) {
     if (sys_status & 0xF0) {
       last_status = DS::TransmitActive;
-      dw3k_write(DW3K_SYS_STATUS_64, 0xF0);  // Clear bit
+      // Only the bits seen, TXFRS may have come since (late poll)
+      dw3k_write(DW3K_SYS_STATUS, sys_status & 0xF0);
     } else if (sys_status & 0x8000000) {
       last_status = DS::TransmitTooLate;
-      dw3k_write(DW3K_SYS_STATUS_64, 0x8000000);  // Clear bit
+      dw3k_write(DW3K_SYS_STATUS, 0x8000000);  // Clear bit
     } else if (sys_state == 0xD0000) {
       // See DW3000 user Manual 9.4.1 "Delayed TX Notes", and:
       // https://forum.qorvo.com/t/dw3000-hpdwarn-errata-need-clarification/12263
@@ -163,124 +294,291 @@ DW3KStatus dw3k_poll() {
   }
 
   if (last_status == DS::TransmitActive && (sys_status & 0x80)) {
-    dw3k_write(DW3K_SYS_STATUS_64, 0x80);  // Clear bit
-    last_status = DS::TransmitDone;
+    // Clear TXPHS (set after the 0xF0 clear above) too, or the next
+    // TransmitWait would see it and miss a late (HPDWARN) schedule
+    dw3k_write(DW3K_SYS_STATUS, 0xF0);  // Clear bits
+    last_status = tx_then_rx ? DS::ReceiveListen : DS::TransmitDone;
   }
 
   auto const pmsc_state = (sys_state >> 16) & 0xFF;
   if (
       (last_status == DS::TransmitWait || last_status == DS::TransmitActive) &&
       (pmsc_state < 0x8 || pmsc_state > 0xF) &&
-      !(dw3k_read<uint32_t>(DW3K_SYS_STATUS_64) & 0xF0)
+      !(dw3k_read(DW3K_SYS_STATUS) & 0xF0)
   ) {
     last_status = DS::ChipError;
     error_text = "Chip: PMSC not in TX state";
   }
 
+  if (last_status == DS::ReceiveListen && rx_delayed &&
+      (sys_status & 0x8000000)) {
+    // DX_TIME had passed (HPDWARN), so the receiver would only turn on
+    // after SYS_TIME wraps (~17s), with RX_FWTO not counting until then
+    dw3k_command(DW3K_TXRXOFF);
+    dw3k_write(DW3K_SYS_STATUS, 0x8000000);  // Clear bit
+    last_status = DS::ReceiveTooLate;
+  }
+
+  if (
+      (last_status == DS::ReceiveListen || last_status == DS::ReceiveAnalyze) &&
+      (sys_status & 0x20000)
+  ) {
+    dw3k_write(DW3K_SYS_STATUS, 0x20000);  // Clear RXFTO
+    last_status = DS::ReceiveTimeout;
+  }
+
+  // Damaged frames (RXPHE, RXFCE, RXFSL, RXSTO); the chip listens on (RXAUTR)
+  if (
+      (last_status == DS::ReceiveListen || last_status == DS::ReceiveAnalyze) &&
+      (sys_status & 0x4019000)
+  ) {
+    dw3k_write(DW3K_SYS_STATUS, 0x4019000);  // Clear bits
+    ++rx_errors;
+  }
+
   if (last_status == DS::ReceiveListen && (sys_status & 0x4000)) {
-    dw3k_write(DW3K_SYS_STATUS_64, 0x4000);  // Clear bit
+    dw3k_write(DW3K_SYS_STATUS, 0x4000);  // Clear bit
     last_status = DS::ReceiveAnalyze;
   }
 
   if (last_status == DS::ReceiveAnalyze && (sys_status & 0x2000)) {
-    dw3k_write(DW3K_SYS_STATUS_64, 0x2000);  // Clear bit
-    last_status = DS::ReceiveDone;
+    if (!(sys_status & 0x8)) {
+      dw3k_write(DW3K_SYS_STATUS, 0x2000);  // Clear bit
+      last_status = DS::ReceiveDone;
+    } else if (sys_status & 0x80) {
+      // AAT: the chip sent an auto-ACK, done once it's out (TXFRS)
+      dw3k_write(DW3K_SYS_STATUS, 0x20F8);  // Clear bits
+      last_status = DS::ReceiveDone;
+    }
   }
 
+  // (After DTX_W4R or DRX the receiver may not be on yet)
   if (
       (last_status == DS::ReceiveListen || last_status == DS::ReceiveAnalyze) &&
+      !(last_status == DS::ReceiveListen && (tx_then_rx || rx_delayed)) &&
       (pmsc_state < 0x12 || pmsc_state > 0x19) &&
-      !(dw3k_read<uint32_t>(DW3K_SYS_STATUS_64) & 0x4400)
+      !(dw3k_read(DW3K_SYS_STATUS) & 0x4400)
   ) {
     last_status = DS::ChipError;
     error_text = "Chip: PMSC not in RX state";
   }
-      
+
+  if (last_status == DS::ReceiveContinuous) {
+    if (sys_status & 0x100000) {  // RXOVRR, both buffers were full
+      ++rx_dropped;
+      dw3k_write(DW3K_SYS_STATUS, 0x100000);  // Clear bit
+    }
+    // Clear the summary bits first, so a frame landing meanwhile raises
+    // them (and IRQ) again; per-buffer state stays in RDB_STATUS
+    if (sys_status & 0x6F00) dw3k_write(DW3K_SYS_STATUS, 0x6F00);
+    drain_rx_buffers();
+  }
+
   return last_status;
 }
 
+DW3KStatus dw3k_poll() {
+  DW3K_SPI_CALLER();
+  using DS = DW3KStatus;
+  auto const before = last_status;
+  rx_queued = 0;
+  auto const status = poll_status();
+  if (!irq_mode) return status;
+
+  for (; rx_queued > 0; --rx_queued) {
+    if (irq_callbacks.receive_done) irq_callbacks.receive_done();
+  }
+  if (status == before) return status;
+
+  switch (status) {
+    case DS::TransmitDone:
+      if (irq_callbacks.transmit_done) irq_callbacks.transmit_done();
+      break;
+    case DS::ReceiveDone:
+      if (irq_callbacks.receive_done) irq_callbacks.receive_done();
+      break;
+    case DS::TransmitTooLate:
+    case DS::ReceiveTimeout:
+    case DS::ReceiveTooLate:
+    case DS::ChipError:
+    case DS::CodeBug:
+      if (irq_callbacks.error) irq_callbacks.error(status);
+      break;
+    default:
+      break;
+  }
+  return status;
+}
+
 uint32_t dw3k_clock_t32() {
+  DW3K_SPI_CALLER();
   if (last_status < DW3KStatus::ResetWaitPLL)
     return bug("BUG: Not ready for dw3k_clock_t32"), 0;
-  dw3k_write<uint8_t>(DW3K_SYS_TIME, 0);
-  return dw3k_read<uint32_t>(DW3K_SYS_TIME);
+  uint8_t const zero = 0;
+  dw3k_write(DW3K_SYS_TIME, &zero, 1);
+  return dw3k_read(DW3K_SYS_TIME);
+}
+
+void dw3k_set_phy(DW3KPhyProfile const& profile) {
+  DW3K_SPI_CALLER();
+  bool const running = last_status >= DW3KStatus::ResetWaitPLL &&
+      last_status <= DW3KStatus::Ready;
+  if (!running) {
+    phy = profile;  // For the next reset
+    return;
+  }
+
+  if (last_status != DW3KStatus::Ready)
+    return bug("BUG: Not ready for dw3k_set_phy");
+  if (profile.channel != phy.channel)
+    return bug("BUG: dw3k_set_phy channel change needs dw3k_reset");
+  DW3KPhyProfile const before = phy;
+  phy = profile;
+  write_phy(&before);
+}
+
+DW3KPhyProfile const& dw3k_phy() { return phy; }
+
+void dw3k_set_long_frames(bool enable) {
+  DW3K_SPI_CALLER();
+  if (last_status != DW3KStatus::Ready)
+    return bug("BUG: Not ready for dw3k_set_long_frames");
+  dw3k_maskset(DW3K_SYS_CFG, ~0x10u, enable ? 0x10 : 0);  // PHR_MODE
+}
+
+int dw3k_max_packet_size() {
+  DW3K_SPI_CALLER();
+  if (last_status < DW3KStatus::ResetWaitPLL)
+    return bug("BUG: Not ready for dw3k_max_packet_size"), 0;
+  auto const long_frames = dw3k_read(DW3K_SYS_CFG) & 0x10;  // Cached
+  return long_frames ? dw3k_packet_size : dw3k_std_packet_size;
+}
+
+void dw3k_set_frame_filter(DW3KFrameFilter const& filter) {
+  DW3K_SPI_CALLER();
+  if (last_status != DW3KStatus::Ready)
+    return bug("BUG: Not ready for dw3k_set_frame_filter");
+
+  if (!filter.allow) {
+    dw3k_maskset(DW3K_SYS_CFG, ~0x1u, 0);  // Clear FFEN
+    dw3k_write(DW3K_FF_CFG, uint16_t(0));
+    return;
+  }
+
+  uint32_t const panadr =
+      (uint32_t(filter.pan_id) << 16) | filter.short_address;
+  dw3k_write(DW3K_PANADR, panadr);
+  if (filter.eui) dw3k_write(DW3K_EUI_64, filter.eui);
+  dw3k_write(DW3K_FF_CFG, filter.allow);
+  dw3k_maskset(DW3K_SYS_CFG, ~0x1u, 0x1);  // FFEN
+}
+
+void dw3k_set_auto_ack(bool enable, uint8_t ack_symbols) {
+  DW3K_SPI_CALLER();
+  if (last_status != DW3KStatus::Ready)
+    return bug("BUG: Not ready for dw3k_set_auto_ack");
+  dw3k_maskset(DW3K_ACK_RESP_T, 0x00FFFFFFu, uint32_t(ack_symbols) << 24);
+  dw3k_maskset(DW3K_SYS_CFG, ~0x800u, enable ? 0x800 : 0);  // AUTO_ACK
 }
 
 void dw3k_buffer_tx(void const* data, int size) {
-  if (size < 0 || tx_buffer_size + size >= dw3k_packet_size)
-    return bug("BUG: Bad size for dw3k_start_transmit");
+  DW3K_SPI_CALLER();
   if (last_status != DW3KStatus::Ready)
     return bug("BUG: Not ready for dw3k_tx_buffer");
+  if (size < 0 || tx_buffer_size + size > dw3k_max_packet_size())
+    return bug("BUG: Bad size for dw3k_buffer_tx");
 
   dw3k_write({DW3K_TX_BUFFER.file, tx_buffer_size}, data, size);
   tx_buffer_size += size;
 
-  uint32_t const fctrl = (cache_tx_fctrl_lo & ~0x300u) | (tx_buffer_size + 2);
-  if (fctrl != cache_tx_fctrl_lo)
-    dw3k_write(DW3K_TX_FCTRL_64, (cache_tx_fctrl_lo = fctrl));
+  dw3k_maskset(DW3K_TX_FCTRL, ~0x3FFu, tx_buffer_size + 2);  // TXFLEN
 }
 
-void dw3k_schedule_tx(uint32_t sched_t32) {
+void dw3k_schedule_tx(uint32_t sched_t32, bool then_rx) {
+  DW3K_SPI_CALLER();
   if (last_status != DW3KStatus::Ready)
     return bug("BUG: Not ready for dw3k_start_transmit");
 
   dw3k_write(DW3K_DX_TIME, sched_t32);
-  dw3k_command(DW3K_DTX);
+  dw3k_command(then_rx ? DW3K_DTX_W4R : DW3K_DTX);
+  tx_then_rx = then_rx;
   last_status = DW3KStatus::TransmitWait;
 }
 
+// W4R_TIM and RX_FWTO count in units of 512 chip clocks (~1.026us)
+static uint32_t micros_to_uus(uint32_t micros) {
+  return (uint64_t(micros) * 4992 + 5119) / 5120;
+}
+
+void dw3k_set_rx_after_tx(uint32_t delay_micros) {
+  DW3K_SPI_CALLER();
+  if (last_status != DW3KStatus::Ready)
+    return bug("BUG: Not ready for dw3k_set_rx_after_tx");
+  auto const uus = micros_to_uus(delay_micros);
+  if (uus > 0xFFFFF) return bug("BUG: Bad delay for dw3k_set_rx_after_tx");
+  dw3k_maskset(DW3K_ACK_RESP_T, ~0xFFFFFu, uus);  // W4R_TIM
+}
+
+void dw3k_set_rx_timeout(uint32_t timeout_micros) {
+  DW3K_SPI_CALLER();
+  if (last_status != DW3KStatus::Ready)
+    return bug("BUG: Not ready for dw3k_set_rx_timeout");
+  auto const uus = micros_to_uus(timeout_micros);
+  if (uus > 0xFFFFF) return bug("BUG: Bad timeout for dw3k_set_rx_timeout");
+  if (uus) dw3k_write(DW3K_RX_FWTO, uus);
+  dw3k_maskset(DW3K_SYS_CFG, ~0x200u, uus ? 0x200 : 0);  // RXWTOE
+}
+
 uint32_t dw3k_tx_leadtime_t32() {
+  DW3K_SPI_CALLER();
   if (last_status < DW3KStatus::ResetWaitPLL)
     return bug("BUG: Not ready for dw3k_tx_leadtime_t32"), 0;
-
-  int pre_sym;
-  switch ((dw3k_read<uint16_t>(DW3K_TX_FCTRL_64) >> 12) & 0xF) {
-    case 0x1: pre_sym = 64; break;
-    case 0x2: pre_sym = 1024; break;
-    case 0x3: pre_sym = 4096; break;
-    case 0x4: pre_sym = 32; break;
-    case 0x5: pre_sym = 128; break;
-    case 0x6: pre_sym = 1536; break;
-    case 0x9: pre_sym = 256; break;
-    case 0xA: pre_sym = 2048; break;
-    case 0xD: pre_sym = 512; break;
-    default:
-      last_status = DW3KStatus::ChipError;
-      error_text = "Chip: Bad TXPSR value";
-      return 0;
-  }
-
-  auto const sym_count = pre_sym + ((cache_chan_ctrl & 0x6) == 0x4 ? 16 : 8);
-  auto const sym_t = (cache_chan_ctrl & 0xF8) <= 0x40 ? 993.59e-9 : 1017.63e-9;
-  auto const t = sym_count * sym_t + 20e-6;
-  return uint32_t(t * dw3k_time32_hz) + 1;
+  return phy.leadtime_t32;
 }
 
 uint64_t dw3k_tx_expected_t40(uint32_t sched_t32) {
+  DW3K_SPI_CALLER();
   if (last_status < DW3KStatus::ResetWaitPLL)
     return bug("BUG: Not ready for dw3k_tx_expect_t40"), 0;
-  static auto tx_delay40 = dw3k_read<uint16_t>(DW3K_TX_ANTD);
-  return (uint64_t(sched_t32 & ~1u) << 8) + tx_delay40;
+  return (dw3k_t40(dw3k_t32(sched_t32 & ~1u)) + dw3k_read(DW3K_TX_ANTD)).ticks;
 }
 
 uint64_t dw3k_tx_timestamp_t40() {
-  if (last_status != DW3KStatus::TransmitDone)
+  DW3K_SPI_CALLER();
+  bool const received_after = tx_then_rx &&
+      last_status >= DW3KStatus::ReceiveListen &&
+      last_status <= DW3KStatus::ReceiveTimeout;
+  if (last_status != DW3KStatus::TransmitDone && !received_after)
     return bug("BUG: Not ready for dw3k_tx_stamp"), 0;
-  return dw3k_read<uint64_t>(DW3K_TX_STAMP_64);
+  return dw3k_read(DW3K_TX_STAMP_64);
 }
 
 void dw3k_start_rx() {
+  DW3K_SPI_CALLER();
   if (last_status != DW3KStatus::Ready)
     return bug("BUG: Not ready for dw3k_start_rx");
   dw3k_command(DW3K_RX);
   last_status = DW3KStatus::ReceiveListen;
 }
 
+void dw3k_schedule_rx(uint32_t sched_t32) {
+  DW3K_SPI_CALLER();
+  if (last_status != DW3KStatus::Ready)
+    return bug("BUG: Not ready for dw3k_schedule_rx");
+  dw3k_write(DW3K_DX_TIME, sched_t32);
+  dw3k_command(DW3K_DRX);
+  rx_delayed = true;
+  last_status = DW3KStatus::ReceiveListen;
+}
+
+uint32_t dw3k_rx_errors() { return rx_errors; }
+
 int dw3k_rx_size() {
+  DW3K_SPI_CALLER();
   if (last_status != DW3KStatus::ReceiveAnalyze &&
       last_status != DW3KStatus::ReceiveDone)
     return bug("BUF: Not ready for dw3k_rx_size"), 0;
-  auto const size_with_crc = dw3k_read<uint16_t>(DW3K_RX_FINFO) & 0x3F;
+  auto const size_with_crc = rx_finfo & 0x3FF;  // RXFLEN
   if (size_with_crc < 2 || size_with_crc > dw3k_packet_size + 2) {
     last_status = DW3KStatus::ChipError;
     error_text = "Chip: Bad RX_FINFO packet size";
@@ -290,6 +588,7 @@ int dw3k_rx_size() {
 }
 
 void dw3k_retrieve_rx(int offset, int size, void* out) {
+  DW3K_SPI_CALLER();
   if (last_status != DW3KStatus::ReceiveAnalyze &&
       last_status != DW3KStatus::ReceiveDone)
     return bug("BUF: Not ready for dw3k_retrieve_rx");
@@ -298,25 +597,114 @@ void dw3k_retrieve_rx(int offset, int size, void* out) {
   dw3k_read({DW3K_RX_BUFFER0.file, uint16_t(offset)}, out, size);
 }
 
+void dw3k_start_retrieve_rx(int offset, int size, void* out, void (*done)()) {
+  DW3K_SPI_CALLER();
+  if (last_status != DW3KStatus::ReceiveAnalyze &&
+      last_status != DW3KStatus::ReceiveDone)
+    return bug("BUF: Not ready for dw3k_start_retrieve_rx");
+  if (offset < 0 || size < 0 || offset + size > dw3k_packet_size + 2)
+    return bug("BUG: Bad offset/size for dw3k_start_retrieve_rx");
+  dw3k_start_read({DW3K_RX_BUFFER0.file, uint16_t(offset)}, out, size, done);
+}
+
+void dw3k_stream_rx(
+    int size, int chunk_size, void* scratch,
+    void (*chunk)(void const* data, int offset, int size)) {
+  DW3K_SPI_CALLER();
+  if (last_status != DW3KStatus::ReceiveAnalyze &&
+      last_status != DW3KStatus::ReceiveDone)
+    return bug("BUF: Not ready for dw3k_stream_rx");
+  if (size < 0 || size > dw3k_packet_size + 2 || chunk_size <= 0)
+    return bug("BUG: Bad size for dw3k_stream_rx");
+
+  auto* const halves = static_cast<uint8_t*>(scratch);
+  auto const start = [&](int offset, int half) {
+    int const n = size - offset < chunk_size ? size - offset : chunk_size;
+    DW3KRegisterAddress const addr = {DW3K_RX_BUFFER0.file, uint16_t(offset)};
+    dw3k_start_read(addr, halves + half * chunk_size, n, nullptr);
+    return n;
+  };
+
+  int n = size > 0 ? start(0, 0) : 0;
+  for (int offset = 0, half = 0; offset < size; half ^= 1) {
+    while (dw3k_spi_busy()) {}
+    int const next = offset + n;
+    int const next_n = next < size ? start(next, half ^ 1) : 0;
+    chunk(halves + half * chunk_size, offset, n);
+    offset = next;
+    n = next_n;
+  }
+}
+
 uint64_t dw3k_rx_timestamp_t40() {
+  DW3K_SPI_CALLER();
   if (last_status != DW3KStatus::ReceiveDone)
     return bug("BUF: Not ready for dw3k_rx_timestamp_t40"), 0;
-  auto const stamp_lo = DW3K_RX_STAMP_64;
-  DW3KRegisterAddress stamp_hi{stamp_lo.file, uint16_t(stamp_lo.offset + 4)};
-  return dw3k_read<uint32_t>(stamp_lo) |
-      (uint64_t(dw3k_read<uint8_t>(stamp_hi)) << 32u);
+  return rx_info.rx_t40;
 }
 
 float dw3k_rx_clock_offset() {
+  DW3K_SPI_CALLER();
   if (last_status != DW3KStatus::ReceiveDone)
     return bug("BUF: Not ready for dw3k_rx_clock_offset"), 0;
-  int32_t car_int = dw3k_read<int32_t>(DW3K_DRX_CAR_INT) & 0x1FFFFF;
-  if (car_int & 0x100000) car_int |= 0xFFE00000;
-  return car_int * -0.5731e-9f;
+  if (!rx_offset_known) {  // The carrier integrator is elsewhere (0x06)
+    int32_t car_int = dw3k_read(DW3K_DRX_CAR_INT) & 0x1FFFFF;
+    if (car_int & 0x100000) car_int |= 0xFFE00000;
+    rx_info.clock_offset = car_int * -0.5731e-9f;
+    rx_offset_known = true;
+  }
+  return rx_info.clock_offset;
+}
+
+DW3KRxInfo const* dw3k_rx_info(bool clock_offset) {
+  DW3K_SPI_CALLER();
+  if (last_status != DW3KStatus::ReceiveDone)
+    return bug("BUF: Not ready for dw3k_rx_info"), nullptr;
+  rx_info.size = dw3k_rx_size();
+  if (clock_offset) dw3k_rx_clock_offset();
+  if (!clock_offset && !rx_offset_known) rx_info.clock_offset = 0;
+  return last_status == DW3KStatus::ReceiveDone ? &rx_info : nullptr;
+}
+
+void dw3k_start_rx_continuous(DW3KRxFrame* ring, int count) {
+  DW3K_SPI_CALLER();
+  if (!ring || count <= 0)
+    return bug("BUG: Bad ring for dw3k_start_rx_continuous");
+  if (last_status != DW3KStatus::Ready)
+    return bug("BUG: Not ready for dw3k_start_rx_continuous");
+
+  rx_ring = ring;
+  rx_ring_count = count;
+  rx_ring_next = rx_ring_used = 0;
+  rx_dropped = 0;
+  rx_host_buffer = 0;
+  dw3k_write(DW3K_RDB_STATUS, uint8_t(0xFF));  // Clear bits
+  dw3k_maskset(DW3K_SYS_CFG, ~0x8u, 0);  // Clear DIS_DRXB (RXAUTR stays on)
+  dw3k_command(DW3K_RX);
+  last_status = DW3KStatus::ReceiveContinuous;
+}
+
+DW3KRxFrame const* dw3k_rx_frame() {
+  if (!rx_ring_used) return nullptr;
+  int const oldest = rx_ring_next - rx_ring_used;
+  return &rx_ring[oldest < 0 ? oldest + rx_ring_count : oldest];
 }
 
+void dw3k_release_rx_frame() {
+  if (!rx_ring_used) return bug("BUG: No frame for dw3k_release_rx_frame");
+  --rx_ring_used;
+}
+
+uint32_t dw3k_rx_dropped() { return rx_dropped; }
+
 void dw3k_end_txrx() {
+  DW3K_SPI_CALLER();
   switch (last_status) {
+    case DW3KStatus::ReceiveContinuous:
+      dw3k_command(DW3K_TXRXOFF);
+      dw3k_maskset(DW3K_SYS_CFG, ~0u, 0x8);  // Set DIS_DRXB
+      if (irq_mode) dw3k_write(DW3K_SYS_STATUS, 0x100000);  // RXOVRR holds IRQ
+      break;
     case DW3KStatus::TransmitWait:
     case DW3KStatus::TransmitActive:
     case DW3KStatus::TransmitTooLate:
@@ -326,6 +714,8 @@ void dw3k_end_txrx() {
       break;
     case DW3KStatus::TransmitDone:
     case DW3KStatus::ReceiveDone:
+    case DW3KStatus::ReceiveTimeout:
+    case DW3KStatus::ReceiveTooLate:
     case DW3KStatus::Ready:
       break;
     default:
@@ -333,6 +723,7 @@ void dw3k_end_txrx() {
   }
 
   tx_buffer_size = 0;
+  tx_then_rx = rx_delayed = false;
   last_status = DW3KStatus::Ready;
 }
 
@@ -348,6 +739,9 @@ char const* dw3k_status_text() {
     S(ReceiveListen);
     S(ReceiveAnalyze);
     S(ReceiveDone);
+    S(ReceiveTimeout);
+    S(ReceiveTooLate);
+    S(ReceiveContinuous);
     S(TransmitWait);
     S(TransmitActive);
     S(TransmitDone);
@@ -359,50 +753,123 @@ char const* dw3k_status_text() {
   return "[BAD STATUS]";
 }
 
-bool dw3k_wait_verbose(DW3KStatus wanted, int timeout_millis) {
-  struct Counter { char const* n; DW3KRegisterAddress const a; int v; };
-  static Counter counters[] = {
-#define C(n) {#n, DW3K_EVC_##n, -1}
-    C(PHE), C(RSE), C(FCG), C(FCE), C(FFR), C(OVR), C(STO), C(PTO), C(FWTO),
-    C(TXFS), C(HPW), C(SWCE), C(CPQE), C(VWARN),
-#undef C
+void dw3k_read_diagnostics(DW3KDiagnostics* out, bool cia) {
+  DW3K_SPI_CALLER();
+  if (last_status < DW3KStatus::ResetWaitPLL)
+    return bug("BUG: Not ready for dw3k_read_diagnostics");
+
+  // EVC_PHE (0x0F:04) through SYS_STATE (0x0F:30); the counters are
+  // contiguous but for reserved space and DIAG_TMC before CPQE and VWARN
+  uint8_t evc[0x34 - 0x04];
+  dw3k_read(DW3K_EVC_PHE.address, evc, sizeof(evc));
+  for (int i = 0; i < dw3k_evc_count; ++i) {
+    int const at = i < 12 ? 2 * i : 0x28 - 0x04 + 2 * (i - 12);
+    out->evc[i] = evc[at] | evc[at + 1] << 8;
+  }
+  memcpy(&out->sys_state, &evc[0x30 - 0x04], sizeof(out->sys_state));
+
+  out->sys_status = 0;
+  dw3k_read(DW3K_SYS_STATUS_64.address, &out->sys_status, 6);
+  if (!cia) return;
+
+  // IP_TS (0x0C:00) through IP_DIAG_12 (0x0C:58)
+  uint8_t d[0x5C];
+  dw3k_read(DW3K_IP_TS_64.address, d, sizeof(d));
+  auto const u32 = [&d](int at) {
+    uint32_t v;
+    memcpy(&v, &d[at], sizeof(v));
+    return v;
   };
+  out->ip_t40 = 0;
+  memcpy(&out->ip_t40, &d[0x00], 5);
+  out->peak_amplitude = u32(0x28) & 0x1FFFFF;
+  out->peak_index = (u32(0x28) >> 21) & 0x3FF;
+  out->cir_power = u32(0x2C) & 0x1FFFF;
+  for (int i = 0; i < 3; ++i)
+    out->fp_amplitude[i] = u32(0x30 + 4 * i) & 0x3FFFFF;
+  out->fp_index = (u32(0x48) & 0xFFFF) / 64.0f;  // 10.6 fixed point
+  out->preamble_count = u32(0x58) & 0xFFF;
+}
+
+float dw3k_first_path_dbm(DW3KDiagnostics const& d) {
+  float sum = 0;
+  for (auto const f : d.fp_amplitude) sum += float(f) * float(f);
+  if (!d.preamble_count || sum <= 0) return -200;  // Nothing received
+  float const n = d.preamble_count;
+  float const a = phy.preamble_code <= 8 ? 113.8f : 121.7f;  // PRF 16/64MHz
+  return 10 * log10f(sum / (n * n)) - a;
+}
+
+bool dw3k_wait_verbose(DW3KStatus wanted, int timeout_millis) {
+  DW3K_SPI_CALLER();
+  static int counters[dw3k_evc_count] = {};  // Last shown, -1 for never
+  static bool counters_init = false;
+  if (!counters_init) {
+    for (auto& c : counters) c = -1;
+    counters_init = true;
+  }
 
   auto const start_millis = millis();
   auto last_status = DW3KStatus::Invalid;
   for (int32_t i = 0;; ++i) {
     auto const status = dw3k_poll();
-    if (status != last_status || !(i % 10000)) {
-      if (status >= DW3KStatus::ResetWaitPLL) {
+    bool const show_status = status != last_status || !(i % 10000);
+    bool const check_counters = !(i % 1000);
+    DW3KDiagnostics diag = {};
+    bool const have_diag = (show_status || check_counters) &&
+        status >= DW3KStatus::ResetWaitPLL;
+    if (have_diag) dw3k_read_diagnostics(&diag, false);
+
+    if (show_status) {
+#if DW3K_TELEMETRY
+      DW3KTelemetryStatus const r = {
+          uint8_t(status), diag.sys_status, diag.sys_state};
+      dw3k_telemetry_log(DW3KTelemetryType::Status, &r, sizeof(r));
+      if (status == DW3KStatus::ChipError || status == DW3KStatus::CodeBug)
+        dw3k_telemetry_text(dw3k_status_text());
+#else
+      if (have_diag) {
         Serial.printf(
-            "DW3K %-15s (status=%012x state=%08x)...\n",
+            "DW3K %-15s (status=%04x%08x state=%08x)...\n",
             dw3k_status_text(),
-            dw3k_read<uint64_t>(DW3K_SYS_STATUS_64),
-            dw3k_read<uint32_t>(DW3K_SYS_STATE)
+            unsigned(diag.sys_status >> 32), unsigned(diag.sys_status),
+            unsigned(diag.sys_state)
         );
       } else {
         Serial.printf("DW3K %s...\n", dw3k_status_text());
       }
+#endif
     }
 
-    if (!(i % 1000) && (status >= DW3KStatus::ResetWaitPLL)) {
+    if (check_counters && have_diag) {
       bool counter_changed = false;
-      for (auto& counter : counters) {
-        auto const v = dw3k_read<uint16_t>(counter.a);
-        if ((v > 0 || counter.v >= 0) && int32_t(v) != counter.v) {
-          counter.v = v;
+      for (int c = 0; c < dw3k_evc_count; ++c) {
+        int const v = diag.evc[c];
+        if ((v > 0 || counters[c] >= 0) && v != counters[c]) {
+          counters[c] = v;
           counter_changed = true;
         }
       }
+#if DW3K_TELEMETRY
+      if (counter_changed) {
+        dw3k_telemetry_log(
+            DW3KTelemetryType::Counters, diag.evc, sizeof(diag.evc));
+      }
+#else
       if (counter_changed) {
         Serial.printf("DW3K counters:");
-        for (auto& counter : counters) {
-          if (counter.v >= 0) Serial.printf(" %s=%d", counter.n, counter.v);
+        for (int c = 0; c < dw3k_evc_count; ++c) {
+          if (counters[c] >= 0)
+            Serial.printf(" %s=%d", dw3k_evc_names[c], counters[c]);
         }
         Serial.printf("\n");
       }
+#endif
     }
 
+#if DW3K_TELEMETRY
+    dw3k_telemetry_drain();
+#endif
     if (status == wanted) return true;
 
     if (timeout_millis && !(i % 100)) {
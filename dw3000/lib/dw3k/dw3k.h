@@ -15,6 +15,9 @@ enum class DW3KStatus {
   ReceiveListen,
   ReceiveAnalyze,
   ReceiveDone,
+  ReceiveTimeout,
+  ReceiveTooLate,
+  ReceiveContinuous,
   Ready,
   ChipError,
   CodeBug,
@@ -23,25 +26,160 @@ enum class DW3KStatus {
 static constexpr double dw3k_chip_hz = 499.2e6;
 static constexpr double dw3k_time32_hz = dw3k_chip_hz / 2;
 static constexpr double dw3k_time40_hz = dw3k_chip_hz * 128;
-static constexpr int dw3k_packet_size = 1023 - 2;
+static constexpr int dw3k_packet_size = 1023 - 2;     // Long frames (default)
+static constexpr int dw3k_std_packet_size = 127 - 2;  // Standard IEEE PHR
+
+// Completion handlers invoked from dw3k_poll() in IRQ mode (any may be null).
+struct DW3KCallbacks {
+  void (*transmit_done)();
+  void (*receive_done)();  // Also for each frame queued by continuous RX
+  void (*error)(DW3KStatus);  // Too late, ReceiveTimeout or errors
+};
 
 void dw3k_reset();
+void dw3k_use_irq(DW3KCallbacks const&);
 DW3KStatus dw3k_poll();
 uint32_t dw3k_clock_t32();
 
+// Long frames use the chip's extended PHR (SYS_CFG PHR_MODE), which standard
+// 802.15.4 receivers can't decode; both ends must agree.
+void dw3k_set_long_frames(bool enable);
+int dw3k_max_packet_size();
+
+// IEEE 802.15.4 data frame header with PAN ID compression and short
+// addresses, which the frame filter understands (payload follows).
+struct __attribute__((packed)) DW3KMacHeader {
+  uint16_t frame_control;  // dw3k_mac_data, maybe | dw3k_mac_ack_request
+  uint8_t sequence;
+  uint16_t pan_id;
+  uint16_t dest;           // 0xFFFF for broadcast
+  uint16_t source;
+};
+
+static constexpr uint16_t dw3k_mac_data = 0x8841;
+static constexpr uint16_t dw3k_mac_ack_request = 0x0020;
+static constexpr int dw3k_mac_ack_size = 3;  // Auto-ACK: control, sequence
+
+// Hardware frame filtering: only 802.15.4 frames of the types in "allow"
+// (FF_CFG bits, e.g. 0x2 data, 0x4 ACK) addressed to this PAN and address
+// (or broadcast) complete reception; others are dropped by the chip, which
+// keeps listening, so they cost no SPI traffic. Zero "allow" turns it off.
+struct DW3KFrameFilter {
+  uint16_t pan_id;
+  uint16_t short_address;
+  uint64_t eui;  // Extended address; 0 leaves EUI_64 alone
+  uint16_t allow;
+};
+
+void dw3k_set_frame_filter(DW3KFrameFilter const&);
+
+// With filtering on, the chip answers data frames asking for an ACK by
+// itself, ack_symbols (ACK_RESP_T ACK_TIM) after reception; 0 is as soon
+// as possible. ReceiveDone then waits for the ACK to go out. Not for
+// continuous RX.
+void dw3k_set_auto_ack(bool enable, uint8_t ack_symbols = 0);
+
 void dw3k_buffer_tx(void const* data, int size);
-void dw3k_schedule_tx(uint32_t sched_t32);
+
+// With then_rx (DTX_W4R) the chip turns its receiver on by itself after
+// sending, so the status goes from TransmitActive straight to ReceiveListen
+// (no TransmitDone); dw3k_tx_timestamp_t40() works until dw3k_end_txrx().
+void dw3k_schedule_tx(uint32_t sched_t32, bool then_rx = false);
+
+// Time from the end of a then_rx transmission to the receiver opening
+// (W4R_TIM, up to ~1s); e.g. a known reply delay minus some margin.
+void dw3k_set_rx_after_tx(uint32_t delay_micros);
+
+// Reception gives up with ReceiveTimeout if no frame arrives within
+// timeout_micros of the receiver opening (RX_FWTO, up to ~1s). Zero waits
+// forever; use that for continuous RX, which has no timeout handling.
+void dw3k_set_rx_timeout(uint32_t timeout_micros);
+
 uint32_t dw3k_tx_leadtime_t32();
 uint64_t dw3k_tx_expected_t40(uint32_t sched_t32);
 uint64_t dw3k_tx_timestamp_t40();
 
 void dw3k_start_rx();
+// Receiver on at sched_t32 (DRX); ReceiveTooLate (and the receiver stays
+// off) if that had passed, as the chip would otherwise wait a clock wrap
+void dw3k_schedule_rx(uint32_t sched_t32);
+uint32_t dw3k_rx_errors();  // Damaged frames (e.g. collisions) while listening
 int dw3k_rx_size();
 void dw3k_retrieve_rx(int offset, int size, void* out);
+void dw3k_start_retrieve_rx(int offset, int size, void* out, void (*done)());
+
+// Retrieves the first "size" payload bytes in pieces of up to chunk_size,
+// passing each to "chunk" while the next one is read (by DMA where possible)
+// into the other half of "scratch", which must hold 2 * chunk_size bytes.
+void dw3k_stream_rx(
+    int size, int chunk_size, void* scratch,
+    void (*chunk)(void const* data, int offset, int size));
 uint64_t dw3k_rx_timestamp_t40();
 float dw3k_rx_clock_offset();
 
+// The frame just received (ReceiveDone) in one go. The poll that saw it
+// complete read SYS_STATUS, RX_FINFO and RX_STAMP in the same burst, so
+// this (like dw3k_rx_size() and dw3k_rx_timestamp_t40()) costs no SPI
+// traffic, bar one read for clock_offset (the carrier integrator lives in
+// another register file); then only the payload is left to read. Null
+// after a bad RX_FINFO (ChipError).
+struct DW3KRxInfo {
+  int size;             // Payload size (without CRC)
+  uint64_t rx_t40;      // As dw3k_rx_timestamp_t40()
+  uint64_t sys_status;  // SYS_STATUS as the frame completed
+  float clock_offset;   // As dw3k_rx_clock_offset(), if asked for (else 0)
+};
+
+DW3KRxInfo const* dw3k_rx_info(bool clock_offset = true);
+
+// Continuous reception using the chip's double RX buffer: the radio fills one
+// buffer while dw3k_poll() drains the other into a ring of frames supplied by
+// the caller (whose data/capacity must be set). Runs until dw3k_end_txrx().
+struct DW3KRxFrame {
+  uint8_t* data;
+  int capacity;
+  int size;            // Payload size (without CRC), may exceed capacity
+  uint64_t rx_t40;     // As dw3k_rx_timestamp_t40()
+  float clock_offset;  // As dw3k_rx_clock_offset()
+};
+
+void dw3k_start_rx_continuous(DW3KRxFrame* ring, int count);
+DW3KRxFrame const* dw3k_rx_frame();  // Oldest unreleased frame, or null
+void dw3k_release_rx_frame();
+uint32_t dw3k_rx_dropped();  // Frames lost to a full ring or buffer overrun
+
 void dw3k_end_txrx();
 
+// Chip health in a few burst reads rather than a read per register: the
+// event counters (EVC_*, counting since dw3k_reset()) and SYS_STATE in one,
+// SYS_STATUS in another and, with "cia", the CIA's diagnostics for the
+// last frame received (IP = preamble based) in a third.
+static constexpr char const* dw3k_evc_names[] = {
+    "PHE", "RSE", "FCG", "FCE", "FFR", "OVR", "STO", "PTO", "FWTO",
+    "TXFS", "HPW", "SWCE", "CPQE", "VWARN",
+};
+
+static constexpr int dw3k_evc_count =
+    sizeof(dw3k_evc_names) / sizeof(dw3k_evc_names[0]);
+
+struct DW3KDiagnostics {
+  uint16_t evc[dw3k_evc_count];  // As dw3k_evc_names
+  uint64_t sys_status;
+  uint32_t sys_state;
+
+  uint64_t ip_t40;           // IP_TS, the preamble's view of the RX time
+  uint32_t peak_amplitude;   // IP_DIAG_0, strongest CIR tap
+  uint16_t peak_index;
+  uint32_t cir_power;        // IP_DIAG_1
+  uint32_t fp_amplitude[3];  // IP_DIAG_2-4, around the first path
+  float fp_index;            // IP_DIAG_8, first path (CIR taps)
+  uint16_t preamble_count;   // IP_DIAG_12, preamble symbols accumulated
+};
+
+void dw3k_read_diagnostics(DW3KDiagnostics* out, bool cia = true);
+
+// First path power (dBm) of the frame in a snapshot (DW3000 User Manual 4.7.1)
+float dw3k_first_path_dbm(DW3KDiagnostics const&);
+
 char const* dw3k_status_text();
 bool dw3k_wait_verbose(DW3KStatus wanted, int timeout_millis = 0);
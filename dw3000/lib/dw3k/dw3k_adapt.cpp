@@ -0,0 +1,168 @@
+#include "dw3k_adapt.h"
+
+#include <Arduino.h>
+
+struct Link {
+  bool used;
+  uint16_t peer;
+  unsigned long heard_micros;
+  int step;
+  float errors;
+  bool probing;  // The latest dw3k_adapt_profile() was a step faster
+  int good_run;  // Exchanges through in a row at this step
+  int probe_wait;
+  bool heard_power;  // first_path_dbm is set
+  float first_path_dbm;
+  float line_of_sight;
+  bool heard_evc;  // evc is set
+  uint16_t evc[3];  // PHE, RSE, FCE as of the last reply
+  uint32_t exchanges, failures, probes, probe_failures, rx_errors;
+};
+
+static DW3KAdaptConfig config = dw3k_adapt_ch5;
+static Link links[dw3k_adapt_max_peers];
+
+static Link* find(uint16_t peer) {
+  for (auto& l : links) {
+    if (l.used && l.peer == peer) return &l;
+  }
+  return nullptr;
+}
+
+// Finds the peer, or starts it (in a free entry or the one heard from least
+// recently) at the slowest step
+static Link* link(uint16_t peer) {
+  Link* link = find(peer);
+  if (link) return link;
+  for (auto& l : links) {
+    if (!l.used) {
+      link = &l;
+      break;
+    }
+  }
+  if (!link) {
+    link = &links[0];
+    for (auto& l : links) {
+      if (long(l.heard_micros - link->heard_micros) < 0) link = &l;
+    }
+  }
+
+  *link = {};
+  link->used = true;
+  link->peer = peer;
+  link->heard_micros = micros();
+  link->step = config.step_count - 1;
+  link->probe_wait = dw3k_adapt_probe_wait;
+  return link;
+}
+
+// First path power over a step's sensitivity, less the extra margin wanted
+// without line of sight
+static float margin_db(Link const* l, int step) {
+  float const nlos = l->line_of_sight < 0.5f ? dw3k_adapt_nlos_margin_db : 0;
+  return l->first_path_dbm - config.steps[step]->sensitivity_dbm - nlos;
+}
+
+static void change_step(Link* l, int step) {
+  l->step = step;
+  l->errors = 0;
+  l->good_run = 0;
+}
+
+static void back_off(Link* l) {
+  l->good_run = 0;
+  l->probe_wait *= 2;
+  if (l->probe_wait > dw3k_adapt_max_probe_wait)
+    l->probe_wait = dw3k_adapt_max_probe_wait;
+}
+
+void dw3k_adapt_setup(DW3KAdaptConfig const& c) {
+  config = c;
+  if (config.step_count > dw3k_adapt_max_steps)
+    config.step_count = dw3k_adapt_max_steps;
+  for (auto& l : links) l = {};
+}
+
+DW3KPhyProfile const& dw3k_adapt_profile(uint16_t peer) {
+  if (config.step_count <= 0) return dw3k_phy();
+  Link* const l = link(peer);
+  int const faster = l->step - 1;
+  l->probing = faster >= 0 && l->good_run >= l->probe_wait &&
+      l->errors < config.target_errors / 2 &&
+      (!l->heard_power ||
+       margin_db(l, faster) >= dw3k_adapt_margin_db + dw3k_adapt_hysteresis_db);
+  return *config.steps[l->probing ? faster : l->step];
+}
+
+void dw3k_adapt_result(
+    uint16_t peer, bool delivered, DW3KDiagnostics const* reply) {
+  if (config.step_count <= 0) return;
+  Link* const l = link(peer);
+  l->heard_micros = micros();
+  ++l->exchanges;
+  if (!delivered) ++l->failures;
+
+  if (reply && delivered) {
+    float const dbm = dw3k_first_path_dbm(*reply);
+    float fp = 0;
+    for (auto const a : reply->fp_amplitude) fp += a;
+    float const los = reply->peak_amplitude ?
+        fp / 3 / reply->peak_amplitude : 0;
+    float const k = l->heard_power ? dw3k_adapt_smoothing * 4 : 1;
+    l->first_path_dbm += k * (dbm - l->first_path_dbm);
+    l->line_of_sight += k * (los - l->line_of_sight);
+    l->heard_power = true;
+
+    uint16_t const evc[3] = {reply->evc[0], reply->evc[1], reply->evc[3]};
+    for (int i = 0; i < 3 && l->heard_evc; ++i)
+      l->rx_errors += uint16_t(evc[i] - l->evc[i]);
+    for (int i = 0; i < 3; ++i) l->evc[i] = evc[i];
+    l->heard_evc = true;
+  }
+
+  if (l->probing) {
+    l->probing = false;
+    ++l->probes;
+    if (delivered) {
+      change_step(l, l->step - 1);
+      l->probe_wait = dw3k_adapt_probe_wait;
+    } else {
+      ++l->probe_failures;
+      back_off(l);
+    }
+    return;
+  }
+
+  l->errors += dw3k_adapt_smoothing * ((delivered ? 0 : 1) - l->errors);
+  l->good_run = delivered ? l->good_run + 1 : 0;
+  bool const slower = l->step + 1 < config.step_count;
+  bool const fading = l->heard_power &&
+      margin_db(l, l->step) < dw3k_adapt_margin_db;
+  if (slower && (l->errors > config.target_errors || fading)) {
+    change_step(l, l->step + 1);
+    back_off(l);
+  }
+}
+
+void dw3k_adapt_forget(uint16_t peer) {
+  Link* const l = find(peer);
+  if (l) *l = {};
+}
+
+bool dw3k_adapt_peer(uint16_t peer, DW3KAdaptPeer* out) {
+  Link const* const l = find(peer);
+  if (!l) return false;
+  *out = {};
+  out->peer = l->peer;
+  out->step = l->step;
+  out->errors = l->errors;
+  out->first_path_dbm = l->heard_power ? l->first_path_dbm : -200;
+  out->line_of_sight = l->line_of_sight;
+  out->exchanges = l->exchanges;
+  out->failures = l->failures;
+  out->probes = l->probes;
+  out->probe_failures = l->probe_failures;
+  out->rx_errors = l->rx_errors;
+  out->airtime_ns = dw3k_phy_frame_ns(*config.steps[l->step], 32);
+  return true;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "dw3k.h"
+#include "dw3k_phy.h"
+
+// Link adaptation: per peer, the fastest PHY profile (shortest preamble,
+// highest data rate, so least airtime) that keeps frame errors under a
+// target, from a ladder of profiles on one channel, fastest first.
+//
+// Before an exchange with a peer, send with dw3k_adapt_profile(peer); after
+// it, report with dw3k_adapt_result() whether it got through, with the
+// reply's dw3k_read_diagnostics() snapshot if there was one. A responder
+// only hears every step while listening with dw3k_adapt_listen_profile()
+// (a profile's own PAC and SFD timeout miss other preamble lengths); it may
+// reply with the step it heard, then should go back to listening with that.
+//
+// Each peer keeps a smoothed frame error rate per step and the first path
+// power of its replies (with how line-of-sight they look). It steps down
+// (slower) once the error rate passes the target, or as soon as the first
+// path fades to within dw3k_adapt_margin_db of the step's sensitivity
+// (more if the replies don't look line-of-sight). After a run of good
+// exchanges, with dw3k_adapt_hysteresis_db more margin than that for the
+// faster step, it tries one frame a step faster and stays there if that
+// gets through; failed tries, and stepping down, double the run wanted
+// (up to dw3k_adapt_max_probe_wait). New peers start at the slowest step.
+//
+// The table holds dw3k_adapt_max_peers peers, dropping the one heard from
+// least recently for a new one.
+
+static constexpr int dw3k_adapt_max_steps = 8;
+static constexpr int dw3k_adapt_max_peers = 16;
+static constexpr float dw3k_adapt_margin_db = 6;  // Wanted over sensitivity
+static constexpr float dw3k_adapt_nlos_margin_db = 3;  // Extra if not LOS
+static constexpr float dw3k_adapt_hysteresis_db = 3;  // Extra to go faster
+static constexpr float dw3k_adapt_smoothing = 1.0f / 32;  // Per exchange
+static constexpr int dw3k_adapt_probe_wait = 4;  // Good exchanges, at first
+static constexpr int dw3k_adapt_max_probe_wait = 256;
+
+struct DW3KAdaptConfig {
+  DW3KPhyProfile const* steps[dw3k_adapt_max_steps];  // Fastest first
+  int step_count;
+  float target_errors;  // Frame error rate to stay under, e.g. 0.05
+};
+
+// Fast 6.8Mbps, 850kbps, then longer preambles, on channel 5
+static constexpr DW3KAdaptConfig dw3k_adapt_ch5 = {
+    {&dw3k_phy_ch5_fast, &dw3k_phy_ch5_default, &dw3k_phy_ch5_medium,
+     &dw3k_phy_ch5_long_range},
+    4, 0.05f};
+
+// The shortest preamble's profile (for its PAC), with an SFD timeout for the
+// longest preamble on the ladder
+constexpr DW3KPhyProfile dw3k_adapt_listen_profile(
+    DW3KAdaptConfig const& c, char const* name) {
+  DW3KPhyProfile const* shortest = c.steps[0];
+  int longest = 0;
+  for (int i = 0; i < c.step_count; ++i) {
+    auto const symbols = c.steps[i]->preamble_symbols;
+    if (symbols < shortest->preamble_symbols) shortest = c.steps[i];
+    if (symbols > longest) longest = symbols;
+  }
+  return dw3k_phy_listen_profile(*shortest, longest, name);
+}
+
+static constexpr DW3KPhyProfile dw3k_adapt_ch5_listen =
+    dw3k_adapt_listen_profile(dw3k_adapt_ch5, "ch5_adapt_listen");
+
+static_assert(dw3k_adapt_ch5_listen.pac_symbols == 8);
+static_assert(dw3k_adapt_ch5_listen.rx_sfd_toc == 1024 + 1 + 8 - 8);
+
+struct DW3KAdaptPeer {
+  uint16_t peer;
+  int step;                // Index into the ladder
+  float errors;            // Smoothed frame error rate at this step
+  float first_path_dbm;    // Smoothed, of replies
+  float line_of_sight;     // First path over CIR peak (1 is clean LOS)
+  uint32_t exchanges, failures;
+  uint32_t probes, probe_failures;
+  uint32_t rx_errors;      // Counted (EVC PHE, RSE, FCE) between replies
+  uint32_t airtime_ns;     // Of a 32-byte frame at this step
+};
+
+void dw3k_adapt_setup(DW3KAdaptConfig const&);
+DW3KPhyProfile const& dw3k_adapt_profile(uint16_t peer);
+void dw3k_adapt_result(
+    uint16_t peer, bool delivered, DW3KDiagnostics const* reply = nullptr);
+void dw3k_adapt_forget(uint16_t peer);
+
+bool dw3k_adapt_peer(uint16_t peer, DW3KAdaptPeer* out);  // False if unknown
@@ -0,0 +1,205 @@
+#include "dw3k_drift.h"
+
+#include <Arduino.h>
+#include <math.h>
+
+#include "dw3k.h"
+#include "dw3k_time.h"
+
+// State: phase (seconds, ours minus theirs, mod the 40-bit clock period),
+// offset, drift (1/s); all at our time t40
+struct Track {
+  bool used;
+  bool has_phase;
+  uint16_t peer;
+  uint8_t rejected_in_row;
+  uint64_t t40;
+  unsigned long heard_micros;
+  double x[3];
+  double p[3][3];
+  uint32_t observations, rejected;
+};
+
+static constexpr double period_s = (dw3k_t40_mask + 1) / dw3k_time40_hz;
+static constexpr double initial_offset_sigma = 50e-6;
+static constexpr double initial_drift_sigma = 1e-8;
+static constexpr double gate_sigmas = 5;
+
+static Track tracks[dw3k_drift_max_peers];
+
+static double span_s(uint64_t from_t40, uint64_t to_t40) {
+  return (dw3k_t40(to_t40) - dw3k_t40(from_t40)) / dw3k_time40_hz;
+}
+
+static double wrap_phase(double s) {
+  return s - period_s * floor(s / period_s + 0.5);
+}
+
+static Track* find(uint16_t peer) {
+  for (auto& t : tracks) {
+    if (t.used && t.peer == peer) return &t;
+  }
+  return nullptr;
+}
+
+// Starts a peer over, in a free entry or the one heard from least recently
+static Track* start(uint16_t peer, uint64_t t40) {
+  Track* track = find(peer);
+  for (auto& t : tracks) {
+    if (track) break;
+    if (!t.used) track = &t;
+  }
+  if (!track) {
+    track = &tracks[0];
+    for (auto& t : tracks) {
+      if (long(t.heard_micros - track->heard_micros) < 0) track = &t;
+    }
+  }
+
+  *track = {};
+  track->used = true;
+  track->peer = peer;
+  track->t40 = t40;
+  track->heard_micros = micros();
+  track->p[0][0] = period_s * period_s;
+  track->p[1][1] = initial_offset_sigma * initial_offset_sigma;
+  track->p[2][2] = initial_drift_sigma * initial_drift_sigma;
+  return track;
+}
+
+// Moves the state to our time t40 (using micros() to tell how many times
+// the 40-bit clock wrapped since)
+static void predict(Track* t, uint64_t t40) {
+  unsigned long const now = micros();
+  double const rough_s = (now - t->heard_micros) * 1e-6;
+  double dt = span_s(t->t40, t40);
+  dt += period_s * floor((rough_s - dt) / period_s + 0.5);
+  t->t40 = t40;
+  t->heard_micros = now;
+  if (dt == 0) return;
+
+  // x = F x, P = F P F' + Q for F = [1 dt dt^2/2; 0 1 dt; 0 0 1]
+  auto& x = t->x;
+  x[0] = wrap_phase(x[0] + x[1] * dt + x[2] * dt * dt / 2);
+  x[1] += x[2] * dt;
+
+  double const f[3][3] = {{1, dt, dt * dt / 2}, {0, 1, dt}, {0, 0, 1}};
+  double fp[3][3];
+  for (int i = 0; i < 3; ++i) {
+    for (int j = 0; j < 3; ++j) {
+      fp[i][j] = 0;
+      for (int k = 0; k < 3; ++k) fp[i][j] += f[i][k] * t->p[k][j];
+    }
+  }
+  for (int i = 0; i < 3; ++i) {
+    for (int j = 0; j < 3; ++j) {
+      t->p[i][j] = 0;
+      for (int k = 0; k < 3; ++k) t->p[i][j] += fp[i][k] * f[j][k];
+    }
+  }
+
+  // Random walk of the offset and of the drift
+  double const adt = fabs(dt);
+  double const qo = dw3k_drift_offset_walk * dw3k_drift_offset_walk;
+  double const qd = dw3k_drift_drift_walk * dw3k_drift_drift_walk;
+  double const dt2 = adt * adt, dt3 = dt2 * adt;
+  t->p[0][0] += qo * dt3 / 3 + qd * dt3 * dt2 / 20;
+  t->p[0][1] += qo * dt2 / 2 + qd * dt2 * dt2 / 8;
+  t->p[1][0] = t->p[0][1];
+  t->p[0][2] += qd * dt3 / 6;
+  t->p[2][0] = t->p[0][2];
+  t->p[1][1] += qo * adt + qd * dt3 / 3;
+  t->p[1][2] += qd * dt2 / 2;
+  t->p[2][1] = t->p[1][2];
+  t->p[2][2] += qd * adt;
+}
+
+// Kalman update with state element k measured as x[k] + innovation y;
+// false if the measurement is too far off to believe
+static bool update(Track* t, int k, double y, double noise) {
+  double const s = t->p[k][k] + noise * noise;
+  if (y * y > gate_sigmas * gate_sigmas * s) return false;
+
+  double gain[3];
+  for (int i = 0; i < 3; ++i) gain[i] = t->p[i][k] / s;
+  for (int i = 0; i < 3; ++i) t->x[i] += gain[i] * y;
+  double const pk[3] = {t->p[k][0], t->p[k][1], t->p[k][2]};
+  for (int i = 0; i < 3; ++i) {
+    for (int j = 0; j < 3; ++j) t->p[i][j] -= gain[i] * pk[j];
+  }
+  t->x[0] = wrap_phase(t->x[0]);
+  return true;
+}
+
+static void observe(
+    uint16_t peer, uint64_t t40, int k, double value, double noise) {
+  Track* t = find(peer);
+  if (!t) t = start(peer, t40);
+  predict(t, t40);
+
+  // A first pair sets the phase outright
+  if (k == 0 && !t->has_phase) {
+    t->x[0] = value;
+    t->p[0][0] = noise * noise;
+    t->p[0][1] = t->p[1][0] = t->p[0][2] = t->p[2][0] = 0;
+    t->has_phase = true;
+    ++t->observations;
+    return;
+  }
+
+  double const y = k == 0 ? wrap_phase(value - t->x[0]) : value - t->x[k];
+  if (update(t, k, y, noise)) {
+    t->rejected_in_row = 0;
+    ++t->observations;
+    return;
+  }
+
+  ++t->rejected;
+  if (++t->rejected_in_row < dw3k_drift_max_rejected) return;
+  uint32_t const rejected = t->rejected;
+  t = start(peer, t40);
+  t->rejected = rejected;
+  observe(peer, t40, k, value, noise);
+}
+
+void dw3k_drift_observe_offset(uint16_t peer, uint64_t t40, float offset) {
+  observe(peer, t40, 1, offset, dw3k_drift_offset_noise);
+}
+
+void dw3k_drift_observe_pair(uint16_t peer, uint64_t t40, uint64_t peer_t40) {
+  double const phase = wrap_phase(span_s(peer_t40, t40));
+  observe(peer, t40, 0, phase, dw3k_drift_phase_noise_s);
+}
+
+void dw3k_drift_forget(uint16_t peer) {
+  Track* t = find(peer);
+  if (t) t->used = false;
+}
+
+bool dw3k_drift_peer(uint16_t peer, DW3KDriftPeer* out) {
+  Track const* t = find(peer);
+  if (!t) return false;
+  out->peer = peer;
+  out->offset = t->x[1];
+  out->offset_sigma = sqrt(t->p[1][1]);
+  out->drift = t->x[2];
+  out->has_phase = t->has_phase;
+  out->observations = t->observations;
+  out->rejected = t->rejected;
+  return true;
+}
+
+bool dw3k_drift_remote_t40(uint16_t peer, uint64_t t40, uint64_t* peer_t40) {
+  Track const* t = find(peer);
+  if (!t || !t->has_phase) return false;
+  double const dt = span_s(t->t40, t40);
+  double const phase = t->x[0] + t->x[1] * dt + t->x[2] * dt * dt / 2;
+  int64_t const phase_t40 = llround(phase * dw3k_time40_hz);
+  *peer_t40 = (dw3k_t40(t40) - phase_t40).ticks;
+  return true;
+}
+
+double dw3k_drift_local_span(uint16_t peer, double peer_span) {
+  Track const* t = find(peer);
+  return t ? peer_span * (1 + t->x[1]) : peer_span;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdint.h>
+
+// Tracks each peer's clock against ours from what reception gives for free,
+// so remote intervals and timestamps can be converted without extra frames.
+//
+// Per peer, a Kalman filter follows the phase (our time minus theirs), the
+// rate offset (as dw3k_rx_clock_offset(), ours minus theirs) and its drift
+// (offset change per second, e.g. as crystals warm up). It takes two kinds
+// of observation, each at one of our timestamps:
+//
+//   dw3k_drift_observe_offset()  carrier integrator offset of a frame
+//   dw3k_drift_observe_pair()    a moment in both clocks, e.g. a frame's RX
+//                                time and its TX time (from the payload)
+//                                less the time of flight, or the midpoints
+//                                of a two-way exchange
+//
+// Offsets alone give the rate; pairs also give the phase, needed by
+// dw3k_drift_remote_t40(). Observations far outside the estimate are
+// dropped, and a few in a row (the peer restarted?) start the peer over.
+//
+// The table holds dw3k_drift_max_peers peers, dropping the one heard from
+// least recently for a new one.
+
+struct DW3KDriftPeer {
+  uint16_t peer;
+  float offset;        // Ours minus theirs, as dw3k_rx_clock_offset()
+  float offset_sigma;  // Standard deviation of the estimate
+  float drift;         // Offset change per second
+  bool has_phase;      // Pairs seen, so dw3k_drift_remote_t40() works
+  uint32_t observations;
+  uint32_t rejected;   // Dropped as too far off
+};
+
+static constexpr int dw3k_drift_max_peers = 16;
+static constexpr double dw3k_drift_offset_noise = 0.1e-6;  // Per observation
+static constexpr double dw3k_drift_phase_noise_s = 0.2e-9;  // Per pair
+static constexpr double dw3k_drift_offset_walk = 1e-9;  // Per sqrt(s)
+static constexpr double dw3k_drift_drift_walk = 1e-10;  // Per s, per sqrt(s)
+static constexpr int dw3k_drift_max_rejected = 3;  // In a row, then restart
+
+void dw3k_drift_observe_offset(uint16_t peer, uint64_t t40, float offset);
+void dw3k_drift_observe_pair(uint16_t peer, uint64_t t40, uint64_t peer_t40);
+void dw3k_drift_forget(uint16_t peer);
+
+bool dw3k_drift_peer(uint16_t peer, DW3KDriftPeer* out);  // False if unknown
+
+// The peer's clock at our t40 (which should be recent), for a peer with
+// has_phase; false otherwise
+bool dw3k_drift_remote_t40(uint16_t peer, uint64_t t40, uint64_t* peer_t40);
+
+// A span of the peer's clock in ours (unchanged for an unknown peer)
+double dw3k_drift_local_span(uint16_t peer, double peer_span);
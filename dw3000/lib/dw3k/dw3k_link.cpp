@@ -0,0 +1,384 @@
+#include "dw3k_link.h"
+
+#include <Arduino.h>
+#include <string.h>
+
+#include "dw3k.h"
+#include "dw3k_time.h"
+
+// Starts every frame; data frames continue with the fragment's bytes
+struct LinkHeader {
+  uint8_t type;       // 'D' (data) or 'A' (ACK)
+  uint8_t flags;      // Data: ack_request
+  uint16_t message;   // Sender's message number
+  uint16_t fragment;  // Data: this fragment; ACK: first missing fragment
+  uint16_t count;     // Fragments in the message
+  uint32_t size;      // Message bytes
+  uint32_t bits;      // ACK: fragments held, bit i is "fragment" + i
+};
+
+static constexpr uint8_t ack_request = 0x1;
+
+enum class Step { Idle, SendData, ListenAck, Listen, SendAck };
+
+static DW3KLinkStatus status = DW3KLinkStatus::Idle;
+static Step step = Step::Idle;
+static char const* error_text = "[No error logged]";
+static DW3KLinkStats stats = {};
+static unsigned long start_micros;
+
+// The message, split into "count" fragments of "fragment_size" bytes
+// (the last may be short)
+static uint8_t const* tx_data = nullptr;
+static uint8_t* rx_data = nullptr;
+static uint32_t rx_capacity = 0;
+static bool have_message = false;  // Receiver has seen the first frame
+static uint16_t message = 0;
+static uint32_t size;
+static uint16_t count;
+static uint32_t fragment_size;
+
+// Window state: "base" is the first fragment not known delivered, and bit i
+// of each mask is about fragment base + i
+static uint16_t base;
+static uint32_t have_bits;  // Delivered (sender) or received (receiver)
+static uint32_t sent_bits;  // Sent at least once (sender)
+
+// Sender burst state
+static int burst_left;
+static int scan;  // Window index to look for the next fragment from
+static bool in_flight_asks_ack;
+static unsigned long ack_deadline_millis;
+static uint32_t burst_start_t32;  // Not before, so the receiver listens again
+static int timeouts_in_a_row;
+
+// Receiver: final ACK of the last message completed, sent again when its
+// sender asks (it missed the ACK) after dw3k_link_receive() re-armed us
+static LinkHeader previous_ack = {};
+static bool resend_previous_ack = false;
+static uint64_t ack_request_t40;  // When the latest ACK request arrived
+
+// Receiver RX ring (the chip's two RX buffers add two more frames)
+static uint8_t ring_data[2][dw3k_packet_size];
+static DW3KRxFrame ring[2];
+
+static void fail(char const* text) {
+  status = DW3KLinkStatus::Failed;
+  error_text = text;
+  if (step != Step::Idle) dw3k_end_txrx();
+  step = Step::Idle;
+}
+
+static void finish() {
+  if (rx_data) previous_ack = {'A', 0, message, count, count, size, 0};
+  status = DW3KLinkStatus::Done;
+  stats.bytes = size;
+  stats.micros = micros() - start_micros;
+}
+
+static void transmit(
+    LinkHeader const& header, void const* data, int n, uint32_t sched_t32) {
+  dw3k_buffer_tx(&header, sizeof(header));
+  if (n > 0) dw3k_buffer_tx(data, n);
+  dw3k_schedule_tx(sched_t32);
+}
+
+// True once the frame in flight is out; a late one is rescheduled
+static bool transmit_done(DW3KStatus radio) {
+  if (radio == DW3KStatus::TransmitTooLate) {
+    dw3k_end_txrx();  // Keeps the buffered frame
+    dw3k_schedule_tx(dw3k_clock_t32() + 2 * dw3k_tx_leadtime_t32());
+    return false;
+  }
+  if (radio != DW3KStatus::TransmitDone) return false;
+  dw3k_end_txrx();
+  return true;
+}
+
+//
+// Sender
+//
+
+// Window index of the next fragment not yet delivered, or -1
+static int next_unsent(int from) {
+  int const left = count - base;
+  int const limit = left < dw3k_link_window ? left : dw3k_link_window;
+  for (int i = from; i < limit; ++i) {
+    if (!((have_bits >> i) & 1)) return i;
+  }
+  return -1;
+}
+
+static void send_next() {
+  int const i = next_unsent(scan);
+  uint16_t const fragment = base + i;
+  uint32_t const offset = fragment * fragment_size;
+  uint32_t const left = size - offset;
+  uint32_t const n = left < fragment_size ? left : fragment_size;
+  --burst_left;
+  scan = i + 1;
+  in_flight_asks_ack = burst_left == 0 || next_unsent(scan) < 0;
+
+  LinkHeader const header = {
+      'D', in_flight_asks_ack ? ack_request : uint8_t(0), message, fragment,
+      count, size, 0};
+  if ((sent_bits >> i) & 1) ++stats.retransmits;
+  sent_bits |= 1u << i;
+  ++stats.frames;
+  auto sched_t32 = dw3k_clock_t32() + dw3k_tx_leadtime_t32();
+  if (int32_t(burst_start_t32 - sched_t32) > 0) sched_t32 = burst_start_t32;
+  transmit(header, tx_data + offset, n, sched_t32);
+  step = Step::SendData;
+}
+
+// Fragment "base" is never delivered, so there is always one to send
+static void start_burst(int frames) {
+  burst_left = frames;
+  scan = 0;
+  send_next();
+}
+
+static void apply_ack(LinkHeader const& ack) {
+  ++stats.acks;
+  timeouts_in_a_row = 0;
+  if (ack.fragment >= base) {  // The receiver's base never moves back
+    int const shift = ack.fragment - base;
+    sent_bits = shift < 32 ? sent_bits >> shift : 0;
+    base = ack.fragment;
+    have_bits = ack.bits;
+    uint32_t const bytes = base * fragment_size;
+    stats.bytes = bytes < size ? bytes : size;
+  }
+  if (base >= count) return finish();
+  start_burst(dw3k_link_burst);
+}
+
+static void poll_send_data(DW3KStatus radio) {
+  if (!transmit_done(radio)) return;
+  if (!in_flight_asks_ack) return send_next();
+  dw3k_start_rx();
+  ack_deadline_millis = millis() + dw3k_link_ack_timeout_millis;
+  step = Step::ListenAck;
+}
+
+static void poll_listen_ack(DW3KStatus radio) {
+  if (radio == DW3KStatus::ReceiveDone) {
+    LinkHeader ack = {};
+    bool const sized = dw3k_rx_size() == sizeof(ack);
+    if (sized) dw3k_retrieve_rx(0, sizeof(ack), &ack);
+    uint32_t const ack_t32 = dw3k_rx_timestamp_t40() >> 8;
+    dw3k_end_txrx();
+    if (sized && ack.type == 'A' && ack.message == message &&
+        ack.count == count && ack.size == size) {
+      burst_start_t32 = ack_t32 + dw3k_micros_t32(dw3k_link_turnaround_micros);
+      step = Step::Idle;
+      return apply_ack(ack);
+    }
+    dw3k_start_rx();  // Not for us, keep listening
+    return;
+  }
+
+  if (long(millis() - ack_deadline_millis) < 0) return;
+  dw3k_end_txrx();
+  ++stats.timeouts;
+  if (++timeouts_in_a_row >= dw3k_link_max_timeouts) {
+    step = Step::Idle;
+    return fail("Link: No ACK from receiver");
+  }
+  start_burst(1);  // Probe: resend one fragment to get an ACK
+}
+
+void dw3k_link_send(void const* data, uint32_t data_size) {
+  dw3k_link_abort();
+  stats = {};
+  start_micros = micros();
+  status = DW3KLinkStatus::Sending;
+
+  uint32_t const payload = dw3k_max_packet_size() - sizeof(LinkHeader);
+  uint32_t const fragments = (data_size + payload - 1) / payload;
+  if (fragments > 0xFFFF) return fail("Link: Message too big to send");
+
+  tx_data = static_cast<uint8_t const*>(data);
+  rx_data = nullptr;
+  size = data_size;
+  count = fragments ? fragments : 1;
+  fragment_size = (size + count - 1) / count;
+  // Start from a random-ish number so that a receiver doesn't take our first
+  // message for one it already has from before we restarted
+  message = message ? message + 1 : uint16_t(micros() | 1);
+  base = 0;
+  have_bits = sent_bits = 0;
+  timeouts_in_a_row = 0;
+  burst_start_t32 = dw3k_clock_t32();
+  start_burst(dw3k_link_burst);
+}
+
+//
+// Receiver
+//
+
+static void start_listen() {
+  for (int i = 0; i < 2; ++i) {
+    ring[i] = {ring_data[i], int(sizeof(ring_data[i])), 0, 0, 0.0f};
+  }
+  dw3k_start_rx_continuous(ring, 2);
+  step = Step::Listen;
+}
+
+// Stores a data frame; returns whether it asked for an ACK
+static bool accept(DW3KRxFrame const& frame) {
+  LinkHeader header;
+  if (frame.size < int(sizeof(header))) return false;
+  memcpy(&header, frame.data, sizeof(header));
+  if (header.type != 'D' || header.count == 0) return false;
+
+  bool const wants_ack = header.flags & ack_request;
+  if (wants_ack) ack_request_t40 = frame.rx_t40;
+  bool const old = previous_ack.type &&
+      header.message == previous_ack.message &&
+      header.size == previous_ack.size;
+  if (old && (!have_message || header.message != message)) {
+    resend_previous_ack |= wants_ack;
+    return false;
+  }
+
+  if (!have_message) {
+    if (header.size > rx_capacity) {
+      fail("Link: Message too big for buffer");
+      return false;
+    }
+    have_message = true;
+    message = header.message;
+    size = header.size;
+    count = header.count;
+    fragment_size = (size + count - 1) / count;
+    start_micros = micros();
+  }
+
+  if (header.message != message || header.count != count ||
+      header.size != size || header.fragment >= count)
+    return false;
+
+  int const i = header.fragment - base;
+  if (i >= dw3k_link_window) return wants_ack;
+  if (i < 0 || ((have_bits >> i) & 1)) {
+    ++stats.retransmits;
+    return wants_ack;
+  }
+
+  uint32_t const offset = header.fragment * fragment_size;
+  uint32_t const left = size - offset;
+  uint32_t const n = left < fragment_size ? left : fragment_size;
+  if (frame.size != int(sizeof(header) + n)) return false;
+  memcpy(rx_data + offset, frame.data + sizeof(header), n);
+  ++stats.frames;
+
+  have_bits |= 1u << i;
+  while (have_bits & 1) {
+    have_bits >>= 1;
+    ++base;
+  }
+  uint32_t const bytes = base * fragment_size;
+  stats.bytes = bytes < size ? bytes : size;
+  return wants_ack;  // Done once the ACK saying so is out
+}
+
+static void poll_listen() {
+  bool ack_wanted = false;
+  while (auto const* frame = dw3k_rx_frame()) {
+    ack_wanted |= accept(*frame);
+    dw3k_release_rx_frame();
+    if (status == DW3KLinkStatus::Failed) return;
+  }
+  if (!ack_wanted && !resend_previous_ack) return;
+
+  dw3k_end_txrx();
+  LinkHeader const ack = ack_wanted ?
+      LinkHeader{'A', 0, message, base, count, size, have_bits} : previous_ack;
+  resend_previous_ack = false;
+  ++stats.acks;
+
+  // Reply a fixed time after the request, by which the sender listens
+  uint32_t const delay_t32 = dw3k_micros_t32(dw3k_link_ack_delay_micros);
+  transmit(ack, nullptr, 0, uint32_t(ack_request_t40 >> 8) + delay_t32);
+  step = Step::SendAck;
+}
+
+void dw3k_link_receive(void* buffer, uint32_t capacity) {
+  dw3k_link_abort();
+  stats = {};
+  status = DW3KLinkStatus::Receiving;
+  tx_data = nullptr;
+  rx_data = static_cast<uint8_t*>(buffer);
+  rx_capacity = capacity;
+  have_message = false;
+  resend_previous_ack = false;
+  base = 0;
+  have_bits = 0;
+  start_listen();
+}
+
+//
+// Common
+//
+
+DW3KLinkStatus dw3k_link_poll() {
+  if (step == Step::Idle) return status;
+
+  auto const radio = dw3k_poll();
+  if (radio == DW3KStatus::ChipError || radio == DW3KStatus::CodeBug) {
+    step = Step::Idle;  // Nothing more to say to the chip
+    fail(dw3k_status_text());
+    return status;
+  }
+
+  switch (step) {
+    case Step::SendData: poll_send_data(radio); break;
+    case Step::ListenAck: poll_listen_ack(radio); break;
+    case Step::Listen: poll_listen(); break;
+    case Step::SendAck:
+      if (!transmit_done(radio)) break;
+      start_listen();
+      // A caller re-arming at Done would cancel an ACK still scheduled
+      if (have_message && base == count &&
+          status == DW3KLinkStatus::Receiving)
+        finish();
+      break;
+    case Step::Idle: break;
+  }
+
+  bool const running = status == DW3KLinkStatus::Sending ||
+      (status == DW3KLinkStatus::Receiving && have_message);
+  if (running) stats.micros = micros() - start_micros;
+  return status;
+}
+
+void dw3k_link_abort() {
+  if (step != Step::Idle) dw3k_end_txrx();
+  step = Step::Idle;
+  if (status == DW3KLinkStatus::Sending || status == DW3KLinkStatus::Receiving)
+    status = DW3KLinkStatus::Idle;
+}
+
+uint32_t dw3k_link_received_size() {
+  return (status == DW3KLinkStatus::Done && rx_data) ? size : 0;
+}
+
+DW3KLinkStats dw3k_link_stats() {
+  auto s = stats;
+  s.goodput = s.micros ? s.bytes * 1e6f / s.micros : 0.0f;
+  return s;
+}
+
+char const* dw3k_link_status_text() {
+  switch (status) {
+#define S(s) case DW3KLinkStatus::s: return #s;
+    S(Idle);
+    S(Sending);
+    S(Receiving);
+    S(Done);
+#undef S
+    case DW3KLinkStatus::Failed: return error_text;
+  }
+  return "[BAD STATUS]";
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdint.h>
+
+// Reliable bulk transfer of one message at a time between two nodes, on top
+// of dw3k_buffer_tx() and continuous RX (dw3k_start_rx_continuous()).
+//
+// The sender splits the message into equal fragments (one per frame) and
+// sends them in bursts without waiting, up to dw3k_link_window fragments
+// past the oldest one not yet delivered. The last frame of each burst asks
+// for an ACK, which carries the receiver's first missing fragment plus a
+// bitmap of the fragments it holds after that, so only the gaps get resent.
+// If no ACK comes, the sender probes with a single frame asking for one.
+//
+// Both ends are driven by dw3k_link_poll() (which calls dw3k_poll()) and own
+// the radio until Done, Failed or dw3k_link_abort(). The receiver is Done
+// once the ACK for the whole message is out, and then keeps answering ACK
+// requests (in case that ACK was lost) until the next dw3k_link_receive()
+// or dw3k_link_abort().
+
+enum class DW3KLinkStatus { Idle, Sending, Receiving, Done, Failed };
+
+struct DW3KLinkStats {
+  uint32_t bytes;        // Message bytes delivered so far
+  uint32_t frames;       // Data frames sent or accepted
+  uint32_t retransmits;  // Data frames sent again (or received twice)
+  uint32_t acks;         // ACK frames sent or accepted
+  uint32_t timeouts;     // Bursts answered by no ACK
+  uint32_t micros;       // From start (sender) or first frame (receiver)
+  float goodput;         // Delivered bytes per second
+};
+
+static constexpr int dw3k_link_window = 32;  // Fragments; bits in an ACK
+static constexpr int dw3k_link_burst = 8;    // Frames per ACK request
+static constexpr int dw3k_link_ack_delay_micros = 1000;  // After request
+static constexpr int dw3k_link_turnaround_micros = 1000;  // ACK to next data
+static constexpr int dw3k_link_ack_timeout_millis = 20;
+static constexpr int dw3k_link_max_timeouts = 50;  // In a row, then Failed
+
+void dw3k_link_send(void const* data, uint32_t size);
+void dw3k_link_receive(void* buffer, uint32_t capacity);
+DW3KLinkStatus dw3k_link_poll();
+void dw3k_link_abort();
+
+uint32_t dw3k_link_received_size();  // Once Done
+DW3KLinkStats dw3k_link_stats();
+char const* dw3k_link_status_text();
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "dw3k_time.h"
+
+// PHY profiles: channel, preamble, PAC, SFD and data rate, with every
+// register value and timing constant they imply worked out at compile time
+// (DW3000 User Manual 8.2 and deca_driver's dwt_configure()). Both ends of
+// a link must use the same channel, preamble code and SFD. The receiver
+// follows the sender's data rate by itself, but its PAC and SFD timeout
+// come from its own profile: a PAC too long misses shorter preambles, and
+// the SFD timeout gives up on longer ones (dw3k_phy_listen_profile()).
+//
+// dw3k_set_phy() before dw3k_reset() picks what the chip starts with; once
+// Ready it rewrites only the registers that differ (a handful of SPI
+// writes, no recalibration), e.g. to hop between a short fast preamble for
+// ranging and a long one for range. Changing channel needs a reset (the
+// PLL relocks and RX recalibrates).
+
+struct DW3KPhyProfile {
+  char const* name;
+  uint8_t channel;            // 5 or 9
+  uint16_t preamble_symbols;  // 32 to 4096
+  uint8_t pac_symbols;        // Preamble acquisition chunk, 4 to 32
+  uint8_t preamble_code;      // 9-12 for 64MHz PRF, 1-8 for 16MHz
+  uint8_t sfd_type;           // CHAN_CTRL SFD_TYPE; 2 is 16 symbols, else 8
+  bool fast;                  // 6.8Mbps data (else 850kbps); PHR is 850kbps
+
+  // Derived timing
+  uint32_t symbol_ps;   // Preamble symbol
+  uint32_t header_ns;   // Preamble, SFD and PHR (until the payload)
+  uint32_t leadtime_t32;  // dw3k_tx_leadtime_t32()
+  int8_t sensitivity_dbm;  // Roughly the weakest first path received well
+
+  // Register values (TX_FCTRL without TXFLEN)
+  uint16_t otp_cfg;  // Kicks OTP loads, with the channel's DGC table
+  uint16_t pll_cfg;
+  uint16_t chan_ctrl;
+  uint16_t tx_fctrl;
+  uint16_t dtune0;
+  uint16_t rx_sfd_toc;
+  uint32_t dtune3;
+  uint32_t rf_tx_ctrl2;
+};
+
+// TX_FCTRL TXPSR for a preamble length (0 if none)
+constexpr uint16_t dw3k_phy_txpsr(int symbols) {
+  switch (symbols) {
+    case 32: return 0x4;
+    case 64: return 0x1;
+    case 128: return 0x5;
+    case 256: return 0x9;
+    case 512: return 0xD;
+    case 1024: return 0x2;
+    case 1536: return 0x6;
+    case 2048: return 0xA;
+    case 4096: return 0x3;
+  }
+  return 0;
+}
+
+constexpr DW3KPhyProfile dw3k_phy_profile(
+    char const* name, int channel, int preamble_symbols, int preamble_code,
+    bool fast, int sfd_type = 3) {
+  int const pac = preamble_symbols <= 32 ? 4 :
+      preamble_symbols <= 128 ? 8 : preamble_symbols <= 512 ? 16 : 32;
+  int const sfd_symbols = sfd_type == 2 ? 16 : 8;
+  int64_t const symbol_ps = preamble_code <= 8 ? 993590 : 1017630;
+  int64_t const sync_ps = (preamble_symbols + sfd_symbols) * symbol_ps;
+  int64_t const phr_ps = 21 * 1176471;  // 21 bits at 850kbps
+
+  DW3KPhyProfile p = {};
+  p.name = name;
+  p.channel = channel;
+  p.preamble_symbols = preamble_symbols;
+  p.pac_symbols = pac;
+  p.preamble_code = preamble_code;
+  p.sfd_type = sfd_type;
+  p.fast = fast;
+  p.symbol_ps = symbol_ps;
+  p.header_ns = (sync_ps + phr_ps) / 1000;
+  p.leadtime_t32 = dw3k_time_scale(sync_ps + 20000000, 156, 625000) + 1;
+
+  // ~-92dBm for 64 symbols at 6.8Mbps; 850kbps gains ~6dB, and each
+  // doubling of the preamble ~3dB (more to accumulate)
+  p.sensitivity_dbm = fast ? -92 : -98;
+  for (int s = 64; s < preamble_symbols; s *= 2) p.sensitivity_dbm -= 3;
+  for (int s = 64; s > preamble_symbols; s /= 2) p.sensitivity_dbm += 3;
+
+  bool const ch9 = channel == 9;
+  p.otp_cfg = ch9 ? 0x35C0 : 0x15C0;  // OPS, BIAS, LDO, DGC (DGC_SEL ch9)
+  p.pll_cfg = ch9 ? 0x0F3C : 0x1F3C;
+  p.chan_ctrl = (ch9 ? 0x1 : 0x0) | sfd_type << 1 | preamble_code << 3 |
+      preamble_code << 8;
+  p.tx_fctrl = (fast ? 0x400 : 0) | 0x800 |  // TXBR, TR (ranging)
+      dw3k_phy_txpsr(preamble_symbols) << 12;
+  p.dtune0 = 0x100C | (pac == 4 ? 3 : pac == 8 ? 0 : pac == 16 ? 1 : 2);
+  p.rx_sfd_toc = preamble_symbols + 1 + sfd_symbols - pac;
+  p.dtune3 = pac == 4 ? 0xAF5F35CC : 0xAF5F584C;  // deca_driver (data on)
+  p.rf_tx_ctrl2 = ch9 ? 0x1C010034 : 0x1C071134;
+  return p;
+}
+
+// The payload's airtime (roughly, with Reed-Solomon parity) for "size"
+// bytes of data (plus CRC), and the whole frame's
+constexpr uint32_t dw3k_phy_payload_ns(DW3KPhyProfile const& p, int size) {
+  uint64_t const bits = (size + 2) * 8;
+  uint64_t const bit_ps = p.fast ? 147059 : 1176471;
+  return (bits + bits * 48 / 330) * bit_ps / 1000;
+}
+
+constexpr uint32_t dw3k_phy_frame_ns(DW3KPhyProfile const& p, int size) {
+  return p.header_ns + dw3k_phy_payload_ns(p, size);
+}
+
+// For a receiver that must hear several profiles (on p's channel, preamble
+// code and SFD): p's PAC, so p should have the shortest preamble, with an
+// SFD timeout long enough for preambles up to longest_preamble symbols
+constexpr DW3KPhyProfile dw3k_phy_listen_profile(
+    DW3KPhyProfile const& p, int longest_preamble, char const* name) {
+  DW3KPhyProfile l = p;
+  l.name = name;
+  int const sfd_symbols = p.sfd_type == 2 ? 16 : 8;
+  if (longest_preamble > p.preamble_symbols)
+    l.rx_sfd_toc = longest_preamble + 1 + sfd_symbols - p.pac_symbols;
+  return l;
+}
+
+// The power-on setup: 64 symbols of code 9 (64MHz PRF) at 850kbps
+static constexpr DW3KPhyProfile dw3k_phy_ch5_default =
+    dw3k_phy_profile("ch5_default", 5, 64, 9, false);
+static constexpr DW3KPhyProfile dw3k_phy_ch9_default =
+    dw3k_phy_profile("ch9_default", 9, 64, 9, false);
+
+// Short range, least airtime: 64 symbols at 6.8Mbps
+static constexpr DW3KPhyProfile dw3k_phy_ch5_fast =
+    dw3k_phy_profile("ch5_fast", 5, 64, 9, true);
+static constexpr DW3KPhyProfile dw3k_phy_ch9_fast =
+    dw3k_phy_profile("ch9_fast", 9, 64, 9, true);
+
+// In between: 256 symbols at 850kbps
+static constexpr DW3KPhyProfile dw3k_phy_ch5_medium =
+    dw3k_phy_profile("ch5_medium", 5, 256, 9, false);
+static constexpr DW3KPhyProfile dw3k_phy_ch9_medium =
+    dw3k_phy_profile("ch9_medium", 9, 256, 9, false);
+
+// Long range: 1024 symbols at 850kbps
+static constexpr DW3KPhyProfile dw3k_phy_ch5_long_range =
+    dw3k_phy_profile("ch5_long_range", 5, 1024, 9, false);
+static constexpr DW3KPhyProfile dw3k_phy_ch9_long_range =
+    dw3k_phy_profile("ch9_long_range", 9, 1024, 9, false);
+
+static constexpr DW3KPhyProfile const* dw3k_phy_profiles[] = {
+    &dw3k_phy_ch5_default, &dw3k_phy_ch5_fast, &dw3k_phy_ch5_medium,
+    &dw3k_phy_ch5_long_range, &dw3k_phy_ch9_default, &dw3k_phy_ch9_fast,
+    &dw3k_phy_ch9_medium, &dw3k_phy_ch9_long_range,
+};
+
+// As the chip was set up before profiles
+static_assert(dw3k_phy_ch5_default.chan_ctrl == 0x094E);
+static_assert(dw3k_phy_ch5_default.tx_fctrl == 0x1800);
+static_assert(dw3k_phy_ch5_default.dtune0 == 0x100C);
+static_assert(dw3k_phy_ch9_default.chan_ctrl == 0x094F);
+
+void dw3k_set_phy(DW3KPhyProfile const&);
+DW3KPhyProfile const& dw3k_phy();  // The one in use (or for the next reset)
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <stdint.h>
+
 struct DW3KFastCommand { uint8_t bits; };
 
 struct DW3KRegisterAddress {
@@ -7,6 +9,49 @@ struct DW3KRegisterAddress {
   uint16_t offset;
 };
 
+// SPI transaction header, see DW3000 User Manual 2.3.1.2 "Transaction formats
+// of the SPI interface". Mode is 0 for plain access, 1-3 for 8/16/32-bit
+// masked writes.
+struct DW3KSpiHeader {
+  uint8_t len;
+  uint8_t bytes[2];
+};
+
+static constexpr DW3KSpiHeader dw3k_spi_header(
+    DW3KRegisterAddress addr, bool write, uint8_t mode) {
+  return (!mode && !addr.offset)
+      ? DW3KSpiHeader{1, {uint8_t((write ? 0x80 : 0) | addr.file << 1), 0}}
+      : DW3KSpiHeader{2, {
+            uint8_t((write ? 0xC0 : 0x40) | addr.file << 1 | addr.offset >> 6),
+            uint8_t((addr.offset << 2 | mode) & 0xFF)}};
+}
+
+// A register with its value type and width (bytes on the wire, which may be
+// less than the type, e.g. 40-bit timestamps in uint64_t). Everything about
+// the access is fixed at compile time; see the typed dw3k_read()/dw3k_write()
+// in dw3k_spi.h. Converts to a plain DW3KRegisterAddress for raw access.
+template <uint8_t File, uint16_t Offset, typename T, int Size = sizeof(T)>
+struct DW3KRegister {
+  static_assert(File < 0x20, "Bad register file");
+  static_assert(Offset < 0x80, "Registers must be directly addressable");
+  static_assert(Size > 0 && Size <= int(sizeof(T)), "Bad register width");
+
+  using Value = T;
+  static constexpr uint8_t file = File;
+  static constexpr uint16_t offset = Offset;
+  static constexpr int size = Size;
+  static constexpr DW3KRegisterAddress address = {File, Offset};
+  static constexpr DW3KSpiHeader read_header =
+      dw3k_spi_header(address, false, 0);
+  static constexpr DW3KSpiHeader write_header =
+      dw3k_spi_header(address, true, 0);
+  static constexpr DW3KSpiHeader maskset_header =
+      dw3k_spi_header(address, true, Size == 1 ? 1 : Size == 2 ? 2 : 3);
+
+  constexpr DW3KRegister() {}
+  constexpr operator DW3KRegisterAddress() const { return address; }
+};
+
 struct DW3KOTPAddress { uint16_t index; };
 
 // DW3000 User Manual 9. "Fast Commands"
@@ -33,204 +78,213 @@ static constexpr DW3KFastCommand
   DW3K_DB_TOGGLE   = {0x13};
 
 // DW3000 User Manual 8.1. "Register map overview"
+// Width is sizeof(value type) unless given.
+static constexpr DW3KRegister<0x00, 0x00, uint32_t> DW3K_DEV_ID;
+static constexpr DW3KRegister<0x00, 0x04, uint64_t> DW3K_EUI_64;
+static constexpr DW3KRegister<0x00, 0x0C, uint32_t> DW3K_PANADR;
+static constexpr DW3KRegister<0x00, 0x10, uint32_t> DW3K_SYS_CFG;
+static constexpr DW3KRegister<0x00, 0x14, uint16_t> DW3K_FF_CFG;
+static constexpr DW3KRegister<0x00, 0x18, uint8_t> DW3K_SPI_RD_CRC;
+static constexpr DW3KRegister<0x00, 0x1C, uint32_t> DW3K_SYS_TIME;
+static constexpr DW3KRegister<0x00, 0x24, uint32_t> DW3K_TX_FCTRL;
+static constexpr DW3KRegister<0x00, 0x24, uint64_t, 6> DW3K_TX_FCTRL_64;
+static constexpr DW3KRegister<0x00, 0x2C, uint32_t> DW3K_DX_TIME;
+static constexpr DW3KRegister<0x00, 0x30, uint32_t> DW3K_DREF_TIME;
+static constexpr DW3KRegister<0x00, 0x34, uint32_t, 3> DW3K_RX_FWTO;
+static constexpr DW3KRegister<0x00, 0x38, uint32_t> DW3K_SYS_CTRL;
+static constexpr DW3KRegister<0x00, 0x3C, uint64_t, 6> DW3K_SYS_ENABLE_64;
+static constexpr DW3KRegister<0x00, 0x44, uint32_t> DW3K_SYS_STATUS;
+static constexpr DW3KRegister<0x00, 0x44, uint64_t, 6> DW3K_SYS_STATUS_64;
+static constexpr DW3KRegister<0x00, 0x4C, uint32_t> DW3K_RX_FINFO;
+static constexpr DW3KRegister<0x00, 0x64, uint64_t, 5> DW3K_RX_STAMP_64;
+static constexpr DW3KRegister<0x00, 0x70, uint32_t> DW3K_RX_RAWST;
+static constexpr DW3KRegister<0x00, 0x74, uint64_t, 5> DW3K_TX_STAMP_64;
+static constexpr DW3KRegister<0x01, 0x00, uint32_t> DW3K_TX_RAWST;
+static constexpr DW3KRegister<0x01, 0x04, uint16_t> DW3K_TX_ANTD;
+static constexpr DW3KRegister<0x01, 0x08, uint32_t> DW3K_ACK_RESP_T;
+static constexpr DW3KRegister<0x01, 0x0C, uint32_t> DW3K_TX_POWER;
+static constexpr DW3KRegister<0x01, 0x14, uint16_t> DW3K_CHAN_CTRL;
+static constexpr DW3KRegister<0x01, 0x18, uint32_t> DW3K_LE_PEND01;
+static constexpr DW3KRegister<0x01, 0x1C, uint32_t> DW3K_LE_PEND23;
+static constexpr DW3KRegister<0x01, 0x20, uint8_t> DW3K_SPI_COLLISION;
+static constexpr DW3KRegister<0x01, 0x24, uint8_t> DW3K_RDB_STATUS;
+static constexpr DW3KRegister<0x01, 0x28, uint8_t> DW3K_RDB_DIAG;
+static constexpr DW3KRegister<0x01, 0x30, uint16_t> DW3K_AES_CFG;
+static constexpr DW3KRegister<0x01, 0x34, uint32_t> DW3K_AES_IV0;
+static constexpr DW3KRegister<0x01, 0x38, uint32_t> DW3K_AES_IV1;
+static constexpr DW3KRegister<0x01, 0x3C, uint32_t> DW3K_AES_IV2;
+static constexpr DW3KRegister<0x01, 0x40, uint32_t> DW3K_AES_IV3;
+static constexpr DW3KRegister<0x01, 0x44, uint64_t> DW3K_DMA_CFG_64;
+static constexpr DW3KRegister<0x01, 0x4C, uint8_t> DW3K_AES_START;
+static constexpr DW3KRegister<0x01, 0x50, uint8_t> DW3K_AES_STS;
+
+static constexpr DW3KRegister<0x02, 0x00, uint16_t> DW3K_STS_CFG;
+static constexpr DW3KRegister<0x02, 0x04, uint8_t> DW3K_STS_CTRL;
+static constexpr DW3KRegister<0x02, 0x08, uint16_t> DW3K_STS_STS;
+
+static constexpr DW3KRegister<0x03, 0x18, uint16_t> DW3K_DGC_CFG;
+static constexpr DW3KRegister<0x03, 0x1C, uint32_t> DW3K_DGC_CFG0;  // from deca_driver
+static constexpr DW3KRegister<0x03, 0x20, uint32_t> DW3K_DGC_CFG1;  // from deca_driver
+static constexpr DW3KRegister<0x03, 0x38, uint32_t> DW3K_DGC_LUT0;  // from deca_driver
+static constexpr DW3KRegister<0x03, 0x3C, uint32_t> DW3K_DGC_LUT1;  // from deca_driver
+static constexpr DW3KRegister<0x03, 0x40, uint32_t> DW3K_DGC_LUT2;  // from deca_driver
+static constexpr DW3KRegister<0x03, 0x44, uint32_t> DW3K_DGC_LUT3;  // from deca_driver
+static constexpr DW3KRegister<0x03, 0x48, uint32_t> DW3K_DGC_LUT4;  // from deca_driver
+static constexpr DW3KRegister<0x03, 0x4C, uint32_t> DW3K_DGC_LUT5;  // from deca_driver
+static constexpr DW3KRegister<0x03, 0x50, uint32_t> DW3K_DGC_LUT6;  // from deca_driver
+static constexpr DW3KRegister<0x03, 0x60, uint32_t> DW3K_DGC_DBG;
+
+static constexpr DW3KRegister<0x04, 0x00, uint32_t> DW3K_EC_CTRL;
+static constexpr DW3KRegister<0x04, 0x0C, uint32_t> DW3K_RX_CAL;
+static constexpr DW3KRegister<0x04, 0x14, uint32_t> DW3K_RX_CAL_RESI;
+static constexpr DW3KRegister<0x04, 0x1C, uint32_t> DW3K_RX_CAL_RESQ;
+static constexpr DW3KRegister<0x04, 0x20, uint8_t> DW3K_RX_CAL_STS;
+
+static constexpr DW3KRegister<0x05, 0x00, uint32_t> DW3K_GPIO_MODE;
+static constexpr DW3KRegister<0x05, 0x04, uint32_t> DW3K_GPIO_PULL_EN;
+static constexpr DW3KRegister<0x05, 0x08, uint32_t> DW3K_GPIO_DIR;
+static constexpr DW3KRegister<0x05, 0x0C, uint32_t> DW3K_GPIO_OUT;
+static constexpr DW3KRegister<0x05, 0x10, uint32_t> DW3K_GPIO_IRQE;
+static constexpr DW3KRegister<0x05, 0x14, uint32_t> DW3K_GPIO_ISTS;
+static constexpr DW3KRegister<0x05, 0x18, uint32_t> DW3K_GPIO_ISEN;
+static constexpr DW3KRegister<0x05, 0x1C, uint32_t> DW3K_GPIO_IMODE;
+static constexpr DW3KRegister<0x05, 0x20, uint32_t> DW3K_GPIO_IBES;
+static constexpr DW3KRegister<0x05, 0x24, uint32_t> DW3K_GPIO_ICLR;
+static constexpr DW3KRegister<0x05, 0x28, uint32_t> DW3K_GPIO_IDBE;
+static constexpr DW3KRegister<0x05, 0x2C, uint32_t> DW3K_GPIO_RAW;
+
+static constexpr DW3KRegister<0x06, 0x00, uint16_t> DW3K_DTUNE0;
+static constexpr DW3KRegister<0x06, 0x02, uint16_t> DW3K_RX_SFD_TOC;
+static constexpr DW3KRegister<0x06, 0x04, uint16_t> DW3K_PRE_TOC;
+static constexpr DW3KRegister<0x06, 0x0C, uint32_t> DW3K_DTUNE3;
+static constexpr DW3KRegister<0x06, 0x14, uint32_t> DW3K_DTUNE5;
+static constexpr DW3KRegister<0x06, 0x29, int32_t, 3> DW3K_DRX_CAR_INT;
+
+static constexpr DW3KRegister<0x07, 0x00, uint32_t> DW3K_RF_ENABLE;
+static constexpr DW3KRegister<0x07, 0x04, uint32_t> DW3K_RF_CTRL_MASK;
+static constexpr DW3KRegister<0x07, 0x10, uint32_t> DW3K_RF_RX_CTRL2;  // from deca_driver
+static constexpr DW3KRegister<0x07, 0x14, uint32_t> DW3K_RF_SWITCH;
+static constexpr DW3KRegister<0x07, 0x1A, uint8_t> DW3K_RF_TX_CTRL1;
+static constexpr DW3KRegister<0x07, 0x1C, uint32_t> DW3K_RF_TX_CTRL2;
+static constexpr DW3KRegister<0x07, 0x28, uint32_t> DW3K_TX_TEST;
+static constexpr DW3KRegister<0x07, 0x34, uint8_t> DW3K_SAR_TEST;
+static constexpr DW3KRegister<0x07, 0x40, uint64_t> DW3K_LDO_TUNE_64;
+static constexpr DW3KRegister<0x07, 0x48, uint32_t> DW3K_LDO_CTRL;
+static constexpr DW3KRegister<0x07, 0x51, uint8_t> DW3K_LDO_RLOAD;  // double check??
+
+static constexpr DW3KRegister<0x08, 0x00, uint8_t> DW3K_SAR_CTRL;
+static constexpr DW3KRegister<0x08, 0x04, uint8_t> DW3K_SAR_STATUS;
+static constexpr DW3KRegister<0x08, 0x08, uint32_t, 3> DW3K_SAR_READING;
+static constexpr DW3KRegister<0x08, 0x0C, uint16_t> DW3K_SAR_WAKE_RD;
+static constexpr DW3KRegister<0x08, 0x10, uint16_t> DW3K_PGC_CTRL;
+static constexpr DW3KRegister<0x08, 0x14, uint16_t> DW3K_PGC_STATUS;
+static constexpr DW3KRegister<0x08, 0x18, uint16_t> DW3K_PG_TEST;
+static constexpr DW3KRegister<0x08, 0x1C, uint16_t> DW3K_PG_CAL_TARGET;
+
+static constexpr DW3KRegister<0x09, 0x00, uint16_t> DW3K_PLL_CFG;
+static constexpr DW3KRegister<0x09, 0x04, uint32_t> DW3K_PLL_CC;
+static constexpr DW3KRegister<0x09, 0x08, uint16_t> DW3K_PLL_CAL;
+static constexpr DW3KRegister<0x09, 0x14, uint8_t> DW3K_XTAL;
+
+static constexpr DW3KRegister<0x0A, 0x00, uint32_t, 3> DW3K_AON_DIG_CFG;
+static constexpr DW3KRegister<0x0A, 0x04, uint8_t> DW3K_AON_CTRL;
+static constexpr DW3KRegister<0x0A, 0x08, uint8_t> DW3K_AON_RDATA;
+static constexpr DW3KRegister<0x0A, 0x0C, uint16_t> DW3K_AON_ADDR;
+static constexpr DW3KRegister<0x0A, 0x10, uint8_t> DW3K_AON_WDATA;
+static constexpr DW3KRegister<0x0A, 0x14, uint8_t> DW3K_AON_CFG;
+
+static constexpr DW3KRegister<0x0B, 0x00, uint32_t> DW3K_OTP_WDATA;
+static constexpr DW3KRegister<0x0B, 0x04, uint16_t> DW3K_OTP_ADDR;
+static constexpr DW3KRegister<0x0B, 0x08, uint16_t> DW3K_OTP_CFG;
+static constexpr DW3KRegister<0x0B, 0x0C, uint8_t> DW3K_OTP_STAT;
+static constexpr DW3KRegister<0x0B, 0x10, uint32_t> DW3K_OTP_RDATA;
+static constexpr DW3KRegister<0x0B, 0x14, uint32_t> DW3K_OTP_SRDATA;
+
+static constexpr DW3KRegister<0x0C, 0x00, uint64_t> DW3K_IP_TS_64;
+static constexpr DW3KRegister<0x0C, 0x08, uint64_t> DW3K_STS_TS_64;
+static constexpr DW3KRegister<0x0C, 0x10, uint64_t> DW3K_STS1_TS_64;
+static constexpr DW3KRegister<0x0C, 0x18, uint64_t, 6> DW3K_TDOA;
+static constexpr DW3KRegister<0x0C, 0x1E, uint16_t> DW3K_PDOA;  // double check?
+static constexpr DW3KRegister<0x0C, 0x20, uint32_t> DW3K_CIA_DIAG0;
+static constexpr DW3KRegister<0x0C, 0x24, uint32_t> DW3K_CIA_DIAG1;
+static constexpr DW3KRegister<0x0C, 0x28, uint32_t> DW3K_IP_DIAG0;
+static constexpr DW3KRegister<0x0C, 0x2C, uint32_t> DW3K_IP_DIAG1;
+static constexpr DW3KRegister<0x0C, 0x30, uint32_t> DW3K_IP_DIAG2;
+static constexpr DW3KRegister<0x0C, 0x34, uint32_t> DW3K_IP_DIAG3;
+static constexpr DW3KRegister<0x0C, 0x38, uint32_t> DW3K_IP_DIAG4;
+static constexpr DW3KRegister<0x0C, 0x48, uint32_t> DW3K_IP_DIAG8;
+static constexpr DW3KRegister<0x0C, 0x58, uint32_t> DW3K_IP_DIAG12;
+static constexpr DW3KRegister<0x0C, 0x5C, uint32_t> DW3K_STS_DIAG0;
+static constexpr DW3KRegister<0x0C, 0x60, uint32_t> DW3K_STS_DIAG1;
+static constexpr DW3KRegister<0x0C, 0x64, uint32_t> DW3K_STS_DIAG2;
+static constexpr DW3KRegister<0x0C, 0x68, uint32_t> DW3K_STS_DIAG3;
+static constexpr DW3KRegister<0x0D, 0x00, uint32_t> DW3K_STS_DIAG4;
+static constexpr DW3KRegister<0x0D, 0x10, uint32_t> DW3K_STS_DIAG8;
+static constexpr DW3KRegister<0x0D, 0x20, uint32_t> DW3K_STS_DIAG12;
+static constexpr DW3KRegister<0x0D, 0x38, uint32_t> DW3K_STS1_DIAG0;
+static constexpr DW3KRegister<0x0D, 0x3C, uint32_t> DW3K_STS1_DIAG1;
+static constexpr DW3KRegister<0x0D, 0x40, uint32_t> DW3K_STS1_DIAG2;
+static constexpr DW3KRegister<0x0D, 0x44, uint32_t> DW3K_STS1_DIAG3;
+static constexpr DW3KRegister<0x0D, 0x48, uint32_t> DW3K_STS1_DIAG4;
+static constexpr DW3KRegister<0x0D, 0x58, uint32_t> DW3K_STS1_DIAG8;
+static constexpr DW3KRegister<0x0D, 0x68, uint32_t> DW3K_STS1_DIAG12;
+static constexpr DW3KRegister<0x0E, 0x00, uint32_t> DW3K_CIA_CONF;
+static constexpr DW3KRegister<0x0E, 0x04, uint32_t> DW3K_FP_CONF;
+static constexpr DW3KRegister<0x0E, 0x0C, uint64_t, 6> DW3K_IP_CONF_64;
+static constexpr DW3KRegister<0x0E, 0x12, uint32_t> DW3K_STS_CONF0;
+static constexpr DW3KRegister<0x0E, 0x16, uint32_t> DW3K_STS_CONF1;
+static constexpr DW3KRegister<0x0E, 0x1A, uint16_t> DW3K_CIA_ADJUST;
+static constexpr DW3KRegister<0x0E, 0x1E, uint64_t> DW3K_PGF_DELAY_COMP_64;
+
+static constexpr DW3KRegister<0x0F, 0x00, uint32_t> DW3K_EVC_CTRL;
+static constexpr DW3KRegister<0x0F, 0x04, uint16_t> DW3K_EVC_PHE;
+static constexpr DW3KRegister<0x0F, 0x06, uint16_t> DW3K_EVC_RSE;
+static constexpr DW3KRegister<0x0F, 0x08, uint16_t> DW3K_EVC_FCG;
+static constexpr DW3KRegister<0x0F, 0x0A, uint16_t> DW3K_EVC_FCE;
+static constexpr DW3KRegister<0x0F, 0x0C, uint16_t> DW3K_EVC_FFR;
+static constexpr DW3KRegister<0x0F, 0x0E, uint16_t> DW3K_EVC_OVR;
+static constexpr DW3KRegister<0x0F, 0x10, uint16_t> DW3K_EVC_STO;
+static constexpr DW3KRegister<0x0F, 0x12, uint16_t> DW3K_EVC_PTO;
+static constexpr DW3KRegister<0x0F, 0x14, uint16_t> DW3K_EVC_FWTO;
+static constexpr DW3KRegister<0x0F, 0x16, uint16_t> DW3K_EVC_TXFS;
+static constexpr DW3KRegister<0x0F, 0x18, uint16_t> DW3K_EVC_HPW;
+static constexpr DW3KRegister<0x0F, 0x1A, uint16_t> DW3K_EVC_SWCE;
+static constexpr DW3KRegister<0x0F, 0x1C, uint16_t> DW3K_EVC_RES1;
+static constexpr DW3KRegister<0x0F, 0x24, uint32_t> DW3K_DIAG_TMC;
+static constexpr DW3KRegister<0x0F, 0x28, uint16_t> DW3K_EVC_CPQE;
+static constexpr DW3KRegister<0x0F, 0x2A, uint16_t> DW3K_EVC_VWARN;
+static constexpr DW3KRegister<0x0F, 0x2C, uint8_t> DW3K_SPI_MODE;
+static constexpr DW3KRegister<0x0F, 0x30, uint32_t> DW3K_SYS_STATE;
+static constexpr DW3KRegister<0x0F, 0x3C, uint8_t> DW3K_FCMD_STAT;
+static constexpr DW3KRegister<0x0F, 0x48, uint32_t> DW3K_CTR_DBG;
+static constexpr DW3KRegister<0x0F, 0x4C, uint8_t> DW3K_SPICRCINIT;
+
+static constexpr DW3KRegister<0x11, 0x00, uint8_t> DW3K_SOFT_RST;
+static constexpr DW3KRegister<0x11, 0x04, uint32_t> DW3K_CLK_CTRL;
+static constexpr DW3KRegister<0x11, 0x08, uint32_t> DW3K_SEQ_CTRL;
+static constexpr DW3KRegister<0x11, 0x12, uint16_t> DW3K_TXFSEQ;  // double check??
+static constexpr DW3KRegister<0x11, 0x16, uint32_t> DW3K_LED_CTRL;
+static constexpr DW3KRegister<0x11, 0x1A, uint32_t> DW3K_RX_SNIFF;
+static constexpr DW3KRegister<0x11, 0x1F, uint16_t> DW3K_BIAS_CTRL;  // From deca_driver
+
+static constexpr DW3KRegister<0x1F, 0x00, uint8_t> DW3K_FINT_STAT;
+static constexpr DW3KRegister<0x1F, 0x04, uint8_t> DW3K_PTR_ADDR_A;
+static constexpr DW3KRegister<0x1F, 0x08, uint16_t> DW3K_PTR_OFFSET_A;
+static constexpr DW3KRegister<0x1F, 0x0C, uint8_t> DW3K_PTR_ADDR_B;
+static constexpr DW3KRegister<0x1F, 0x10, uint16_t> DW3K_PTR_OFFSET_B;
+
+
+// Buffers, indirect pointer windows and registers too wide for one value,
+// accessed with dw3k_read()/dw3k_write() at an explicit length.
 static constexpr DW3KRegisterAddress
-  DW3K_DEV_ID        = {0x00, 0x00},
-  DW3K_EUI_64        = {0x00, 0x04},
-  DW3K_PANADR        = {0x00, 0x0C},
-  DW3K_SYS_CFG       = {0x00, 0x10},
-  DW3K_FF_CFG        = {0x00, 0x14},
-  DW3K_SPI_RD_CRC    = {0x00, 0x18},
-  DW3K_SYS_TIME      = {0x00, 0x1C},
-  DW3K_TX_FCTRL_64   = {0x00, 0x24},
-  DW3K_DX_TIME       = {0x00, 0x2C},
-  DW3K_DREF_TIME     = {0x00, 0x30},
-  DW3K_RX_FWTO       = {0x00, 0x34},
-  DW3K_SYS_CTRL      = {0x00, 0x38},
-  DW3K_SYS_ENABLE_64 = {0x00, 0x3C},
-  DW3K_SYS_STATUS_64 = {0x00, 0x44},
-  DW3K_RX_FINFO      = {0x00, 0x4C},
-  DW3K_RX_STAMP_64   = {0x00, 0x64},
-  DW3K_RX_RAWST      = {0x00, 0x70},
-  DW3K_TX_STAMP_64   = {0x00, 0x74},
-  DW3K_TX_RAWST      = {0x01, 0x00},
-  DW3K_TX_ANTD       = {0x01, 0x04},
-  DW3K_ACK_RESP_T    = {0x01, 0x08},
-  DW3K_TX_POWER      = {0x01, 0x0C},
-  DW3K_CHAN_CTRL     = {0x01, 0x14},
-  DW3K_LE_PEND01     = {0x01, 0x18},
-  DW3K_LE_PEND23     = {0x01, 0x1C},
-  DW3K_SPI_COLLISION = {0x01, 0x20},
-  DW3K_RDB_STATUS    = {0x01, 0x24},
-  DW3K_RDB_DIAG      = {0x01, 0x28},
-  DW3K_AES_CFG       = {0x01, 0x30},
-  DW3K_AES_IV0       = {0x01, 0x34},
-  DW3K_AES_IV1       = {0x01, 0x38},
-  DW3K_AES_IV2       = {0x01, 0x3C},
-  DW3K_AES_IV3       = {0x01, 0x40},
-  DW3K_DMA_CFG_64    = {0x01, 0x44},
-  DW3K_AES_START     = {0x01, 0x4C},
-  DW3K_AES_STS       = {0x01, 0x50},
   DW3K_AES_KEY_128   = {0x01, 0x54},
-
-  DW3K_STS_CFG       = {0x02, 0x00},
-  DW3K_STS_CTRL      = {0x02, 0x04},
-  DW3K_STS_STS       = {0x02, 0x08},
   DW3K_STS_KEY_128   = {0x02, 0x0C},
   DW3K_STS_IV_128    = {0x02, 0x1C},
 
-  DW3K_DGC_CFG       = {0x03, 0x18},
-  DW3K_DGC_CFG0      = {0x03, 0x1C},  // from deca_driver
-  DW3K_DGC_CFG1      = {0x03, 0x20},  // from deca_driver
-  DW3K_DGC_LUT0      = {0x03, 0x38},  // from deca_driver
-  DW3K_DGC_LUT1      = {0x03, 0x3C},  // from deca_driver
-  DW3K_DGC_LUT2      = {0x03, 0x40},  // from deca_driver
-  DW3K_DGC_LUT3      = {0x03, 0x44},  // from deca_driver
-  DW3K_DGC_LUT4      = {0x03, 0x48},  // from deca_driver
-  DW3K_DGC_LUT5      = {0x03, 0x4C},  // from deca_driver
-  DW3K_DGC_LUT6      = {0x03, 0x50},  // from deca_driver
-  DW3K_DGC_DBG       = {0x03, 0x60},
-
-  DW3K_EC_CTRL       = {0x04, 0x00},
-  DW3K_RX_CAL        = {0x04, 0x0C},
-  DW3K_RX_CAL_RESI   = {0x04, 0x14},
-  DW3K_RX_CAL_RESQ   = {0x04, 0x1C},
-  DW3K_RX_CAL_STS    = {0x04, 0x20},
-
-  DW3K_GPIO_MODE     = {0x05, 0x00},
-  DW3K_GPIO_PULL_EN  = {0x05, 0x04},
-  DW3K_GPIO_DIR      = {0x05, 0x08},
-  DW3K_GPIO_OUT      = {0x05, 0x0C},
-  DW3K_GPIO_IRQE     = {0x05, 0x10},
-  DW3K_GPIO_ISTS     = {0x05, 0x14},
-  DW3K_GPIO_ISEN     = {0x05, 0x18},
-  DW3K_GPIO_IMODE    = {0x05, 0x1C},
-  DW3K_GPIO_IBES     = {0x05, 0x20},
-  DW3K_GPIO_ICLR     = {0x05, 0x24},
-  DW3K_GPIO_IDBE     = {0x05, 0x28},
-  DW3K_GPIO_RAW      = {0x05, 0x2C},
-
-  DW3K_DTUNE0        = {0x06, 0x00},
-  DW3K_RX_SFD_TOC    = {0x06, 0x02},
-  DW3K_PRE_TOC       = {0x06, 0x04},
-  DW3K_DTUNE3        = {0x06, 0x0C},
-  DW3K_DTUNE5        = {0x06, 0x14},
-  DW3K_DRX_CAR_INT   = {0x06, 0x29},
-
-  DW3K_RF_ENABLE     = {0x07, 0x00},
-  DW3K_RF_CTRL_MASK  = {0x07, 0x04},
-  DW3K_RF_RX_CTRL2   = {0x07, 0x10},  // from deca_driver
-  DW3K_RF_SWITCH     = {0x07, 0x14},
-  DW3K_RF_TX_CTRL1   = {0x07, 0x1A},
-  DW3K_RF_TX_CTRL2   = {0x07, 0x1C},
-  DW3K_TX_TEST       = {0x07, 0x28},
-  DW3K_SAR_TEST      = {0x07, 0x34},
-  DW3K_LDO_TUNE_64   = {0x07, 0x40},
-  DW3K_LDO_CTRL      = {0x07, 0x48},
-  DW3K_LDO_RLOAD     = {0x07, 0x51},  // double check??
-
-  DW3K_SAR_CTRL      = {0x08, 0x00},
-  DW3K_SAR_STATUS    = {0x08, 0x04},
-  DW3K_SAR_READING   = {0x08, 0x08},
-  DW3K_SAR_WAKE_RD   = {0x08, 0x0C},
-  DW3K_PGC_CTRL      = {0x08, 0x10},
-  DW3K_PGC_STATUS    = {0x08, 0x14},
-  DW3K_PG_TEST       = {0x08, 0x18},
-  DW3K_PG_CAL_TARGET = {0x08, 0x1C},
-
-  DW3K_PLL_CFG       = {0x09, 0x00},
-  DW3K_PLL_CC        = {0x09, 0x04},
-  DW3K_PLL_CAL       = {0x09, 0x08},
-  DW3K_XTAL          = {0x09, 0x14},
-
-  DW3K_AON_DIG_CFG   = {0x0A, 0x00},
-  DW3K_AON_CTRL      = {0x0A, 0x04},
-  DW3K_AON_RDATA     = {0x0A, 0x08},
-  DW3K_AON_ADDR      = {0x0A, 0x0C},
-  DW3K_AON_WDATA     = {0x0A, 0x10},
-  DW3K_AON_CFG       = {0x0A, 0x14},
-
-  DW3K_OTP_WDATA     = {0x0B, 0x00},
-  DW3K_OTP_ADDR      = {0x0B, 0x04},
-  DW3K_OTP_CFG       = {0x0B, 0x08},
-  DW3K_OTP_STAT      = {0x0B, 0x0C},
-  DW3K_OTP_RDATA     = {0x0B, 0x10},
-  DW3K_OTP_SRDATA    = {0x0B, 0x14},
-
-  DW3K_IP_TS_64      = {0x0C, 0x00},
-  DW3K_STS_TS_64     = {0x0C, 0x08},
-  DW3K_STS1_TS_64    = {0x0C, 0x10},
-  DW3K_TDOA          = {0x0C, 0x18},
-  DW3K_PDOA          = {0x0C, 0x1E},  // double check?
-  DW3K_CIA_DIAG0     = {0x0C, 0x20},
-  DW3K_CIA_DIAG1     = {0x0C, 0x24},
-  DW3K_IP_DIAG0      = {0x0C, 0x28},
-  DW3K_IP_DIAG1      = {0x0C, 0x2C},
-  DW3K_IP_DIAG2      = {0x0C, 0x30},
-  DW3K_IP_DIAG3      = {0x0C, 0x34},
-  DW3K_IP_DIAG4      = {0x0C, 0x38},
-  DW3K_IP_DIAG8      = {0x0C, 0x48},
-  DW3K_IP_DIAG12     = {0x0C, 0x58},
-  DW3K_STS_DIAG0     = {0x0C, 0x5C},
-  DW3K_STS_DIAG1     = {0x0C, 0x60},
-  DW3K_STS_DIAG2     = {0x0C, 0x64},
-  DW3K_STS_DIAG3     = {0x0C, 0x68},
-  DW3K_STS_DIAG4     = {0x0D, 0x00},
-  DW3K_STS_DIAG8     = {0x0D, 0x10},
-  DW3K_STS_DIAG12    = {0x0D, 0x20},
-  DW3K_STS1_DIAG0    = {0x0D, 0x38},
-  DW3K_STS1_DIAG1    = {0x0D, 0x3C},
-  DW3K_STS1_DIAG2    = {0x0D, 0x40},
-  DW3K_STS1_DIAG3    = {0x0D, 0x44},
-  DW3K_STS1_DIAG4    = {0x0D, 0x48},
-  DW3K_STS1_DIAG8    = {0x0D, 0x58},
-  DW3K_STS1_DIAG12   = {0x0D, 0x68},
-  DW3K_CIA_CONF      = {0x0E, 0x00},
-  DW3K_FP_CONF       = {0x0E, 0x04},
-  DW3K_IP_CONF_64    = {0x0E, 0x0C},
-  DW3K_STS_CONF0     = {0x0E, 0x12},
-  DW3K_STS_CONF1     = {0x0E, 0x16},
-  DW3K_CIA_ADJUST    = {0x0E, 0x1A},
-  DW3K_PGF_DELAY_COMP_64 = {0x0E, 0x1E},
-
-  DW3K_EVC_CTRL      = {0x0F, 0x00},
-  DW3K_EVC_PHE       = {0x0F, 0x04},
-  DW3K_EVC_RSE       = {0x0F, 0x06},
-  DW3K_EVC_FCG       = {0x0F, 0x08},
-  DW3K_EVC_FCE       = {0x0F, 0x0A},
-  DW3K_EVC_FFR       = {0x0F, 0x0C},
-  DW3K_EVC_OVR       = {0x0F, 0x0E},
-  DW3K_EVC_STO       = {0x0F, 0x10},
-  DW3K_EVC_PTO       = {0x0F, 0x12},
-  DW3K_EVC_FWTO      = {0x0F, 0x14},
-  DW3K_EVC_TXFS      = {0x0F, 0x16},
-  DW3K_EVC_HPW       = {0x0F, 0x18},
-  DW3K_EVC_SWCE      = {0x0F, 0x1A},
-  DW3K_EVC_RES1      = {0x0F, 0x1C},
-  DW3K_DIAG_TMC      = {0x0F, 0x24},
-  DW3K_EVC_CPQE      = {0x0F, 0x28},
-  DW3K_EVC_VWARN     = {0x0F, 0x2A},
-  DW3K_SPI_MODE      = {0x0F, 0x2C},
-  DW3K_SYS_STATE     = {0x0F, 0x30},
-  DW3K_FCMD_STAT     = {0x0F, 0x3C},
-  DW3K_CTR_DBG       = {0x0F, 0x48},
-  DW3K_SPICRCINIT    = {0x0F, 0x4C},
-
-  DW3K_SOFT_RST      = {0x11, 0x00},
-  DW3K_CLK_CTRL      = {0x11, 0x04},
-  DW3K_SEQ_CTRL      = {0x11, 0x08},
-  DW3K_TXFSEQ        = {0x11, 0x12},  // double check??
-  DW3K_LED_CTRL      = {0x11, 0x16},
-  DW3K_RX_SNIFF      = {0x11, 0x1A},
-  DW3K_BIAS_CTRL     = {0x11, 0x1F},  // From deca_driver
-
   DW3K_RX_BUFFER0    = {0x12, 0x00},
-
   DW3K_RX_BUFFER1    = {0x13, 0x00},
-
   DW3K_TX_BUFFER     = {0x14, 0x00},
-
   DW3K_ACC_MEM       = {0x15, 0x00},
-
   DW3K_SCRATCH_RAM   = {0x16, 0x00},
 
   DW3K_AES_KEY1      = {0x17, 0x00},
@@ -242,14 +296,13 @@ static constexpr DW3KRegisterAddress
   DW3K_AES_KEY7      = {0x17, 0x60},
   DW3K_AES_KEY8      = {0x17, 0x70},
 
-  DW3K_INDIRECT_PTR_A = {0x1D, 0},
-  DW3K_INDIRECT_PTR_B = {0x1E, 0},
+  // RX_FINFO, RX_TIME (+0x04) and CIA_DIAG_0 (+0x0C) for each buffer
+  // in double buffer mode (SYS_CFG DIS_DRXB clear)
+  DW3K_BUF0_RX_FINFO = {0x18, 0x00},
+  DW3K_BUF1_RX_FINFO = {0x18, 0xE8},
 
-  DW3K_FINT_STAT     = {0x1F, 0x00},
-  DW3K_PTR_ADDR_A    = {0x1F, 0x04},
-  DW3K_PTR_OFFSET_A  = {0x1F, 0x08},
-  DW3K_PTR_ADDR_B    = {0x1F, 0x0C},
-  DW3K_PTR_OFFSET_B  = {0x1F, 0x10};
+  DW3K_INDIRECT_PTR_A = {0x1D, 0},
+  DW3K_INDIRECT_PTR_B = {0x1E, 0};
 
 static constexpr DW3KOTPAddress
   DW3K_OTP_EUID_LO             = {0x00},
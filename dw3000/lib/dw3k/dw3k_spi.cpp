@@ -12,12 +12,155 @@
 #include "dw3k_registers.h"
 #include "dwm3k_pins.h"
 
+#if defined(__SAMD51__)
+#include <Adafruit_ZeroDMA.h>
+#endif
+
 static SPIClass* spi = nullptr;
 
 uint8_t spi_buf[256];
 int spi_buf_filled = 0;
 
+static void (*volatile async_done)() = nullptr;
+static volatile bool async_busy = false;
+static bool async_reading = false;
+
+#if defined(__SAMD51__)
+// SAMD51 Datasheet 22. "DMAC - Direct Memory Access Controller"
+static Adafruit_ZeroDMA dma_tx, dma_rx;
+static DmacDescriptor* dma_tx_desc = nullptr;
+static DmacDescriptor* dma_rx_desc = nullptr;
+#endif
+
+#if DW3K_SPI_PROFILE
+struct ProfileRecord {
+  char const* caller;
+  uint32_t start_ticks;
+  uint32_t ticks;
+  uint16_t offset;
+  uint16_t len;
+  uint8_t file;
+  char op;  // R/W/M(askset)/C(ommand), lowercase r/w for async
+};
+
+struct ProfileCounter {
+  char const* caller;
+  uint32_t calls;
+  uint32_t transactions;
+  uint32_t bytes;
+  uint32_t ticks;
+};
+
+static ProfileRecord profile_ring[128];
+static ProfileCounter profile_counters[32];
+static uint32_t profile_count = 0;
+static uint32_t profile_start = 0;
+static ProfileRecord async_record;
+
+#if defined(__SAMD51__)
+static uint32_t profile_ticks() { return DWT->CYCCNT; }
+static constexpr uint32_t profile_ticks_per_us = F_CPU / 1000000;
+#else
+static uint32_t profile_ticks() { return micros(); }
+static constexpr uint32_t profile_ticks_per_us = 1;
+#endif
+
+char const* dw3k_spi_caller = nullptr;
+void (*dw3k_spi_caller_hook)(char const*) = nullptr;
+
+static ProfileCounter* profile_counter(char const* caller) {
+  for (auto& c : profile_counters) {
+    if (c.caller == caller) return &c;
+    if (!c.caller) {
+      c.caller = caller;
+      return &c;
+    }
+  }
+  return &profile_counters[0];  // Full; lump into the first entry
+}
+
+DW3KSpiCaller::DW3KSpiCaller(char const* name) : outer(dw3k_spi_caller) {
+  dw3k_spi_caller = name;
+  ++profile_counter(name)->calls;
+  if (dw3k_spi_caller_hook) dw3k_spi_caller_hook(name);
+}
+
+DW3KSpiCaller::~DW3KSpiCaller() { dw3k_spi_caller = outer; }
+
+static void profile_record(ProfileRecord r) {
+  r.ticks = profile_ticks() - r.start_ticks;
+  profile_ring[profile_count++ % 128] = r;
+  auto* const counter = profile_counter(r.caller);
+  ++counter->transactions;
+  counter->bytes += r.len;
+  counter->ticks += r.ticks;
+}
+
+static void profile(DW3KRegisterAddress addr, char op, int len) {
+  profile_record({
+      dw3k_spi_caller, profile_start, 0, addr.offset, uint16_t(len),
+      addr.file, op
+  });
+}
+
+static void profile(DW3KSpiHeader header, int len) {
+  auto const b0 = header.bytes[0], b1 = header.bytes[1];
+  auto const mode = header.len > 1 ? b1 & 0x3 : 0;
+  auto const offset = header.len > 1 ? (b0 & 1) << 6 | b1 >> 2 : 0;
+  DW3KRegisterAddress const addr = {uint8_t(b0 >> 1 & 0x1F), uint16_t(offset)};
+  profile(addr, !(b0 & 0x80) ? 'R' : mode ? 'M' : 'W', len);
+}
+
+static void profile_async(DW3KRegisterAddress addr, char op, int len) {
+  async_record = {
+      dw3k_spi_caller, profile_start, 0, addr.offset, uint16_t(len),
+      addr.file, op
+  };
+}
+
+void dw3k_spi_profile_dump(int trace_count) {
+  using ul = unsigned long;
+  Serial.printf("DW3K SPI profile (%lu transactions):\n", ul(profile_count));
+  Serial.printf("  %-24s %7s %7s %8s %8s\n",
+                "call", "calls", "xfers", "bytes", "us");
+  for (auto const& c : profile_counters) {
+    if (!c.caller) continue;
+    Serial.printf("  %-24s %7lu %7lu %8lu %8lu\n",
+                  c.caller, ul(c.calls), ul(c.transactions), ul(c.bytes),
+                  ul(c.ticks / profile_ticks_per_us));
+  }
+
+  uint32_t n = profile_count < 128 ? profile_count : 128;
+  if (uint32_t(trace_count) < n) n = trace_count;
+  if (n) Serial.printf("  Last %lu transactions:\n", ul(n));
+  for (uint32_t i = profile_count - n; i != profile_count; ++i) {
+    auto const& r = profile_ring[i % 128];
+    Serial.printf("  %10lu %c %02x:%03x len=%-4u %4luus %s\n",
+                  ul(r.start_ticks / profile_ticks_per_us), r.op, r.file,
+                  r.offset, r.len, ul(r.ticks / profile_ticks_per_us),
+                  r.caller ? r.caller : "-");
+  }
+}
+
+uint32_t dw3k_spi_profile_transactions() { return profile_count; }
+
+void dw3k_spi_profile_reset() {
+  for (auto& c : profile_counters) {
+    c.calls = c.transactions = c.bytes = c.ticks = 0;
+  }
+  profile_count = 0;
+}
+#else
+static inline void profile(DW3KRegisterAddress, char, int) {}
+static inline void profile(DW3KSpiHeader, int) {}
+static inline void profile_async(DW3KRegisterAddress, char, int) {}
+#endif
+
 static void begin() {
+  while (async_busy) {}
+#if DW3K_SPI_PROFILE
+  profile_start = profile_ticks();
+#endif
   digitalWrite(DW3K_CSn_PIN, 0);
   spi->beginTransaction(SPISettings(36000000, MSBFIRST, SPI_MODE0));
   spi_buf_filled = 0;
@@ -53,11 +196,38 @@ static void end() {
   digitalWrite(DW3K_CSn_PIN, 1);
 }
 
+static void end_async() {
+  spi->endTransaction();
+  digitalWrite(DW3K_CSn_PIN, 1);
+#if DW3K_SPI_PROFILE
+  profile_record(async_record);
+#endif
+  auto const done = async_done;
+  async_done = nullptr;
+  async_busy = false;
+  if (done) done();
+}
+
+#if defined(__SAMD51__)
+static void on_dma_rx_done(Adafruit_ZeroDMA*) { end_async(); }
+
+static void on_dma_tx_done(Adafruit_ZeroDMA*) {
+  if (async_reading) return;  // Wait for the RX channel to finish instead
+
+  // Write; let the last byte leave the shifter, then drop unread RX data
+  auto* const sercom_spi = &SERCOM3->SPI;
+  while (!sercom_spi->INTFLAG.bit.TXC) {}
+  while (sercom_spi->INTFLAG.bit.RXC) (void) sercom_spi->DATA.reg;
+  sercom_spi->STATUS.bit.BUFOVF = 1;
+  end_async();
+}
+#endif
+
 void dw3k_init_spi() {
   if (!spi) {
     digitalWrite(DW3K_CSn_PIN, 1);
     pinMode(DW3K_CSn_PIN, OUTPUT);
-#if ARDUINO_ARCH_AVR
+#if ARDUINO_ARCH_AVR || DW3K_SIM
     spi = &SPI;
     spi->begin();
 #endif
@@ -71,6 +241,28 @@ void dw3k_init_spi() {
     pinPeripheral(DW3K_MISO_PIN, PIO_SERCOM_ALT);
     pinPeripheral(DW3K_CLK_PIN, PIO_SERCOM_ALT);
     pinPeripheral(DW3K_MOSI_PIN, PIO_SERCOM_ALT);
+#endif
+#if DW3K_SPI_PROFILE && defined(__SAMD51__)
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+#if defined(__SAMD51__)
+    void* const data_reg = (void*) &SERCOM3->SPI.DATA.reg;
+    dma_tx.setTrigger(SERCOM3_DMAC_ID_TX);
+    dma_tx.setAction(DMA_TRIGGER_ACTON_BEAT);
+    dma_tx.allocate();
+    dma_tx_desc = dma_tx.addDescriptor(
+        spi_buf, data_reg, 0, DMA_BEAT_SIZE_BYTE, true, false
+    );
+    dma_tx.setCallback(on_dma_tx_done);
+
+    dma_rx.setTrigger(SERCOM3_DMAC_ID_RX);
+    dma_rx.setAction(DMA_TRIGGER_ACTON_BEAT);
+    dma_rx.allocate();
+    dma_rx_desc = dma_rx.addDescriptor(
+        data_reg, spi_buf, 0, DMA_BEAT_SIZE_BYTE, false, true
+    );
+    dma_rx.setCallback(on_dma_rx_done);
 #endif
   }
 }
@@ -79,71 +271,156 @@ void dw3k_command(DW3KFastCommand command) {
   begin();
   add_byte(0x81 | (command.bits << 1));
   end();
+  profile({0xFF, command.bits}, 'C', 0);
 }
 
-static void add_header(DW3KRegisterAddress addr, bool wr, uint8_t mbits) {
-  if (!mbits && !addr.offset) {
-    add_byte((wr ? 0x80 : 0) | (addr.file << 1));
-  } else {
-    add_byte((wr ? 0xC0 : 0x40) | (addr.file << 1) | (addr.offset >> 6));
-    add_byte((addr.offset << 2) | mbits);
-  }
+static void add_header(DW3KSpiHeader header) {
+  add_data(header.bytes, header.len);
 }
 
+// Offsets past 0x7F go through an indirect pointer (DW3000 User Manual 8.2.20
+// "Indirect pointer A"). Pointer A serves registers and pointer B the RX/TX
+// buffers, so buffer streaming and register access don't keep re-aiming one
+// pointer. Each remembers its target; an access within 0x7F bytes past it
+// reuses it through the window's sub-offset.
+struct IndirectPointer {
+  DW3KRegisterAddress const window;
+  DW3KSpiHeader const aim_header;  // PTR_ADDR_x, PTR_OFFSET_x follows at +4
+  bool valid;
+  DW3KRegisterAddress target;
+};
+
+static IndirectPointer pointer_a = {
+    DW3K_INDIRECT_PTR_A, DW3K_PTR_ADDR_A.write_header, false, {}
+};
+
+static IndirectPointer pointer_b = {
+    DW3K_INDIRECT_PTR_B, DW3K_PTR_ADDR_B.write_header, false, {}
+};
+
 static void maybe_indirect(DW3KRegisterAddress* addr) {
   if (addr->offset < 0x80) return;
-  dw3k_write(DW3K_PTR_ADDR_A, addr->file);
-  dw3k_write(DW3K_PTR_OFFSET_A, addr->offset);
-  *addr = DW3K_INDIRECT_PTR_A;
+  bool const buffer =
+      addr->file >= DW3K_RX_BUFFER0.file && addr->file <= DW3K_TX_BUFFER.file;
+  auto& ptr = buffer ? pointer_b : pointer_a;
+  if (!ptr.valid || ptr.target.file != addr->file ||
+      addr->offset < ptr.target.offset ||
+      addr->offset - ptr.target.offset >= 0x80) {
+    uint32_t const aim[2] = {addr->file, addr->offset};
+    dw3k_write_direct(ptr.aim_header, aim, sizeof(aim));
+    ptr.target = *addr;
+    ptr.valid = true;
+  }
+  *addr = {ptr.window.file, uint16_t(addr->offset - ptr.target.offset)};
+}
+
+uint32_t dw3k_cache_value[dw3k_cache_size];
+uint32_t dw3k_cache_valid = 0;
+
+void dw3k_cache_invalidate() {
+  dw3k_cache_valid = 0;
+  pointer_a.valid = pointer_b.valid = false;
+}
+
+static void forget_written(DW3KRegisterAddress addr, int n) {
+  if (dw3k_cache_forgets_all(addr)) dw3k_cache_invalidate();
+  dw3k_cache_valid &= ~dw3k_cache_overlap(addr, n);
 }
 
 void dw3k_read(DW3KRegisterAddress addr, void* data, int n) {
+  auto const logical = addr;
   maybe_indirect(&addr);
   begin();
-  add_header(addr, false, 0);
+  add_header(dw3k_spi_header(addr, false, 0));
   flush();
   spi->transfer(data, n);
   end();
+  profile(logical, 'R', n);
 }
 
 void dw3k_write(DW3KRegisterAddress addr, void const* data, int n) {
+  auto const logical = addr;
+  forget_written(addr, n);
   maybe_indirect(&addr);
   begin();
-  add_header(addr, true, 0);
+  add_header(dw3k_spi_header(addr, true, 0));
   add_data(data, n);
   end();
+  profile(logical, 'W', n);
 }
 
-void dw3k_maskset8(DW3KRegisterAddress addr, uint8_t mask, uint8_t set) {
-  maybe_indirect(&addr);
+void dw3k_read_direct(DW3KSpiHeader header, void* data, int n) {
   begin();
-  add_header(addr, true, 1);
-  add_data(&mask, sizeof(mask));
-  add_data(&set, sizeof(set));
+  add_header(header);
+  flush();
+  spi->transfer(data, n);
   end();
+  profile(header, n);
 }
 
-void dw3k_maskset16(DW3KRegisterAddress addr, uint16_t mask, uint16_t set) {
-  maybe_indirect(&addr);
+void dw3k_write_direct(DW3KSpiHeader header, void const* data, int n) {
   begin();
-  add_header(addr, true, 2);
-  add_data(&mask, sizeof(mask));
-  add_data(&set, sizeof(set));
+  add_header(header);
+  add_data(data, n);
   end();
+  profile(header, n);
+}
+
+// The header goes out synchronously (1-2 bytes); only the payload uses DMA.
+static void start_async(void* rx, void const* tx, int n, void (*done)()) {
+  async_done = done;
+  async_busy = true;
+  async_reading = (rx != nullptr);
+#if defined(__SAMD51__)
+  if (n > 0) {
+    if (rx) {
+      dma_rx.changeDescriptor(dma_rx_desc, nullptr, rx, n);
+      dma_rx.startJob();
+    }
+    dma_tx.changeDescriptor(dma_tx_desc, (void*) tx, nullptr, n);
+    dma_tx.startJob();
+    return;
+  }
+#else
+  if (rx) {
+    spi->transfer(rx, n);
+  } else {
+    add_data(tx, n);
+    flush();
+  }
+#endif
+  end_async();
+}
+
+void dw3k_start_read(DW3KRegisterAddress addr, void* data, int n,
+                     void (*done)()) {
+  auto const logical = addr;
+  maybe_indirect(&addr);
+  begin();  // Waits out any transfer in flight, which logs its own record
+  add_header(dw3k_spi_header(addr, false, 0));
+  flush();
+  profile_async(logical, 'r', n);
+  start_async(data, data, n, done);  // Outgoing bytes are ignored by the chip
 }
 
-void dw3k_maskset32(DW3KRegisterAddress addr, uint32_t mask, uint32_t set) {
+void dw3k_start_write(DW3KRegisterAddress addr, void const* data, int n,
+                      void (*done)()) {
+  auto const logical = addr;
+  forget_written(addr, n);
   maybe_indirect(&addr);
   begin();
-  add_header(addr, true, 3);
-  add_data(&mask, sizeof(mask));
-  add_data(&set, sizeof(set));
-  end();
+  add_header(dw3k_spi_header(addr, true, 0));
+  flush();
+  profile_async(logical, 'w', n);
+  start_async(nullptr, data, n, done);
 }
 
+bool dw3k_spi_busy() { return async_busy; }
+
 uint32_t dw3k_read_otp(DW3KOTPAddress addr) {
+  DW3K_SPI_CALLER();
   dw3k_write(DW3K_OTP_CFG, uint16_t(0x0001));
   dw3k_write(DW3K_OTP_ADDR, addr.index);
   dw3k_write(DW3K_OTP_CFG, uint16_t(0x0002));
-  return dw3k_read<uint32_t>(DW3K_OTP_RDATA);
+  return dw3k_read(DW3K_OTP_RDATA);
 }
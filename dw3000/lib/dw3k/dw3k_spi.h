@@ -6,19 +6,160 @@ void dw3k_init_spi();
 void dw3k_command(DW3KFastCommand);
 void dw3k_read(DW3KRegisterAddress, void*, int len);
 void dw3k_write(DW3KRegisterAddress, void const*, int len);
-void dw3k_maskset8(DW3KRegisterAddress, uint8_t mask, uint8_t set);
-void dw3k_maskset16(DW3KRegisterAddress, uint16_t mask, uint16_t set);
-void dw3k_maskset32(DW3KRegisterAddress, uint32_t mask, uint32_t set);
 uint32_t dw3k_read_otp(DW3KOTPAddress);
 
-template <typename T>
-static inline uint32_t dw3k_read(DW3KRegisterAddress addr) {
-  T val;
-  dw3k_read(addr, &val, sizeof(val));
-  return val;
+// Asynchronous transfers (DMA on SAMD51; elsewhere they complete at once).
+// The buffer must stay valid until "done" runs, which is in interrupt context.
+// Other dw3k_* SPI calls made meanwhile wait for the transfer to finish.
+void dw3k_start_read(DW3KRegisterAddress, void*, int len, void (*done)());
+void dw3k_start_write(
+    DW3KRegisterAddress, void const*, int len, void (*done)());
+bool dw3k_spi_busy();
+
+// Optional bus profiling (build with -DDW3K_SPI_PROFILE=1): each transaction
+// is logged to a RAM ring buffer and counted against the public dw3k_* call
+// in progress, which names itself with DW3K_SPI_CALLER(). Compiles to nothing
+// when disabled.
+#if DW3K_SPI_PROFILE
+struct DW3KSpiCaller {
+  DW3KSpiCaller(char const* name);
+  ~DW3KSpiCaller();
+  char const* const outer;
+};
+
+extern char const* dw3k_spi_caller;                 // Null outside any call
+extern void (*dw3k_spi_caller_hook)(char const*);  // Run on each entry
+
+#define DW3K_SPI_CALLER() DW3KSpiCaller const spi_caller(__func__)
+void dw3k_spi_profile_dump(int trace_count = 32);
+void dw3k_spi_profile_reset();
+uint32_t dw3k_spi_profile_transactions();  // Since the last reset
+#else
+#define DW3K_SPI_CALLER() do {} while (0)
+static inline void dw3k_spi_profile_dump(int = 32) {}
+static inline void dw3k_spi_profile_reset() {}
+static inline uint32_t dw3k_spi_profile_transactions() { return 0; }
+#endif
+
+// Shadow copies of configuration registers the chip never changes on its own
+// (32 bits at most; not ones the OTP kick loads, like BIAS_CTRL). Writes go
+// through, reads cost no SPI traffic once the value is known, and masked
+// writes that would change nothing are skipped.
+// Everything is forgotten on dw3k_cache_invalidate() (dw3k_reset() calls it)
+// and on any write to SOFT_RST; raw writes forget registers they overlap.
+// The indirect pointer registers are cached too (see dw3k_spi.cpp), so only
+// the SPI layer should write them.
+static constexpr DW3KRegisterAddress dw3k_cached_registers[] = {
+  DW3K_PANADR, DW3K_SYS_CFG, DW3K_FF_CFG, DW3K_TX_FCTRL, DW3K_RX_FWTO,
+  DW3K_TX_ANTD, DW3K_ACK_RESP_T, DW3K_TX_POWER, DW3K_CHAN_CTRL,
+  DW3K_DTUNE0, DW3K_DTUNE3, DW3K_RF_TX_CTRL1, DW3K_RF_TX_CTRL2, DW3K_XTAL,
+};
+
+static constexpr int dw3k_cache_size =
+    sizeof(dw3k_cached_registers) / sizeof(dw3k_cached_registers[0]);
+static_assert(dw3k_cache_size <= 32, "Too many cached registers");
+
+extern uint32_t dw3k_cache_value[dw3k_cache_size];
+extern uint32_t dw3k_cache_valid;  // Bit per dw3k_cached_registers entry
+void dw3k_cache_invalidate();
+
+// Wider registers at the same address (e.g. TX_FCTRL_64) aren't cached.
+static constexpr int dw3k_cache_slot(DW3KRegisterAddress addr, int len) {
+  if (len > 4) return -1;
+  for (int i = 0; i < dw3k_cache_size; ++i) {
+    auto const& c = dw3k_cached_registers[i];
+    if (c.file == addr.file && c.offset == addr.offset) return i;
+  }
+  return -1;
+}
+
+// Cache entries touched by writing "len" bytes at "addr".
+static constexpr uint32_t dw3k_cache_overlap(
+    DW3KRegisterAddress addr, int len) {
+  uint32_t bits = 0;
+  for (int i = 0; i < dw3k_cache_size; ++i) {
+    auto const& c = dw3k_cached_registers[i];
+    if (c.file == addr.file &&
+        c.offset < addr.offset + len && addr.offset < c.offset + 4)
+      bits |= 1u << i;
+  }
+  return bits;
 }
 
-template <typename T>
-static inline void dw3k_write(DW3KRegisterAddress addr, T const& v) {
-  dw3k_write(addr, &v, sizeof(v));
+// Writes that reset the chip (or pointers) behind the cache's back.
+static constexpr bool dw3k_cache_forgets_all(DW3KRegisterAddress addr) {
+  return (addr.file == DW3K_SOFT_RST.file &&
+          addr.offset == DW3K_SOFT_RST.offset) ||
+      (addr.file == DW3K_PTR_ADDR_A.file &&
+       addr.offset >= DW3K_PTR_ADDR_A.offset &&
+       addr.offset <= DW3K_PTR_OFFSET_B.offset);
+}
+
+// Typed register access (see DW3KRegister), with the SPI header built at
+// compile time. Only the register's width goes over the wire.
+void dw3k_read_direct(DW3KSpiHeader, void*, int len);
+void dw3k_write_direct(DW3KSpiHeader, void const*, int len);
+
+template <uint8_t F, uint16_t O, typename T, int S>
+static inline T dw3k_read(DW3KRegister<F, O, T, S>) {
+  using R = DW3KRegister<F, O, T, S>;
+  constexpr int slot = dw3k_cache_slot(R::address, S);
+  if constexpr (slot >= 0) {
+    if (dw3k_cache_valid & (1u << slot)) return T(dw3k_cache_value[slot]);
+  }
+
+  T value = 0;
+  dw3k_read_direct(R::read_header, &value, S);
+  if constexpr (slot >= 0) {
+    dw3k_cache_value[slot] = value;
+    dw3k_cache_valid |= 1u << slot;
+  }
+  return value;
+}
+
+template <uint8_t F, uint16_t O, typename T, int S>
+static inline void dw3k_write(
+    DW3KRegister<F, O, T, S>, typename DW3KRegister<F, O, T, S>::Value v) {
+  using R = DW3KRegister<F, O, T, S>;
+  constexpr int slot = dw3k_cache_slot(R::address, S);
+  constexpr uint32_t overlap = dw3k_cache_overlap(R::address, S);
+  dw3k_write_direct(R::write_header, &v, S);
+  if constexpr (dw3k_cache_forgets_all(R::address)) dw3k_cache_invalidate();
+  if constexpr (overlap != 0) dw3k_cache_valid &= ~overlap;
+  if constexpr (slot >= 0) {
+    dw3k_cache_value[slot] = v;
+    dw3k_cache_valid |= 1u << slot;
+  }
+}
+
+template <uint8_t F, uint16_t O, typename T, int S>
+static inline void dw3k_maskset(
+    DW3KRegister<F, O, T, S>,
+    typename DW3KRegister<F, O, T, S>::Value mask,
+    typename DW3KRegister<F, O, T, S>::Value set) {
+  static_assert(S == 1 || S == 2 || S == 4, "No masked write at this width");
+  using R = DW3KRegister<F, O, T, S>;
+  constexpr int slot = dw3k_cache_slot(R::address, S);
+  constexpr uint32_t overlap = dw3k_cache_overlap(R::address, S);
+  bool known = false;
+  T value = 0;
+  if constexpr (slot >= 0) {
+    if ((known = dw3k_cache_valid & (1u << slot))) {
+      T const old = dw3k_cache_value[slot];
+      value = (old & mask) | set;
+      if (value == old) return;
+    }
+  }
+
+  struct { T mask, set; } const data = {mask, set};
+  static_assert(sizeof(data) == 2 * S, "Bad masked write layout");
+  dw3k_write_direct(R::maskset_header, &data, sizeof(data));
+  if constexpr (dw3k_cache_forgets_all(R::address)) dw3k_cache_invalidate();
+  if constexpr (overlap != 0) dw3k_cache_valid &= ~overlap;
+  if constexpr (slot >= 0) {
+    if (known) {
+      dw3k_cache_value[slot] = value;
+      dw3k_cache_valid |= 1u << slot;
+    }
+  }
 }
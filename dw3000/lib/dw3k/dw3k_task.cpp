@@ -0,0 +1,160 @@
+#include "dw3k_task.h"
+
+#include <Arduino.h>
+
+#include "dw3k_time.h"
+
+enum Wait : uint8_t { NoWait, Round, Status, ChipTime, Delay };
+enum Clock : uint8_t { NoClock, ChipClock, MicrosClock };
+
+static DW3KTask* tasks = nullptr;  // Started ones, in order
+static DW3KStatus radio = DW3KStatus::Invalid;  // Latest dw3k_poll()
+
+// Chip deadlines cost a SYS_TIME read to check, so that happens at most
+// every clock_check_micros, or at the nearest deadline if sooner (as
+// micros() sees it), and at once after a new one is set
+static constexpr uint32_t clock_check_micros = 250;
+static unsigned long next_check_micros = 0;
+static bool check_now = true;
+
+static bool chip_clock_runs(DW3KStatus s) {
+  return s >= DW3KStatus::ResetWaitPLL && s <= DW3KStatus::Ready;
+}
+
+static bool failed(DW3KStatus s) {
+  return s == DW3KStatus::ChipError || s == DW3KStatus::CodeBug;
+}
+
+// Statuses that end an operation without reaching "wanted"
+static bool rules_out(DW3KStatus s, DW3KStatus wanted) {
+  if (s == wanted) return false;
+  return failed(s) || s == DW3KStatus::TransmitTooLate ||
+      s == DW3KStatus::ReceiveTimeout || s == DW3KStatus::ReceiveTooLate;
+}
+
+void dw3k_task_start(
+    DW3KTask* task, void (*run)(DW3KTask*), void* context) {
+  if (!dw3k_task_running(task)) {
+    DW3KTask** end = &tasks;
+    while (*end) end = &(*end)->next;
+    *end = task;
+    task->next = nullptr;
+  }
+  task->run = run;
+  task->context = context;
+  task->step = 0;
+  task->status = radio;
+  task->timed_out = task->due = false;
+  task->wait = Round;
+  task->clock = NoClock;
+}
+
+void dw3k_task_stop(DW3KTask* task) {
+  for (DW3KTask** t = &tasks; *t; t = &(*t)->next) {
+    if (*t != task) continue;
+    *t = task->next;
+    break;
+  }
+  task->next = nullptr;
+  task->wait = NoWait;
+  task->due = false;
+}
+
+bool dw3k_task_running(DW3KTask const* task) {
+  for (auto const* t = tasks; t; t = t->next) {
+    if (t == task) return true;
+  }
+  return false;
+}
+
+void dw3k_task_yield(DW3KTask* task) {
+  task->wait = Round;
+  task->clock = NoClock;
+}
+
+void dw3k_task_wait_status(
+    DW3KTask* task, DW3KStatus wanted, uint32_t timeout_micros) {
+  task->wait = Status;
+  task->wanted = wanted;
+  task->clock = NoClock;
+  if (!timeout_micros) return;
+
+  radio = dw3k_poll();  // Maybe just reset
+  if (chip_clock_runs(radio)) {
+    task->clock = ChipClock;
+    task->deadline = dw3k_clock_t32() + dw3k_micros_t32(timeout_micros);
+    check_now = true;
+  } else {
+    task->clock = MicrosClock;
+    task->deadline = micros() + timeout_micros;
+  }
+}
+
+void dw3k_task_wait_t32(DW3KTask* task, uint32_t t32) {
+  task->wait = ChipTime;
+  task->clock = ChipClock;
+  task->deadline = t32;
+  check_now = true;
+}
+
+void dw3k_task_wait_micros(DW3KTask* task, uint32_t delay_micros) {
+  task->wait = Delay;
+  task->clock = MicrosClock;
+  task->deadline = micros() + delay_micros;
+}
+
+void dw3k_task_run() {
+  // Only talk to the chip if some task needs it
+  bool poll = false;
+  for (auto const* t = tasks; t; t = t->next) {
+    poll |= t->wait == Status || t->wait == ChipTime;
+  }
+  if (poll) radio = dw3k_poll();
+  unsigned long const now_micros = micros();
+
+  // Decide who is due first, so tasks started meanwhile wait a round
+  bool chip_deadlines = false;
+  for (auto* t = tasks; t; t = t->next) {
+    bool woken = false;
+    if (t->wait == Round) woken = true;
+    if (t->wait == Status) woken = radio == t->wanted ||
+        rules_out(radio, t->wanted);
+    if (t->wait == ChipTime) woken = failed(radio);
+
+    t->timed_out = false;
+    if (!woken && t->clock == MicrosClock)
+      t->timed_out = long(now_micros - t->deadline) >= 0;
+    chip_deadlines |= !woken && t->clock == ChipClock;
+    t->due = woken || t->timed_out;
+  }
+
+  if (chip_deadlines &&
+      (check_now || long(now_micros - next_check_micros) >= 0)) {
+    // Without a running chip clock (reset?) chip times are meaningless
+    bool const have_t32 = chip_clock_runs(radio);
+    uint32_t const now_t32 = have_t32 ? dw3k_clock_t32() : 0;
+    int64_t wait_ns = clock_check_micros * 1000;
+    for (auto* t = tasks; t; t = t->next) {
+      if (t->due || t->clock != ChipClock) continue;
+      int32_t const left_t32 = t->deadline - now_t32;
+      t->timed_out = t->due = !have_t32 || left_t32 <= 0;
+      if (!t->due && dw3k_t32_ns(left_t32) < wait_ns)
+        wait_ns = dw3k_t32_ns(left_t32);
+    }
+    next_check_micros = now_micros + uint32_t(wait_ns / 1000);
+    check_now = false;
+  }
+
+  // Rescan after each run(), which may start and stop tasks
+  for (;;) {
+    DW3KTask* t = tasks;
+    while (t && !t->due) t = t->next;
+    if (!t) break;
+    t->due = false;
+    t->status = radio;
+    t->wait = NoWait;
+    t->clock = NoClock;
+    t->run(t);
+    if (t->wait == NoWait) dw3k_task_stop(t);
+  }
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "dw3k.h"
+
+// Cooperative tasks sharing the MCU with the radio, instead of blocking in
+// dw3k_wait_verbose(). A task's run() does a step of work, says what to
+// wake it for next (a radio status, a chip time, a delay or just the next
+// round) and returns; loop() calls dw3k_task_run(), which polls the chip
+// once and runs every task that is due. Ranging, telemetry and other
+// peripherals then interleave, each step only as long as its own work.
+//
+// Radio timeouts and chip times count on the chip's clock (as the radio's
+// own timing does) whenever it runs, and on micros() during reset. A task
+// waiting on the radio is also woken by failures that rule its status out
+// (TransmitTooLate, ReceiveTimeout, ReceiveTooLate, ChipError, CodeBug);
+// "status" and "timed_out" tell run() what happened. Chip deadlines are
+// checked (a SYS_TIME read) only when status didn't wake their task, at
+// most every ~250us unless one is nearer.
+//
+// Tasks belong to the caller (usually static, zeroed) and are linked
+// together while started, so there is no allocation. run() may start or
+// stop any task, itself included; a task that sets no new wait is stopped.
+
+struct DW3KTask {
+  void (*run)(DW3KTask*);
+  void* context;
+  int step;  // For run() (e.g. to switch on); 0 when started
+
+  // Why run() was called, set by dw3k_task_run()
+  DW3KStatus status;  // As of this round's dw3k_poll(), if it polled
+  bool timed_out;
+
+  // Internal
+  DW3KTask* next;
+  uint8_t wait;
+  uint8_t clock;
+  bool due;
+  DW3KStatus wanted;
+  uint32_t deadline;
+};
+
+// Runs it in the next dw3k_task_run() (restarts it if running)
+void dw3k_task_start(
+    DW3KTask*, void (*run)(DW3KTask*), void* context = nullptr);
+void dw3k_task_stop(DW3KTask*);
+bool dw3k_task_running(DW3KTask const*);
+
+// Called by run() to choose its next wake-up (the last call counts)
+void dw3k_task_yield(DW3KTask*);  // Next round
+void dw3k_task_wait_status(  // Timeout 0 waits forever, else up to ~8s
+    DW3KTask*, DW3KStatus wanted, uint32_t timeout_micros = 0);
+void dw3k_task_wait_t32(DW3KTask*, uint32_t t32);  // dw3k_clock_t32() time
+void dw3k_task_wait_micros(DW3KTask*, uint32_t delay_micros);  // No chip
+
+void dw3k_task_run();  // A round; from loop(), as often as possible
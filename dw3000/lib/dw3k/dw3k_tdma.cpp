@@ -0,0 +1,378 @@
+#include "dw3k_tdma.h"
+
+#include <Arduino.h>
+#include <string.h>
+
+#include "dw3k.h"
+#include "dw3k_time.h"
+
+// Every frame starts with a header; a beacon adds the superframe layout, a
+// data frame the payload
+struct __attribute__((packed)) TdmaHeader {
+  uint8_t type;  // 'B' (beacon) or 'D' (data)
+  uint8_t slot;
+  uint16_t source;
+  uint32_t superframe;
+};
+
+struct __attribute__((packed)) TdmaBeacon {
+  uint8_t slots;
+  uint32_t slot_micros;
+  uint32_t guard_micros;
+};
+
+static constexpr int max_frame_size =
+    sizeof(TdmaHeader) + dw3k_tdma_max_payload;
+static constexpr uint32_t setup_micros = 20;  // Ahead of DX_TIME, at least
+
+enum class Step { Idle, Search, Transmit, Receive };
+
+static DW3KTdmaStatus status = DW3KTdmaStatus::Idle;
+static Step step = Step::Idle;
+static char const* error_text = "[No error logged]";
+static DW3KTdmaConfig config = {};
+static DW3KTdmaStats stats = {};
+static DW3KTdmaSlotStats slot_stats[dw3k_tdma_max_slots];
+static DW3KTdmaFrame frame = {};
+static bool frame_new = false;
+static unsigned long start_micros;
+
+// Superframe timing in our clock (a node scales slot_q16 by the offset)
+static uint32_t start_t32;  // Slot 0 start
+static uint64_t slot_q16;  // Slot length in t32 ticks, 16 bits fraction
+static uint32_t guard_t32, lead_t32, setup_t32;
+static uint32_t superframe;
+static int slot;
+static int missed;  // Node: beacons in a row
+static uint32_t errors_before;  // dw3k_rx_errors() as the window opened
+
+// dw3k_tdma_send() payload, for our next TX slot
+static uint8_t payload[dw3k_tdma_max_payload];
+static int payload_size = -1;
+
+static void fail(char const* text) {
+  status = DW3KTdmaStatus::Failed;
+  error_text = text;
+  if (step != Step::Idle) dw3k_end_txrx();
+  step = Step::Idle;
+}
+
+static uint32_t slots_t32(int count) {
+  return uint32_t((count * slot_q16 + 0x8000) >> 16);
+}
+
+static uint32_t slot_start_t32(int s) { return start_t32 + slots_t32(s); }
+
+static bool owned(uint64_t slots, int s) { return s && (slots >> s) & 1; }
+
+static void transmit(uint32_t at_t32) {
+  uint8_t data[max_frame_size];
+  TdmaHeader const header = {
+      uint8_t(slot ? 'D' : 'B'), uint8_t(slot), config.address, superframe};
+  memcpy(data, &header, sizeof(header));
+  int size = sizeof(header);
+  if (slot == 0) {
+    TdmaBeacon const beacon = {
+        config.slots, config.slot_micros, config.guard_micros};
+    memcpy(data + size, &beacon, sizeof(beacon));
+    size += sizeof(beacon);
+  } else {
+    memcpy(data + size, payload, payload_size);
+    size += payload_size;
+  }
+
+  // The preamble starts a guard time into the slot
+  dw3k_buffer_tx(data, size);
+  dw3k_schedule_tx(at_t32 + guard_t32 + lead_t32);
+  step = Step::Transmit;
+}
+
+static void receive(uint32_t at_t32) {
+  errors_before = dw3k_rx_errors();
+  ++slot_stats[slot].windows;
+  ++stats.rx_slots;
+  dw3k_schedule_rx(at_t32);
+  step = Step::Receive;
+}
+
+static void search();
+
+static void miss_beacon() {
+  ++stats.beacons_missed;
+  if (++missed >= dw3k_tdma_max_missed) search();
+}
+
+// Sets up the first slot after the current one with something to do,
+// skipping any that would start before we could get ready
+static void next_slot() {
+  for (;;) {
+    if (++slot == config.slots) {
+      start_t32 = slot_start_t32(config.slots);
+      slot = 0;
+      ++superframe;
+      ++stats.superframes;
+    }
+
+    bool const beacon = slot == 0;
+    bool const tx = (beacon && config.coordinator) ||
+        (owned(config.tx_slots, slot) && payload_size >= 0);
+    bool const rx = !tx &&
+        ((beacon && !config.coordinator) || owned(config.rx_slots, slot));
+    if (owned(config.tx_slots, slot)) ++stats.tx_slots;
+    if (!tx && !rx) continue;
+
+    uint32_t const at_t32 = slot_start_t32(slot);
+    uint32_t const ready_t32 = at_t32 + (tx ? guard_t32 : 0);
+    if (int32_t(ready_t32 - dw3k_clock_t32()) < int32_t(setup_t32)) {
+      ++stats.late;
+      if (beacon && !config.coordinator) {
+        miss_beacon();
+        if (step == Step::Search) return;
+      }
+      continue;
+    }
+
+    return tx ? transmit(at_t32) : receive(at_t32);
+  }
+}
+
+// A frame as it arrived, read out before dw3k_end_txrx()
+struct Arrival {
+  TdmaHeader header;
+  TdmaBeacon beacon;  // If header.type is 'B'
+  uint64_t rx_t40;
+  float clock_offset;
+};
+
+// Reads the frame (a data frame's payload straight into "frame")
+static bool read_frame(Arrival* a) {
+  int const size = dw3k_rx_size();
+  if (size < int(sizeof(a->header)) || size > max_frame_size) return false;
+  uint8_t data[max_frame_size];
+  dw3k_retrieve_rx(0, size, data);
+  memcpy(&a->header, data, sizeof(a->header));
+  a->rx_t40 = dw3k_rx_timestamp_t40();
+  a->clock_offset = dw3k_rx_clock_offset();
+
+  auto const* const body = data + sizeof(a->header);
+  int const body_size = size - sizeof(a->header);
+  if (a->header.type == 'B') {
+    if (body_size != sizeof(a->beacon)) return false;
+    memcpy(&a->beacon, body, sizeof(a->beacon));
+  } else {
+    frame.source = a->header.source;
+    frame.slot = a->header.slot;
+    frame.superframe = a->header.superframe;
+    frame.rx_t40 = a->rx_t40;
+    frame.size = body_size;
+    memcpy(frame.data, body, body_size);
+  }
+  return true;
+}
+
+// Node: takes the superframe from a beacon (with the radio Ready)
+static bool sync(Arrival const& a) {
+  auto const& b = a.beacon;
+  if (a.header.type != 'B' || a.header.slot != 0) return false;
+  if (b.slots < 2 || b.slots > dw3k_tdma_max_slots) return false;
+  if (b.slot_micros <= 3 * b.guard_micros) return false;
+
+  bool const layout_changed = b.slots != config.slots ||
+      b.slot_micros != config.slot_micros ||
+      b.guard_micros != config.guard_micros;
+  if (layout_changed || step == Step::Search)
+    dw3k_set_rx_timeout(b.slot_micros - 2 * b.guard_micros);
+  config.slots = b.slots;
+  config.slot_micros = b.slot_micros;
+  config.guard_micros = b.guard_micros;
+  guard_t32 = dw3k_micros_t32(b.guard_micros);
+  uint32_t const slot_t32 = dw3k_micros_t32(b.slot_micros);
+  slot_q16 = (uint64_t(slot_t32) << 16) +
+      int64_t(slot_t32 * a.clock_offset * 65536.0f);
+  start_t32 = uint32_t(a.rx_t40 >> 8) - guard_t32 - lead_t32;
+  superframe = a.header.superframe;
+  slot = 0;
+  missed = 0;
+  return true;
+}
+
+static void search() {
+  ++stats.searches;
+  status = DW3KTdmaStatus::Searching;
+  dw3k_end_txrx();
+  dw3k_set_rx_timeout(0);
+  dw3k_start_rx();
+  step = Step::Search;
+}
+
+static void poll_search(DW3KStatus radio) {
+  if (radio != DW3KStatus::ReceiveDone) return;
+  Arrival a = {};
+  bool const read = read_frame(&a);
+  dw3k_end_txrx();
+  if (!read || !sync(a)) {
+    dw3k_start_rx();  // Keep looking
+    return;
+  }
+
+  status = DW3KTdmaStatus::Running;
+  step = Step::Receive;
+  next_slot();
+}
+
+static void poll_transmit(DW3KStatus radio) {
+  if (radio == DW3KStatus::TransmitTooLate) {
+    ++stats.late;  // The payload waits for the next slot
+  } else if (radio == DW3KStatus::TransmitDone) {
+    if (slot) {
+      ++stats.tx_frames;
+      payload_size = -1;
+    }
+  } else {
+    return;
+  }
+  dw3k_end_txrx();
+  next_slot();
+}
+
+static void poll_receive(DW3KStatus radio) {
+  if (radio == DW3KStatus::ReceiveTooLate) {
+    ++stats.late;  // The window was gone before the receiver could open
+    dw3k_end_txrx();
+    if (slot == 0) {
+      miss_beacon();
+      if (step == Step::Search) return;
+    }
+    return next_slot();
+  }
+  if (radio != DW3KStatus::ReceiveDone && radio != DW3KStatus::ReceiveTimeout)
+    return;
+
+  auto& ss = slot_stats[slot];
+  uint32_t const errors = dw3k_rx_errors() - errors_before;
+  ss.errors += errors;
+  stats.rx_errors += errors;
+
+  Arrival a = {};
+  bool const read = radio == DW3KStatus::ReceiveDone && read_frame(&a);
+  dw3k_end_txrx();
+
+  bool const want_beacon = slot == 0;
+  bool const good = read &&
+      (want_beacon ? sync(a) : a.header.type == 'D' && a.header.slot == slot);
+  if (good) {
+    ++ss.frames;
+    ++stats.rx_frames;
+    frame_new = !want_beacon;
+  } else if (read) {
+    ++ss.misplaced;
+    ++stats.misplaced;
+  }
+
+  if (want_beacon && !good) {
+    miss_beacon();
+    if (step == Step::Search) return;
+  }
+  next_slot();
+}
+
+void dw3k_tdma_start(DW3KTdmaConfig const& c) {
+  dw3k_tdma_stop();
+  config = c;
+  stats = {};
+  memset(slot_stats, 0, sizeof(slot_stats));
+  frame_new = false;
+  payload_size = -1;
+  missed = 0;
+  start_micros = micros();
+  lead_t32 = dw3k_tx_leadtime_t32();
+  setup_t32 = dw3k_micros_t32(setup_micros);
+
+  if (!config.coordinator) {
+    config.slots = 0;  // From the beacon
+    return search();
+  }
+
+  if (config.slots < 2 || config.slots > dw3k_tdma_max_slots ||
+      config.slot_micros <= 3 * config.guard_micros)
+    return fail("TDMA: Bad slot layout");
+
+  status = DW3KTdmaStatus::Running;
+  guard_t32 = dw3k_micros_t32(config.guard_micros);
+  slot_q16 = uint64_t(dw3k_micros_t32(config.slot_micros)) << 16;
+  dw3k_set_rx_timeout(config.slot_micros - 2 * config.guard_micros);
+  // The first superframe starts a millisecond from now
+  start_t32 = dw3k_clock_t32() + dw3k_micros_t32(1000) -
+      slots_t32(config.slots);
+  superframe = uint32_t(-1);
+  slot = config.slots - 1;
+  next_slot();
+}
+
+bool dw3k_tdma_send(void const* data, int size) {
+  if (payload_size >= 0 || size < 0 || size > dw3k_tdma_max_payload)
+    return false;
+  memcpy(payload, data, size);
+  payload_size = size;
+  return true;
+}
+
+DW3KTdmaStatus dw3k_tdma_poll() {
+  if (step == Step::Idle) return status;
+
+  auto const radio = dw3k_poll();
+  if (radio == DW3KStatus::ChipError || radio == DW3KStatus::CodeBug) {
+    step = Step::Idle;  // Nothing more to say to the chip
+    fail(dw3k_status_text());
+    return status;
+  }
+
+  switch (step) {
+    case Step::Search: poll_search(radio); break;
+    case Step::Transmit: poll_transmit(radio); break;
+    case Step::Receive: poll_receive(radio); break;
+    case Step::Idle: break;
+  }
+
+  stats.micros = micros() - start_micros;
+  if (status == DW3KTdmaStatus::Failed || !frame_new) return status;
+  frame_new = false;
+  return DW3KTdmaStatus::Received;
+}
+
+void dw3k_tdma_stop() {
+  if (step != Step::Idle) {
+    dw3k_end_txrx();
+    dw3k_set_rx_timeout(0);
+  }
+  step = Step::Idle;
+  if (status == DW3KTdmaStatus::Searching || status == DW3KTdmaStatus::Running)
+    status = DW3KTdmaStatus::Idle;
+}
+
+DW3KTdmaFrame const& dw3k_tdma_frame() { return frame; }
+
+DW3KTdmaStats dw3k_tdma_stats() {
+  auto s = stats;
+  s.tx_utilisation = s.tx_slots ? float(s.tx_frames) / s.tx_slots : 0.0f;
+  s.rx_utilisation = s.rx_slots ? float(s.rx_frames) / s.rx_slots : 0.0f;
+  return s;
+}
+
+DW3KTdmaSlotStats dw3k_tdma_slot_stats(int slot) {
+  if (slot < 0 || slot >= dw3k_tdma_max_slots) return {};
+  return slot_stats[slot];
+}
+
+char const* dw3k_tdma_status_text() {
+  switch (status) {
+#define S(s) case DW3KTdmaStatus::s: return #s;
+    S(Idle);
+    S(Searching);
+    S(Running);
+    S(Received);
+#undef S
+    case DW3KTdmaStatus::Failed: return error_text;
+  }
+  return "[BAD STATUS]";
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <stdint.h>
+
+// Time-division access for many nodes sharing the channel, run by
+// dw3k_tdma_poll() (which calls dw3k_poll()) without blocking. Each node
+// owns the radio until dw3k_tdma_stop().
+//
+// The coordinator divides time on its own clock into superframes of "slots"
+// equal slots and sends a beacon in slot 0 of each one. Nodes search for a
+// beacon, take the superframe start and layout from it, and from then on
+// only turn on for their own slots: a scheduled TX (dw3k_schedule_tx()) in
+// each TX slot, if dw3k_tdma_send() queued something, and a scheduled RX
+// window (dw3k_schedule_rx() plus RX_FWTO) in each RX slot and the beacon
+// slot. Each beacon also corrects the slot length for the clock offset, so
+// one beacon missed here and there doesn't matter.
+//
+//   | beacon | slot 1 | slot 2 | ...                  | beacon | slot 1 |
+//   |guard| frame ... |guard|guard|  (within a slot: RX window, next setup)
+//
+// A frame starts (preamble) a guard time into its slot, and RX windows open
+// at the slot start and close two guard times before the slot end, leaving
+// the last part of the slot to set up the next one. So a frame must last
+// at most slot_micros - 3 * guard_micros - 20us on the air.
+//
+// Frames in a slot its owner doesn't own are counted as misplaced, and
+// damaged frames in RX windows (dw3k_rx_errors(), mostly collisions) as
+// errors, both per slot (dw3k_tdma_slot_stats()).
+
+enum class DW3KTdmaStatus { Idle, Searching, Running, Received, Failed };
+
+struct DW3KTdmaConfig {
+  uint16_t address;        // Ours
+  bool coordinator;        // Sends the beacons; otherwise follows them
+  uint8_t slots;           // Coordinator: per superframe, slot 0 the beacon
+  uint32_t slot_micros;    // Coordinator
+  uint32_t guard_micros;   // Coordinator
+  uint64_t tx_slots;       // Bit per slot we send in (not slot 0)
+  uint64_t rx_slots;       // Bit per slot we listen in (not slot 0)
+};
+
+struct DW3KTdmaFrame {
+  uint16_t source;
+  uint8_t slot;
+  uint32_t superframe;  // The coordinator's count
+  uint64_t rx_t40;
+  int size;
+  uint8_t data[64];
+};
+
+struct DW3KTdmaStats {
+  uint32_t superframes;
+  uint32_t beacons_missed;  // Node: beacon windows without a beacon
+  uint32_t searches;        // Node: searches for the beacon (sync lost)
+  uint32_t tx_slots;        // Own TX slots passed
+  uint32_t tx_frames;       // ... that carried a frame
+  uint32_t rx_slots;        // RX windows opened (beacon windows included)
+  uint32_t rx_frames;       // ... that got a frame for their slot
+  uint32_t rx_errors;       // Damaged frames in RX windows
+  uint32_t misplaced;       // Good frames for another slot
+  uint32_t late;            // Slots skipped, set up too late (TX or RX)
+  uint32_t micros;          // Since the start
+  float tx_utilisation;     // tx_frames / tx_slots
+  float rx_utilisation;     // rx_frames / rx_slots
+};
+
+struct DW3KTdmaSlotStats {
+  uint32_t windows;  // RX windows opened
+  uint32_t frames;
+  uint32_t errors;
+  uint32_t misplaced;
+};
+
+static constexpr int dw3k_tdma_max_slots = 64;
+static constexpr int dw3k_tdma_max_payload = sizeof(DW3KTdmaFrame::data);
+static constexpr int dw3k_tdma_max_missed = 4;  // Beacons in a row, then search
+static constexpr uint32_t dw3k_tdma_slot_micros = 1000;  // Suggested
+static constexpr uint32_t dw3k_tdma_guard_micros = 100;  // Suggested
+
+void dw3k_tdma_start(DW3KTdmaConfig const&);
+bool dw3k_tdma_send(void const* data, int size);  // False if one is waiting
+DW3KTdmaStatus dw3k_tdma_poll();  // Received once per new dw3k_tdma_frame()
+void dw3k_tdma_stop();
+
+DW3KTdmaFrame const& dw3k_tdma_frame();
+DW3KTdmaStats dw3k_tdma_stats();
+DW3KTdmaSlotStats dw3k_tdma_slot_stats(int slot);
+char const* dw3k_tdma_status_text();
@@ -0,0 +1,259 @@
+#include "dw3k_tdoa.h"
+
+#include <Arduino.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "dw3k.h"
+#include "dw3k_drift.h"
+#include "dw3k_time.h"
+
+// Sync and blink frames; a blink stops before "interval_micros"
+struct __attribute__((packed)) TdoaFrame {
+  uint8_t type;  // 'S' (sync) or 'K' (blink)
+  uint16_t sequence;
+  uint16_t source;
+  uint32_t interval_micros;
+  uint64_t tx_t40;  // The sync's own TX timestamp
+};
+
+static constexpr int blink_size = offsetof(TdoaFrame, interval_micros);
+static constexpr double light_m_per_s = 299792458.0;
+
+enum class Step { Idle, Listen, SyncSent, Wait, BlinkSent };
+
+static DW3KTdoaStatus status = DW3KTdoaStatus::Idle;
+static Step step = Step::Idle;
+static char const* error_text = "[No error logged]";
+static DW3KTdoaConfig config = {};
+static DW3KTdoaStats stats = {};
+static DW3KTdoaBlink blink = {};
+static unsigned long start_micros, next_tx_micros;
+static uint16_t sequence;
+static uint32_t random_state;
+static uint32_t dropped_before;
+
+// Blinks not yet returned by dw3k_tdoa_poll(), oldest first
+static DW3KTdoaBlink pending[dw3k_tdoa_ring_size];
+static int pending_count = 0;
+
+// Anchor: when the last sync came (the clock model is in dw3k_drift)
+static bool synced;
+static uint64_t sync_local_t40;
+static uint32_t sync_interval_micros;
+
+static uint8_t ring_data[dw3k_tdoa_ring_size][sizeof(TdoaFrame)];
+static DW3KRxFrame ring[dw3k_tdoa_ring_size];
+
+static void fail(char const* text) {
+  status = DW3KTdoaStatus::Failed;
+  error_text = text;
+  if (step != Step::Idle) dw3k_end_txrx();
+  step = Step::Idle;
+}
+
+static void listen() {
+  for (int i = 0; i < dw3k_tdoa_ring_size; ++i) {
+    ring[i] = {ring_data[i], int(sizeof(ring_data[i])), 0, 0, 0.0f};
+  }
+  dw3k_start_rx_continuous(ring, dw3k_tdoa_ring_size);
+  step = Step::Listen;
+}
+
+// Sends a sync (stamped with its TX time) or blink as soon as the chip can
+static void send(TdoaFrame f, int size) {
+  uint32_t const sched_t32 = dw3k_clock_t32() + dw3k_tx_leadtime_t32();
+  if (f.type == 'S') f.tx_t40 = dw3k_tx_expected_t40(sched_t32);
+  dw3k_buffer_tx(&f, size);
+  dw3k_schedule_tx(sched_t32);
+}
+
+//
+// Reference and anchors
+//
+
+static void report(
+    TdoaFrame const& f, uint64_t rx_t40, uint64_t ref_t40, uint32_t age) {
+  ++stats.blinks;
+  if (pending_count == dw3k_tdoa_ring_size) return;  // Not polled for long
+  auto& b = pending[pending_count++];
+  b.tag = f.source;
+  b.sequence = f.sequence;
+  b.anchor = config.address;
+  b.rx_t40 = rx_t40;
+  b.ref_t40 = dw3k_t40(ref_t40).ticks;
+  b.sync_age_micros = age;
+  b.clock_offset = 0;
+  DW3KDriftPeer peer;
+  if (config.role == DW3KTdoaRole::Anchor &&
+      dw3k_drift_peer(config.reference, &peer))
+    b.clock_offset = peer.offset;
+}
+
+static void accept_sync(TdoaFrame const& f, DW3KRxFrame const& frame) {
+  if (f.source != config.reference || !f.interval_micros) return;
+
+  // The sync left at tx_t40 and took reference_m to get here
+  double const tof_t40 = config.reference_m / light_m_per_s * dw3k_time40_hz;
+  uint64_t const ref_t40 = (dw3k_t40(f.tx_t40) + int64_t(tof_t40 + 0.5)).ticks;
+  dw3k_drift_observe_offset(f.source, frame.rx_t40, frame.clock_offset);
+  dw3k_drift_observe_pair(f.source, frame.rx_t40, ref_t40);
+
+  synced = true;
+  sync_local_t40 = frame.rx_t40;
+  sync_interval_micros = f.interval_micros;
+  ++stats.syncs;
+}
+
+static void accept_blink(TdoaFrame const& f, uint64_t rx_t40) {
+  if (config.role == DW3KTdoaRole::Reference)
+    return report(f, rx_t40, rx_t40, 0);  // Our clock is the timebase
+
+  int64_t const age_t40 = dw3k_t40(rx_t40) - dw3k_t40(sync_local_t40);
+  int64_t const age_micros = dw3k_t40_ns(age_t40) / 1000;
+  uint64_t ref_t40;
+  if (!synced || age_micros < 0 ||
+      age_micros > int64_t(dw3k_tdoa_max_sync_age) * sync_interval_micros ||
+      !dw3k_drift_remote_t40(config.reference, rx_t40, &ref_t40)) {
+    ++stats.unsynced;
+    return;
+  }
+  report(f, rx_t40, ref_t40, uint32_t(age_micros));
+}
+
+static void poll_listen() {
+  while (auto const* frame = dw3k_rx_frame()) {
+    TdoaFrame f = {};
+    if (frame->size == blink_size || frame->size == int(sizeof(f))) {
+      memcpy(&f, frame->data, frame->size);
+      if (f.type == 'K' && frame->size == blink_size)
+        accept_blink(f, frame->rx_t40);
+      if (f.type == 'S' && frame->size == int(sizeof(f)) &&
+          config.role == DW3KTdoaRole::Anchor)
+        accept_sync(f, *frame);
+    }
+    dw3k_release_rx_frame();
+  }
+  stats.dropped = dw3k_rx_dropped() - dropped_before;
+
+  if (config.role != DW3KTdoaRole::Reference) return;
+  if (long(micros() - next_tx_micros) < 0) return;
+  next_tx_micros += config.interval_micros;
+  dw3k_end_txrx();
+  TdoaFrame const sync = {
+      'S', ++sequence, config.address, config.interval_micros, 0};
+  send(sync, sizeof(sync));
+  step = Step::SyncSent;
+}
+
+static void poll_sync_sent(DW3KStatus radio) {
+  if (radio != DW3KStatus::TransmitDone &&
+      radio != DW3KStatus::TransmitTooLate)
+    return;
+  if (radio == DW3KStatus::TransmitDone) ++stats.syncs;
+  dw3k_end_txrx();
+  listen();
+}
+
+//
+// Tag
+//
+
+static void poll_wait() {
+  if (long(micros() - next_tx_micros) < 0) return;
+
+  // Jitter of +-1/8 interval keeps tags that started together apart
+  random_state = random_state * 1664525 + 1013904223;
+  uint32_t const jitter = config.interval_micros / 4;
+  next_tx_micros += config.interval_micros - jitter / 2 +
+      (jitter ? (random_state >> 8) % jitter : 0);
+  TdoaFrame const f = {'K', ++sequence, config.address, 0, 0};
+  send(f, blink_size);
+  step = Step::BlinkSent;
+}
+
+static void poll_blink_sent(DW3KStatus radio) {
+  if (radio != DW3KStatus::TransmitDone &&
+      radio != DW3KStatus::TransmitTooLate)
+    return;
+  if (radio == DW3KStatus::TransmitDone) ++stats.blinks;
+  dw3k_end_txrx();
+  step = Step::Wait;
+}
+
+//
+// Common
+//
+
+void dw3k_tdoa_start(DW3KTdoaConfig const& c) {
+  dw3k_tdoa_stop();
+  config = c;
+  stats = {};
+  blink = {};
+  pending_count = 0;
+  synced = false;
+  if (config.role == DW3KTdoaRole::Anchor) dw3k_drift_forget(config.reference);
+  start_micros = next_tx_micros = micros();
+  random_state = config.address;
+  status = DW3KTdoaStatus::Running;
+  if (config.role == DW3KTdoaRole::Tag) {
+    step = Step::Wait;
+    return;
+  }
+  dropped_before = dw3k_rx_dropped();
+  listen();
+}
+
+DW3KTdoaStatus dw3k_tdoa_poll() {
+  if (step == Step::Idle) return status;
+
+  auto const radio = dw3k_poll();
+  if (radio == DW3KStatus::ChipError || radio == DW3KStatus::CodeBug) {
+    step = Step::Idle;  // Nothing more to say to the chip
+    fail(dw3k_status_text());
+    return status;
+  }
+
+  switch (step) {
+    case Step::Listen: poll_listen(); break;
+    case Step::SyncSent: poll_sync_sent(radio); break;
+    case Step::Wait: poll_wait(); break;
+    case Step::BlinkSent: poll_blink_sent(radio); break;
+    case Step::Idle: break;
+  }
+
+  stats.micros = micros() - start_micros;
+  if (status == DW3KTdoaStatus::Failed || !pending_count) return status;
+  blink = pending[0];
+  memmove(pending, pending + 1, --pending_count * sizeof(pending[0]));
+  return DW3KTdoaStatus::Blink;
+}
+
+void dw3k_tdoa_stop() {
+  if (step != Step::Idle) dw3k_end_txrx();
+  step = Step::Idle;
+  if (status == DW3KTdoaStatus::Running) status = DW3KTdoaStatus::Idle;
+}
+
+DW3KTdoaBlink const& dw3k_tdoa_blink() { return blink; }
+
+DW3KTdoaStats dw3k_tdoa_stats() {
+  auto s = stats;
+  s.rate = s.micros ? s.blinks * 1e6f / s.micros : 0.0f;
+  DW3KDriftPeer peer;
+  s.clock_offset = config.role == DW3KTdoaRole::Anchor &&
+      dw3k_drift_peer(config.reference, &peer) ? peer.offset : 0;
+  return s;
+}
+
+char const* dw3k_tdoa_status_text() {
+  switch (status) {
+#define S(s) case DW3KTdoaStatus::s: return #s;
+    S(Idle);
+    S(Running);
+    S(Blink);
+#undef S
+    case DW3KTdoaStatus::Failed: return error_text;
+  }
+  return "[BAD STATUS]";
+}
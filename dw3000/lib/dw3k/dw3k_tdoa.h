@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdint.h>
+
+// Time-difference-of-arrival positioning infrastructure, run by
+// dw3k_tdoa_poll() (which calls dw3k_poll()) without blocking. Every role
+// owns the radio until dw3k_tdoa_stop().
+//
+// The reference anchor sends a sync frame every interval_micros carrying its
+// own (scheduled, so known in advance) TX timestamp. Other anchors listen
+// continuously; each sync gives them a point where their clock and the
+// reference's are known to line up (less the time of flight over the known
+// reference_m); dw3k_drift filters those and the syncs' carrier offsets
+// into the anchor's model of the reference clock. Tags just send a short
+// blink per fix, and every anchor that hears it (the reference too) reports
+// its arrival in the reference's timebase, so differences between anchors
+// are TDOAs.
+//
+// Blinks too long after the last sync (dw3k_tdoa_max_sync_age intervals)
+// aren't reported, as the clocks may have drifted apart.
+
+enum class DW3KTdoaRole { Reference, Anchor, Tag };
+enum class DW3KTdoaStatus { Idle, Running, Blink, Failed };
+
+struct DW3KTdoaConfig {
+  uint16_t address;          // Ours
+  DW3KTdoaRole role;
+  uint32_t interval_micros;  // Reference: sync to sync; tag: blink to blink
+  uint16_t reference;        // Anchor: the reference anchor
+  float reference_m;         // Anchor: distance to the reference anchor
+};
+
+struct DW3KTdoaBlink {
+  uint16_t tag;
+  uint16_t sequence;         // The tag's fix number
+  uint16_t anchor;           // Us
+  uint64_t rx_t40;           // In our clock
+  uint64_t ref_t40;          // In the reference's clock (mod 2^40)
+  uint32_t sync_age_micros;  // Since the sync it was converted with
+  float clock_offset;        // Ours against the reference's (local - ref)
+};
+
+struct DW3KTdoaStats {
+  uint32_t syncs;     // Sent (reference) or used (anchor)
+  uint32_t blinks;    // Sent (tag) or reported (anchors)
+  uint32_t unsynced;  // Anchor: blinks heard without a recent sync
+  uint32_t dropped;   // Frames lost to a full RX ring (dw3k_rx_dropped())
+  uint32_t micros;    // Since the start
+  float rate;         // Blinks per second
+  float clock_offset;  // Anchor: latest estimate, as DW3KTdoaBlink
+};
+
+static constexpr int dw3k_tdoa_ring_size = 8;  // Frames
+static constexpr int dw3k_tdoa_max_sync_age = 4;  // Intervals
+static constexpr uint32_t dw3k_tdoa_sync_micros = 100000;  // Suggested
+
+void dw3k_tdoa_start(DW3KTdoaConfig const&);
+DW3KTdoaStatus dw3k_tdoa_poll();  // Blink once per new dw3k_tdoa_blink()
+void dw3k_tdoa_stop();
+
+DW3KTdoaBlink const& dw3k_tdoa_blink();
+DW3KTdoaStats dw3k_tdoa_stats();
+char const* dw3k_tdoa_status_text();
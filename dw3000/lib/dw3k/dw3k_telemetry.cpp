@@ -0,0 +1,72 @@
+#include "dw3k_telemetry.h"
+
+#include <Arduino.h>
+#include <string.h>
+
+static uint8_t ring[dw3k_telemetry_ring_size];
+static uint32_t head = 0, tail = 0;  // Written, drained (wrap as uint32_t)
+static uint32_t lost = 0, lost_unreported = 0;
+
+static uint8_t put(void const* data, int size, uint8_t sum) {
+  auto const* const bytes = static_cast<uint8_t const*>(data);
+  int const at = head % dw3k_telemetry_ring_size;
+  int const room = dw3k_telemetry_ring_size - at;
+  int const first = size < room ? size : room;
+  memcpy(ring + at, bytes, first);
+  memcpy(ring, bytes + first, size - first);
+  head += size;
+  for (int i = 0; i < size; ++i) sum += bytes[i];
+  return sum;
+}
+
+static bool append(DW3KTelemetryType type, void const* payload, int size) {
+  int const total = dw3k_telemetry_header_size + size + 1;
+  if (dw3k_telemetry_ring_size - int(head - tail) < total) return false;
+
+  struct __attribute__((packed)) {
+    uint8_t magic, size, type;
+    uint32_t micros;
+  } const header = {
+      dw3k_telemetry_magic, uint8_t(size), uint8_t(type), uint32_t(micros())};
+  static_assert(sizeof(header) == dw3k_telemetry_header_size);
+
+  put(&header, 1, 0);
+  uint8_t sum = put(&header.size, sizeof(header) - 1, 0);
+  sum = put(payload, size, sum);
+  put(&sum, 1, 0);
+  return true;
+}
+
+void dw3k_telemetry_log(DW3KTelemetryType type, void const* payload, int size) {
+  if (size > 255) size = 255;
+  if (lost_unreported) {
+    if (!append(DW3KTelemetryType::Lost, &lost_unreported, 4)) {
+      ++lost;
+      ++lost_unreported;
+      return;
+    }
+    lost_unreported = 0;
+  }
+  if (!append(type, payload, size)) {
+    ++lost;
+    ++lost_unreported;
+  }
+}
+
+void dw3k_telemetry_text(char const* text) {
+  dw3k_telemetry_log(DW3KTelemetryType::Text, text, strlen(text));
+}
+
+void dw3k_telemetry_drain() {
+  while (head != tail) {
+    int const at = tail % dw3k_telemetry_ring_size;
+    int size = dw3k_telemetry_ring_size - at;  // Up to the wrap
+    if (int(head - tail) < size) size = head - tail;
+    int const writable = Serial.availableForWrite();
+    if (writable < size) size = writable;
+    if (size <= 0) return;
+    tail += Serial.write(ring + at, size);
+  }
+}
+
+uint32_t dw3k_telemetry_lost() { return lost; }
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "dw3k.h"
+
+// Compact binary telemetry: typed records appended to a RAM ring (a
+// memcpy or two, no formatting) and drained to Serial by
+// dw3k_telemetry_drain() only as fast as it takes them without blocking,
+// for logging that can stay on at full ranging rates. If the ring fills up,
+// records are dropped and a Lost record says how many.
+// host/dw3k_telemetry decodes (and records) the stream.
+//
+// Build with -DDW3K_TELEMETRY=1 to have dw3k_wait_verbose() and the test
+// apps log records instead of printing text. Not for use from interrupts.
+//
+// On the wire (little-endian), each record is
+//
+//   magic  size  type  micros (4)  payload (size)  check
+//
+// where "check" is the low byte of the sum of everything from "size" on;
+// the decoder finds records by magic and check, so stray text (e.g. from
+// setup()) in between does no harm.
+
+static constexpr uint8_t dw3k_telemetry_magic = 0xD3;
+static constexpr int dw3k_telemetry_header_size = 7;  // Before payload
+static constexpr int dw3k_telemetry_ring_size = 4096;
+
+enum class DW3KTelemetryType : uint8_t {
+  Status = 1,  // DW3KTelemetryStatus
+  Timestamp,   // DW3KTelemetryTimestamp (e.g. test_pong)
+  Range,       // DW3KTelemetryRange
+  Counters,    // uint16_t each, as dw3k_evc_names
+  Text,        // Characters (no terminator)
+  Lost,        // uint32_t records dropped just before this one
+};
+
+struct __attribute__((packed)) DW3KTelemetryStatus {
+  uint8_t status;  // DW3KStatus
+  uint64_t sys_status;
+  uint32_t sys_state;
+};
+
+struct __attribute__((packed)) DW3KTelemetryTimestamp {
+  uint8_t kind;  // 'T' (TX) or 'R' (RX)
+  uint64_t t40;
+};
+
+struct __attribute__((packed)) DW3KTelemetryRange {
+  uint16_t address;  // Ours
+  uint16_t peer;
+  uint32_t sequence;
+  float distance_m;
+  float quality;
+  float clock_offset;
+};
+
+void dw3k_telemetry_log(DW3KTelemetryType, void const* payload, int size);
+void dw3k_telemetry_text(char const* text);
+void dw3k_telemetry_drain();  // Call often, e.g. from loop()
+uint32_t dw3k_telemetry_lost();  // Records dropped so far
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <stdint.h>
+
+// Integer arithmetic on the chip's timebase, for scheduling without
+// (soft-float) doubles, cheap enough for interrupt handlers. "t40" counts
+// dw3k_time40_hz ticks (~15.65ps; timestamps) and "t32" dw3k_time32_hz
+// ticks (~4.006ns, t40 >> 8; SYS_TIME, DX_TIME); both wrap every ~17.2s.
+// Differences are taken modulo the counter, so spans under half a wrap
+// (~8.6s) come out right, with sign, either side of it.
+
+static constexpr uint64_t dw3k_t40_mask = (uint64_t(1) << 40) - 1;
+
+// A reading of a "Bits"-wide counter, held in T, with signed Span between
+template <typename T, typename Span, int Bits>
+struct DW3KTime {
+  static constexpr int shift = 8 * sizeof(T) - Bits;
+  static constexpr T mask = T(~T(0)) >> shift;
+
+  T ticks;
+
+  constexpr DW3KTime operator+(Span s) const { return {T(ticks + s) & mask}; }
+  constexpr DW3KTime operator-(Span s) const { return {T(ticks - s) & mask}; }
+
+  // Signed span from "from" to this, the short way round the wrap
+  constexpr Span operator-(DW3KTime from) const {
+    return Span(T(T(ticks - from.ticks) << shift)) >> shift;
+  }
+
+  constexpr bool before(DW3KTime other) const { return *this - other < 0; }
+};
+
+using DW3KTime32 = DW3KTime<uint32_t, int32_t, 32>;
+using DW3KTime40 = DW3KTime<uint64_t, int64_t, 40>;
+
+constexpr DW3KTime32 dw3k_t32(uint32_t t32) { return {t32}; }
+constexpr DW3KTime40 dw3k_t40(uint64_t t40) { return {t40 & dw3k_t40_mask}; }
+constexpr DW3KTime40 dw3k_t40(DW3KTime32 t) { return {uint64_t(t.ticks) << 8}; }
+constexpr DW3KTime32 dw3k_t32(DW3KTime40 t) { return {uint32_t(t.ticks >> 8)}; }
+
+// Extends wrapping t40 readings to a 64-bit count that doesn't wrap (for
+// ~9 years), given readings in order under ~8.6s apart
+struct DW3KTimeline {
+  uint64_t t64;
+  bool started;
+};
+
+constexpr uint64_t dw3k_timeline_t64(DW3KTimeline* line, uint64_t t40) {
+  if (!line->started) {
+    *line = {t40 & dw3k_t40_mask, true};
+  } else {
+    line->t64 += dw3k_t40(t40) - dw3k_t40(line->t64);
+  }
+  return line->t64;
+}
+
+// x * num / den (rounding toward zero) without overflowing the product
+constexpr int64_t dw3k_time_scale(int64_t x, int64_t num, int64_t den) {
+  return x / den * num + x % den * num / den;
+}
+
+// Conversions of spans: dw3k_time40_hz is 63,897,600,000 = 2^14 * 39 * 10^5
+// ticks per second, dw3k_time32_hz 249,600,000, so the ratios are exact
+constexpr int64_t dw3k_t40_ps(int64_t t40) {
+  return dw3k_time_scale(t40, 78125, 4992);
+}
+
+constexpr int64_t dw3k_ps_t40(int64_t ps) {
+  return dw3k_time_scale(ps, 4992, 78125);
+}
+
+constexpr int64_t dw3k_t40_ns(int64_t t40) {
+  return dw3k_time_scale(t40, 625, 39936);
+}
+
+constexpr int64_t dw3k_ns_t40(int64_t ns) {
+  return dw3k_time_scale(ns, 39936, 625);
+}
+
+constexpr int64_t dw3k_t32_ns(int64_t t32) {
+  return dw3k_time_scale(t32, 625, 156);
+}
+
+constexpr int64_t dw3k_ns_t32(int64_t ns) {
+  return dw3k_time_scale(ns, 156, 625);
+}
+
+// Delays in microseconds (up to ~23 minutes), in 32-bit operations only
+constexpr uint32_t dw3k_micros_t32(uint32_t micros) {
+  return micros * 249u + micros * 3u / 5u;  // * 249.6
+}
+
+constexpr uint32_t dw3k_t32_micros(uint32_t t32) {
+  return uint32_t(uint64_t(t32) * 5 / 1248);
+}
+
+static_assert(dw3k_micros_t32(1000000) == 249600000);
+static_assert(dw3k_t32_micros(249600000) == 1000000);
+static_assert(dw3k_t40_ns(63897600000) == 1000000000);
+static_assert(dw3k_ps_t40(1000000000000) == 63897600000);
+static_assert(dw3k_ns_t32(1000000000) == 249600000);
+static_assert(dw3k_t40(0x10) - dw3k_t40(dw3k_t40_mask) == 0x11);
+static_assert(dw3k_t32(5) - dw3k_t32(0xFFFFFFFB) == 10);
+static_assert(dw3k_t32(0xFFFFFFFB).before(dw3k_t32(5)));
+static_assert((dw3k_t40(dw3k_t40_mask) + 1).ticks == 0);
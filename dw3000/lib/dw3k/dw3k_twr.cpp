@@ -0,0 +1,463 @@
+#include "dw3k_twr.h"
+
+#include <Arduino.h>
+#include <math.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "dw3k.h"
+#include "dw3k_time.h"
+
+// Poll and Response frames; a unicast Poll stops before "a", and a Final is
+// the first part followed by a TwrEntry per responder
+struct __attribute__((packed)) TwrFrame {
+  uint8_t type;      // 'P' (Poll), 'R' (Response) or 'F' (Final)
+  uint8_t sequence;  // Exchange; in a Response, the exchange reported
+  uint16_t source;
+  uint16_t dest;
+  uint32_t a;  // Response: reply1 (0 for no report); broadcast Poll: slots
+  uint32_t b;  // Response: round2; broadcast Poll: slot_micros
+};
+
+struct __attribute__((packed)) TwrEntry {
+  uint16_t address;
+  uint32_t round1;
+  uint32_t reply2;
+};
+
+static constexpr int header_size = offsetof(TwrFrame, a);
+static constexpr int max_final_size =
+    header_size + dw3k_twr_max_slots * sizeof(TwrEntry);
+static constexpr double light_m_per_s = 299792458.0;
+
+enum class Step {
+  Idle, Wait, PollSent, Collect, FinalSent, Listen, ResponseSent
+};
+
+static DW3KTwrStatus status = DW3KTwrStatus::Idle;
+static Step step = Step::Idle;
+static char const* error_text = "[No error logged]";
+static DW3KTwrConfig config = {};
+static DW3KTwrStats stats = {};
+static DW3KTwrResult result = {};
+static unsigned long start_micros;
+static uint32_t reply_t32;
+
+// Results not yet returned by dw3k_twr_poll(), oldest first
+static DW3KTwrResult pending[dw3k_twr_max_slots];
+static int pending_count = 0;
+
+// The exchange in progress (timestamps in our clock)
+static uint8_t sequence;
+static uint16_t peer;  // Responder: the initiator
+static uint64_t poll_t40, response_t40, final_t40;
+
+// Initiator: the Responses of this exchange, then (once the Final is out)
+// of the last completed one, until the next Responses report on them
+struct Heard {
+  uint16_t address;  // dw3k_twr_broadcast once reported
+  uint64_t response_t40;
+  uint32_t round1, reply2;
+};
+
+static Heard heard[dw3k_twr_max_slots];
+static int heard_count;
+static Heard reported[dw3k_twr_max_slots];
+static int reported_count = 0;
+static uint8_t reported_sequence;
+static uint64_t reported_poll_t40, reported_final_t40;
+static uint32_t poll_sched_t32;
+static unsigned long next_poll_micros, collect_end_micros;
+
+// Broadcast initiator RX ring (the chip's two RX buffers add two more)
+static uint8_t ring_data[dw3k_twr_max_slots][sizeof(TwrFrame)];
+static DW3KRxFrame ring[dw3k_twr_max_slots];
+
+// Responder: the next Response, with the report for its "dest", which is
+// written to the TX buffer while listening so that only the send is left
+static TwrFrame response = {};
+static bool response_buffered = false;
+
+static void fail(char const* text) {
+  status = DW3KTwrStatus::Failed;
+  error_text = text;
+  if (step != Step::Idle) dw3k_end_txrx();
+  step = Step::Idle;
+}
+
+static bool broadcast() { return config.peer == dw3k_twr_broadcast; }
+
+static uint32_t interval_t40(uint64_t from_t40, uint64_t to_t40) {
+  return uint32_t(to_t40 - from_t40);  // Fine across the 40-bit wrap
+}
+
+static void complete(
+    uint16_t with, uint8_t exchange, uint64_t const (&t40)[3],
+    uint32_t round1, uint32_t reply1, uint32_t round2, uint32_t reply2,
+    float carrier_offset, bool initiator) {
+  if (pending_count == dw3k_twr_max_slots) return;  // Not polled for long
+  auto& r = pending[pending_count++];
+  double const r1 = round1, d1 = reply1, r2 = round2, d2 = reply2;
+  double const tof_t40 = (r1 * r2 - d1 * d2) / (r1 + r2 + d1 + d2);
+
+  // Poll to Final is the same time span on both clocks
+  double const initiator_span = r1 + d2, responder_span = d1 + r2;
+  double const ratio = initiator ?
+      initiator_span / responder_span : responder_span / initiator_span;
+
+  r.peer = with;
+  r.sequence = exchange;
+  r.distance_m = tof_t40 / dw3k_time40_hz * light_m_per_s;
+  r.clock_offset = ratio - 1;
+  r.carrier_offset = carrier_offset;
+  float const disagree = fabsf(r.clock_offset - carrier_offset) * 1e6f;
+  r.quality = disagree < 1 ? 1 - disagree : 0;
+  if (r.distance_m < -1) r.quality = 0;  // Garbled timestamps
+  r.poll_t40 = t40[0];
+  r.response_t40 = t40[1];
+  r.final_t40 = t40[2];
+  r.round1_t40 = round1;
+  r.reply1_t40 = reply1;
+  r.round2_t40 = round2;
+  r.reply2_t40 = reply2;
+  ++stats.ranges;
+}
+
+// After a reply the other end's receiver opens (W4R_TIM) once the slots
+// after its own are over plus half the reply delay, and the wait gives up
+// (RX_FWTO) a reply delay and slot past the end of the slots, or a reply
+// delay after opening for one responder; zero "timeout" just listens
+static void set_reply_rx(uint32_t after_micros, uint32_t timeout_micros) {
+  dw3k_set_rx_after_tx(after_micros + config.reply_micros / 2);
+  dw3k_set_rx_timeout(timeout_micros);
+}
+
+static void start(DW3KTwrConfig const& c) {
+  dw3k_twr_stop();
+  config = c;
+  stats = {};
+  result = {};
+  pending_count = 0;
+  start_micros = micros();
+  reply_t32 = dw3k_micros_t32(config.reply_micros);
+  status = DW3KTwrStatus::Ranging;
+}
+
+//
+// Initiator
+//
+
+static void send_poll() {
+  ++sequence;
+  ++stats.attempts;
+  heard_count = 0;
+  next_poll_micros = micros() + config.interval_micros;
+
+  TwrFrame const poll = {
+      'P', sequence, config.address, config.peer, config.slots,
+      config.slot_micros};
+  dw3k_buffer_tx(&poll, broadcast() ? sizeof(poll) : header_size);
+  auto const lead_t32 = dw3k_tx_leadtime_t32();
+  poll_sched_t32 = dw3k_clock_t32() + lead_t32;
+  poll_t40 = dw3k_tx_expected_t40(poll_sched_t32);
+  // Broadcast: listen continuously from TransmitDone, until the slots end
+  collect_end_micros = micros() + dw3k_t32_micros(lead_t32) +
+      config.reply_micros * 5 / 4 + config.slots * config.slot_micros;
+  dw3k_schedule_tx(poll_sched_t32, !broadcast());
+  step = Step::PollSent;
+}
+
+static void retry_later() {
+  dw3k_end_txrx();
+  step = Step::Wait;
+}
+
+static void accept_response(
+    TwrFrame const& r, uint64_t rx_t40, float carrier_offset) {
+  if (r.type != 'R' || r.dest != config.address) return;
+  if (!broadcast() && r.source != config.peer) return;
+  for (int i = 0; i < heard_count; ++i) {
+    if (heard[i].address == r.source) return;  // Twice?
+  }
+  if (heard_count == dw3k_twr_max_slots) return;
+
+  // The Response reports on the previous exchange
+  for (int i = 0; i < reported_count; ++i) {
+    auto& p = reported[i];
+    if (p.address != r.source || !r.a || r.sequence != reported_sequence)
+      continue;
+    uint64_t const t40[3] = {
+        reported_poll_t40, p.response_t40, reported_final_t40};
+    complete(
+        r.source, reported_sequence, t40, p.round1, r.a, r.b, p.reply2,
+        carrier_offset, true);
+    p.address = dw3k_twr_broadcast;
+  }
+
+  heard[heard_count++] = {r.source, rx_t40, interval_t40(poll_t40, rx_t40), 0};
+}
+
+static void send_final(uint32_t sched_t32) {
+  final_t40 = dw3k_tx_expected_t40(sched_t32);
+  uint8_t frame[max_final_size];
+  TwrFrame const header = {
+      'F', sequence, config.address, config.peer, 0, 0};
+  memcpy(frame, &header, header_size);
+  auto* const entries = frame + header_size;
+  for (int i = 0; i < heard_count; ++i) {
+    heard[i].reply2 = interval_t40(heard[i].response_t40, final_t40);
+    TwrEntry const entry = {heard[i].address, heard[i].round1, heard[i].reply2};
+    memcpy(entries + i * sizeof(entry), &entry, sizeof(entry));
+  }
+  dw3k_buffer_tx(frame, header_size + heard_count * sizeof(TwrEntry));
+  dw3k_schedule_tx(sched_t32);
+  step = Step::FinalSent;
+}
+
+static void poll_response(DW3KStatus radio) {
+  if (radio == DW3KStatus::TransmitTooLate) return ++stats.late, retry_later();
+  if (radio == DW3KStatus::ReceiveTimeout)
+    return ++stats.timeouts, retry_later();
+
+  if (broadcast()) {
+    if (radio != DW3KStatus::TransmitDone) return;
+    dw3k_end_txrx();
+    for (int i = 0; i < dw3k_twr_max_slots; ++i) {
+      ring[i] = {ring_data[i], int(sizeof(ring_data[i])), 0, 0, 0.0f};
+    }
+    dw3k_start_rx_continuous(ring, dw3k_twr_max_slots);
+    step = Step::Collect;
+    return;
+  }
+
+  if (radio != DW3KStatus::ReceiveDone) return;
+  TwrFrame r = {};
+  bool const sized = dw3k_rx_size() == sizeof(r);
+  if (sized) dw3k_retrieve_rx(0, sizeof(r), &r);
+  uint64_t const rx_t40 = sized ? dw3k_rx_timestamp_t40() : 0;
+  float const carrier_offset = sized ? dw3k_rx_clock_offset() : 0;
+  if (sized) accept_response(r, rx_t40, carrier_offset);
+  dw3k_end_txrx();
+  if (!heard_count) {
+    dw3k_start_rx();  // Not ours, keep listening (RX_FWTO starts over)
+    return;
+  }
+
+  // Final, a fixed time after the Response arrived
+  send_final(uint32_t(rx_t40 >> 8) + reply_t32);
+}
+
+static void poll_collect() {
+  while (auto const* frame = dw3k_rx_frame()) {
+    TwrFrame r;
+    if (frame->size == sizeof(r)) {
+      memcpy(&r, frame->data, sizeof(r));
+      accept_response(r, frame->rx_t40, frame->clock_offset);
+    }
+    dw3k_release_rx_frame();
+  }
+
+  bool const over = long(micros() - collect_end_micros) >= 0;
+  if (heard_count < config.slots && !over) return;
+  dw3k_end_txrx();
+  stats.timeouts += config.slots - heard_count;
+  if (!heard_count) return retry_later();
+
+  // Final, a reply delay after the last slot
+  send_final(
+      poll_sched_t32 + 2 * reply_t32 +
+      config.slots * dw3k_micros_t32(config.slot_micros));
+}
+
+static void poll_final_sent(DW3KStatus radio) {
+  if (radio == DW3KStatus::TransmitTooLate) return ++stats.late, retry_later();
+  if (radio != DW3KStatus::TransmitDone) return;
+  memcpy(reported, heard, heard_count * sizeof(Heard));
+  reported_count = heard_count;
+  reported_sequence = sequence;
+  reported_poll_t40 = poll_t40;
+  reported_final_t40 = final_t40;
+  retry_later();
+}
+
+void dw3k_twr_initiate(DW3KTwrConfig const& c) {
+  start(c);
+  if (broadcast() && (c.slots < 1 || c.slots > dw3k_twr_max_slots))
+    return fail("TWR: Bad slot count");
+  reported_count = 0;
+  // Broadcast collects with continuous RX, which has no timeout
+  set_reply_rx(0, broadcast() ? 0 : config.reply_micros);
+  // Number exchanges from a random-ish start so that a responder's report
+  // from before we restarted isn't taken for one of ours
+  sequence = micros();
+  send_poll();
+}
+
+//
+// Responder
+//
+
+static void listen() {
+  if (!response_buffered) {
+    dw3k_buffer_tx(&response, sizeof(response));
+    response_buffered = true;
+  }
+  dw3k_set_rx_timeout(0);
+  dw3k_start_rx();
+  step = Step::Listen;
+}
+
+static void poll_listen(DW3KStatus radio) {
+  if (radio != DW3KStatus::ReceiveDone) return;
+
+  TwrFrame p = {};
+  int const size = dw3k_rx_size();
+  bool const sized = size == header_size || size == int(sizeof(p));
+  if (sized) dw3k_retrieve_rx(0, size, &p);
+  bool const to_all =
+      size == int(sizeof(p)) && p.dest == dw3k_twr_broadcast;
+  bool const ours = sized && p.type == 'P' &&
+      ((size == header_size && p.dest == config.address) ||
+       (to_all && config.slot < p.a && p.a <= dw3k_twr_max_slots));
+  if (!ours) {
+    dw3k_end_txrx();
+    return listen();
+  }
+
+  poll_t40 = dw3k_rx_timestamp_t40();
+  dw3k_end_txrx();
+  if (p.source != response.dest) {  // New initiator, nothing to report
+    response = {'R', 0, config.address, p.source, 0, 0};
+    dw3k_buffer_tx(&response, sizeof(response));
+  }
+
+  // Response, a fixed time (plus our slot) after the Poll arrived
+  int const later_slots = to_all ? p.a - config.slot - 1 : 0;
+  uint32_t const slot_micros = to_all ? p.b : 0;
+  uint32_t const sched_t32 = uint32_t(poll_t40 >> 8) + reply_t32 +
+      (to_all ? config.slot * dw3k_micros_t32(slot_micros) : 0);
+  response_t40 = dw3k_tx_expected_t40(sched_t32);
+  set_reply_rx(
+      later_slots * slot_micros,
+      config.reply_micros + (to_all ? config.reply_micros + slot_micros : 0));
+  dw3k_schedule_tx(sched_t32, true);  // Then wait for the Final
+  sequence = p.sequence;
+  peer = p.source;
+  ++stats.attempts;
+  step = Step::ResponseSent;
+}
+
+static void poll_response_sent(DW3KStatus radio) {
+  if (radio == DW3KStatus::TransmitTooLate) ++stats.late;
+  if (radio == DW3KStatus::ReceiveTimeout) ++stats.timeouts;
+  if (radio == DW3KStatus::TransmitTooLate ||
+      radio == DW3KStatus::ReceiveTimeout) {
+    dw3k_end_txrx();
+    return listen();
+  }
+  if (radio != DW3KStatus::ReceiveDone) return;
+
+  uint8_t frame[max_final_size];
+  TwrFrame f = {};
+  int const size = dw3k_rx_size();
+  int const count = (size - header_size) / int(sizeof(TwrEntry));
+  bool const sized = size > header_size && size <= max_final_size &&
+      header_size + count * int(sizeof(TwrEntry)) == size;
+  if (sized) {
+    dw3k_retrieve_rx(0, size, frame);
+    memcpy(&f, frame, header_size);
+  }
+  if (!sized || f.type != 'F' || f.source != peer || f.sequence != sequence) {
+    dw3k_end_txrx();  // Maybe another slot's Response, keep listening
+    dw3k_start_rx();
+    return;
+  }
+
+  TwrEntry entry = {};
+  for (int i = 0; i < count && entry.address != config.address; ++i) {
+    memcpy(&entry, frame + header_size + i * sizeof(entry), sizeof(entry));
+  }
+  if (entry.address == config.address) {
+    final_t40 = dw3k_rx_timestamp_t40();
+    float const carrier_offset = dw3k_rx_clock_offset();
+    uint32_t const reply1 = interval_t40(poll_t40, response_t40);
+    uint32_t const round2 = interval_t40(response_t40, final_t40);
+    uint64_t const t40[3] = {poll_t40, response_t40, final_t40};
+    complete(
+        peer, sequence, t40, entry.round1, reply1, round2, entry.reply2,
+        carrier_offset, false);
+    response = {'R', sequence, config.address, peer, reply1, round2};
+    response_buffered = false;
+  }
+  dw3k_end_txrx();
+  listen();
+}
+
+void dw3k_twr_respond(DW3KTwrConfig const& c) {
+  start(c);
+  response = {'R', 0, config.address, dw3k_twr_broadcast, 0, 0};
+  response_buffered = false;
+  listen();
+}
+
+//
+// Common
+//
+
+DW3KTwrStatus dw3k_twr_poll() {
+  if (step == Step::Idle) return status;
+
+  auto const radio = dw3k_poll();
+  if (radio == DW3KStatus::ChipError || radio == DW3KStatus::CodeBug) {
+    step = Step::Idle;  // Nothing more to say to the chip
+    fail(dw3k_status_text());
+    return status;
+  }
+
+  switch (step) {
+    case Step::Wait:
+      if (long(micros() - next_poll_micros) >= 0) send_poll();
+      break;
+    case Step::PollSent: poll_response(radio); break;
+    case Step::Collect: poll_collect(); break;
+    case Step::FinalSent: poll_final_sent(radio); break;
+    case Step::Listen: poll_listen(radio); break;
+    case Step::ResponseSent: poll_response_sent(radio); break;
+    case Step::Idle: break;
+  }
+
+  stats.micros = micros() - start_micros;
+  if (status == DW3KTwrStatus::Failed || !pending_count) return status;
+  result = pending[0];
+  memmove(pending, pending + 1, --pending_count * sizeof(pending[0]));
+  return DW3KTwrStatus::Result;
+}
+
+void dw3k_twr_stop() {
+  if (step != Step::Idle) {
+    dw3k_end_txrx();
+    dw3k_set_rx_timeout(0);
+  }
+  step = Step::Idle;
+  if (status == DW3KTwrStatus::Ranging) status = DW3KTwrStatus::Idle;
+}
+
+DW3KTwrResult const& dw3k_twr_result() { return result; }
+
+DW3KTwrStats dw3k_twr_stats() {
+  auto s = stats;
+  s.rate = s.micros ? s.ranges * 1e6f / s.micros : 0.0f;
+  return s;
+}
+
+char const* dw3k_twr_status_text() {
+  switch (status) {
+#define S(s) case DW3KTwrStatus::s: return #s;
+    S(Idle);
+    S(Ranging);
+    S(Result);
+#undef S
+    case DW3KTwrStatus::Failed: return error_text;
+  }
+  return "[BAD STATUS]";
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stdint.h>
+
+// Double-sided two-way ranging (DS-TWR) between an initiator and a
+// responder, run by dw3k_twr_poll() (which calls dw3k_poll()) without
+// blocking. Both ends own the radio until dw3k_twr_stop().
+//
+// Each exchange is Poll (initiator), Response, Final (initiator). Every reply
+// is scheduled reply_micros after the frame it answers arrived, and the
+// other end's receiver opens by itself (DTX_W4R) and times out (RX_FWTO), so
+// the exchange needs no clock reads and has a fixed length. The Final
+// carries the initiator's intervals, so the responder has a result at once;
+// the next Response carries the responder's intervals back, giving the
+// initiator the same result one exchange later.
+//
+//   Poll TX ---- round1 ---- Response RX -- reply2 -- Final TX  (initiator)
+//   Poll RX -- reply1 -- Response TX ---- round2 ---- Final RX  (responder)
+//
+//   time of flight = (round1 * round2 - reply1 * reply2) /
+//                    (round1 + round2 + reply1 + reply2)
+//
+// With peer dw3k_twr_broadcast the initiator ranges with up to
+// dw3k_twr_max_slots responders at once: its Poll names the slot count and
+// width, each responder answers in its own slot after the reply delay, the
+// initiator collects the Responses in one continuous RX window, and a single
+// Final carries everyone's intervals. An exchange then takes about as long
+// as one with a single responder plus a slot per responder, and
+// dw3k_twr_poll() returns Result once per responder.
+
+enum class DW3KTwrStatus { Idle, Ranging, Result, Failed };
+
+struct DW3KTwrConfig {
+  uint16_t address;          // Ours
+  uint16_t peer;             // Initiator: responder, or dw3k_twr_broadcast
+  uint32_t reply_micros;     // Reply delay, the same at both ends
+  uint32_t interval_micros;  // Initiator: Poll to Poll, 0 for back to back
+  uint8_t slots;             // Broadcast initiator: responders polled
+  uint8_t slot;              // Responder: its turn answering a broadcast
+  uint32_t slot_micros;      // Broadcast initiator: spacing of the answers
+};
+
+struct DW3KTwrResult {
+  uint16_t peer;
+  uint8_t sequence;    // Exchange number, from the initiator
+  float distance_m;
+  float quality;       // 1 if the clock offsets below agree, 0 by 1ppm apart
+  float clock_offset;  // From the exchange timing, as dw3k_rx_clock_offset()
+  float carrier_offset;  // dw3k_rx_clock_offset() of the peer's last frame
+  uint64_t poll_t40;     // Our timestamps (TX or RX, by role)
+  uint64_t response_t40;
+  uint64_t final_t40;
+  uint32_t round1_t40, reply1_t40, round2_t40, reply2_t40;
+};
+
+struct DW3KTwrStats {
+  uint32_t ranges;    // Results
+  uint32_t attempts;  // Polls sent (initiator) or answered (responder)
+  uint32_t timeouts;  // Response or Final never came
+  uint32_t late;      // Replies that missed their slot (TransmitTooLate)
+  uint32_t micros;    // Since the start
+  float rate;         // Results per second
+};
+
+static constexpr uint16_t dw3k_twr_broadcast = 0xFFFF;
+static constexpr int dw3k_twr_max_slots = 8;
+static constexpr uint32_t dw3k_twr_reply_micros = 1000;  // Suggested
+static constexpr uint32_t dw3k_twr_slot_micros = 500;    // Suggested
+
+void dw3k_twr_initiate(DW3KTwrConfig const&);
+void dw3k_twr_respond(DW3KTwrConfig const&);
+DW3KTwrStatus dw3k_twr_poll();  // Result once per new dw3k_twr_result()
+void dw3k_twr_stop();
+
+DW3KTwrResult const& dw3k_twr_result();
+DW3KTwrStats dw3k_twr_stats();
+char const* dw3k_twr_status_text();
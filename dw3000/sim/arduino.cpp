@@ -0,0 +1,69 @@
+// Host implementation of the Arduino shims in arduino/, backed by the
+// simulated chip. Runs setup() and then loop() DW3K_SIM_LOOPS times (default
+// forever), and prints SPI usage on exit (including Ctrl-C or kill).
+
+#include <Arduino.h>
+#include <SPI.h>
+#include <avr/dtostrf.h>
+
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "dw3k_sim.h"
+
+HostSerial Serial;
+SPIClass SPI;
+
+int HostSerial::available() {
+  pollfd p = {0, POLLIN, 0};
+  return poll(&p, 1, 0) > 0 && (p.revents & POLLIN);
+}
+
+int HostSerial::read() { return getchar(); }
+
+static double const start_ns = dw3k_sim_now_ns();
+
+unsigned long millis() { return (dw3k_sim_now_ns() - start_ns) * 1e-6; }
+unsigned long micros() { return (dw3k_sim_now_ns() - start_ns) * 1e-3; }
+
+static void sleep_ns(double ns) {
+  timespec const t = {time_t(ns * 1e-9), long(fmod(ns, 1e9))};
+  nanosleep(&t, nullptr);
+}
+
+void delay(unsigned long ms) { sleep_ns(ms * 1e6); }
+void delayMicroseconds(unsigned int us) { sleep_ns(us * 1e3); }
+
+void pinMode(int pin, int mode) { dw3k_sim_pin_mode(pin, mode); }
+void digitalWrite(int pin, int value) { dw3k_sim_pin_write(pin, value); }
+int digitalRead(int pin) { return dw3k_sim_pin_read(pin); }
+
+void attachInterrupt(int, void (*)(), int) {}
+void detachInterrupt(int) {}
+
+uint8_t SPIClass::transfer(uint8_t data) { return dw3k_sim_spi_byte(data); }
+
+void SPIClass::transfer(void* buf, size_t count) {
+  auto* const bytes = static_cast<uint8_t*>(buf);
+  for (size_t i = 0; i < count; ++i) bytes[i] = dw3k_sim_spi_byte(bytes[i]);
+}
+
+char* dtostrf(double val, signed char width, unsigned char prec, char* out) {
+  sprintf(out, "%*.*f", width, prec, val);
+  return out;
+}
+
+int main() {
+  setvbuf(stdout, nullptr, _IOLBF, 0);
+  atexit(dw3k_sim_report);
+  signal(SIGINT, [](int) { exit(0); });
+  signal(SIGTERM, [](int) { exit(0); });
+
+  char const* const loops_env = getenv("DW3K_SIM_LOOPS");
+  long const loops = loops_env ? atol(loops_env) : 0;
+  setup();
+  for (long i = 0; !loops || i < loops; ++i) loop();
+  return 0;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+// Minimal host stand-in for the Arduino core, enough to build the dw3k
+// library and test apps against the simulated chip (see ../dw3k_sim.h).
+
+#include <ctype.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pins_arduino.h"
+
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+
+#define LOW 0x0
+#define HIGH 0x1
+
+#define CHANGE 0x2
+#define FALLING 0x3
+#define RISING 0x4
+
+#define MSBFIRST 1
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+void pinMode(int pin, int mode);
+void digitalWrite(int pin, int value);
+int digitalRead(int pin);
+
+inline int digitalPinToInterrupt(int pin) { return pin; }
+void attachInterrupt(int interrupt, void (*isr)(), int mode);
+void detachInterrupt(int interrupt);
+inline void interrupts() {}
+inline void noInterrupts() {}
+
+inline bool isPrintable(int c) { return isprint(c); }
+
+class HostSerial {
+ public:
+  void begin(unsigned long) {}
+  explicit operator bool() const { return true; }
+  int available();  // Bytes waiting on stdin
+  int read();
+
+  template <typename... Args>
+  int printf(char const* format, Args... args) {
+    return ::printf(format, args...);
+  }
+
+  int availableForWrite() { return 64; }  // As a USB CDC packet
+  size_t write(uint8_t const* data, size_t size) {
+    return fwrite(data, 1, size, stdout);
+  }
+
+  void print(char c) { putchar(c); }
+  void print(char const* s) { fputs(s, stdout); }
+  void println(char const* s = "") { puts(s); }
+};
+
+extern HostSerial Serial;
+
+// Provided by the app, as with the real core
+void setup();
+void loop();
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "Arduino.h"
+
+#define SPI_MODE0 0x02
+
+struct SPISettings {
+  SPISettings(uint32_t /* clock */, uint8_t /* order */, uint8_t /* mode */) {}
+};
+
+// Clocks bytes into the simulated chip (see ../dw3k_sim.h)
+class SPIClass {
+ public:
+  void begin() {}
+  void beginTransaction(SPISettings) {}
+  void endTransaction() {}
+  uint8_t transfer(uint8_t data);
+  void transfer(void* buf, size_t count);
+};
+
+extern SPIClass SPI;
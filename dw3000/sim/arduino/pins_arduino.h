@@ -0,0 +1,4 @@
+#pragma once
+
+static constexpr int A0 = 14;
+static constexpr int A1 = 15;
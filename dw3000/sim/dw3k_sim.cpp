@@ -0,0 +1,852 @@
+// Simulated DW3000 chip (see dw3k_sim.h).
+//
+// Modeled: register files with SPI short/long headers, masked writes and the
+// indirect pointers A/B; fast commands; the reset, PLL lock and RX
+// calibration sequence; OTP reads; immediate and delayed TX/RX with
+// timestamps in each chip's own (offset, drifting) clock; RX after TX
+// (W4R_TIM) and the frame wait timeout (RX_FWTO); the double RX
+// buffer (RDB_STATUS, DB_TOGGLE, overrun); 802.15.4 frame filtering and
+// auto-ACK; the event counters (EVC_*); and frames passed between processes
+// through the shared air file, heard only on a matching channel, SFD and
+// preamble code (CHAN_CTRL), with airtime from the sender's preamble
+// length and data rate; preamble acquisition against the receiver's PAC
+// (DTUNE0) and SFD timeout (RX_SFD_TOC); a free-space link budget, with
+// frames failing (or going unheard) as the first path nears the sender's
+// profile's sensitivity (dw3k_phy.h), and a line-of-sight CIR diagnostic
+// to match.
+//
+// Not modeled: the rest of the analog side (overlapping frames from
+// different senders both fail CRC, and other errors only come from
+// DW3K_SIM_LOSS, a fraction of frames failing CRC), STS, AES, sleep, GPIOs
+// and the other diagnostics (IP_TS is the RX timestamp, the rest zero).
+
+#include "dw3k_sim.h"
+
+#include <Arduino.h>
+#include <fcntl.h>
+#include <math.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "dw3k.h"
+#include "dw3k_phy.h"
+#include "dw3k_registers.h"
+#include "dw3k_spi.h"
+#include "dwm3k_pins.h"
+
+namespace {
+
+constexpr uint64_t mask40 = (uint64_t(1) << 40) - 1;
+constexpr double light_m_per_ns = 0.299792458;
+constexpr double uus_ns = 512 / 0.4992;  // W4R_TIM and RX_FWTO units
+constexpr int file_count = 0x20;
+constexpr int file_size = 1024 + 64;  // Buffers (1024) + slop for bursts
+
+//
+// Shared air between processes
+//
+
+struct AirFrame {
+  std::atomic<uint32_t> seq;
+  int32_t sender;
+  double ppm;
+  double preamble_ns;  // Start of transmission
+  double rmarker_ns;   // When the RMARKER leaves the antenna
+  double end_ns;       // End of transmission
+  uint16_t size;       // Payload size without CRC
+  bool long_phr;       // Sent with SYS_CFG PHR_MODE (extended length)
+  uint16_t chan_ctrl;  // Sender's channel, SFD and preamble codes
+  uint16_t tx_fctrl;   // Sender's preamble length and data rate
+  uint8_t data[1024];
+};
+
+struct Air {
+  std::atomic<uint32_t> next_seq;
+  AirFrame frames[16];
+};
+
+Air* open_air() {
+  char const* path = getenv("DW3K_SIM_AIR");
+  if (!path) path = "/tmp/dw3k_sim_air";
+  int const fd = open(path, O_RDWR | O_CREAT, 0666);
+  if (fd < 0 || ftruncate(fd, sizeof(Air)) < 0) {
+    perror(path);
+    exit(1);
+  }
+
+  void* const map =
+      mmap(nullptr, sizeof(Air), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) {
+    perror(path);
+    exit(1);
+  }
+  close(fd);
+  return static_cast<Air*>(map);
+}
+
+// TX_FCTRL TXPSR
+int preamble_symbols(uint16_t tx_fctrl) {
+  switch ((tx_fctrl >> 12) & 0xF) {
+    case 0x1: return 64;
+    case 0x2: return 1024;
+    case 0x3: return 4096;
+    case 0x4: return 32;
+    case 0x5: return 128;
+    case 0x6: return 1536;
+    case 0x9: return 256;
+    case 0xA: return 2048;
+    case 0xD: return 512;
+  }
+  return 64;
+}
+
+double env_double(char const* name, double dflt) {
+  char const* const value = getenv(name);
+  return value ? atof(value) : dflt;
+}
+
+//
+// Bus usage accounting
+//
+
+struct Usage {
+  long calls = 0;
+  long transactions = 0;
+  long bytes = 0;
+};
+
+std::map<std::string, Usage>* usage_map() {
+  static auto* const map = new std::map<std::string, Usage>;
+  return map;
+}
+
+Usage& caller_usage() {
+  return (*usage_map())[dw3k_spi_caller ? dw3k_spi_caller : "(direct)"];
+}
+
+//
+// Chip model
+//
+
+enum class Radio { Off, Init, Idle, TxWait, Tx, RxWait, Rx };
+
+struct Transaction {
+  int count = 0;
+  uint8_t header0 = 0;
+  int header_len = 0;
+  bool fast = false;
+  bool write = false;
+  int file = 0;
+  int offset = 0;
+  int mode = 0;
+  std::vector<uint8_t> data;
+};
+
+struct TxJob {
+  bool stuck = false;  // Scheduled too late (HPDWARN), never transmits
+  bool published = false;
+  double preamble_ns = 0;
+  double rmarker_ns = 0;
+  double end_ns = 0;
+  uint64_t stamp_t40 = 0;
+  int ack_sequence = -1;  // Auto-ACK frame instead of TX_BUFFER
+  bool then_rx = false;   // TX_W4R or DTX_W4R
+};
+
+class Chip {
+ public:
+  Chip();
+
+  void pin_mode(int pin, int mode);
+  void pin_write(int pin, int value);
+  int pin_read(int pin);
+  uint8_t spi_byte(uint8_t mosi);
+
+ private:
+  uint8_t* reg(int file, int offset) { return &regs[file][offset]; }
+
+  template <typename T> T get(DW3KRegisterAddress a, int n = sizeof(T)) {
+    T v = 0;
+    memcpy(&v, reg(a.file, a.offset), n);
+    return v;
+  }
+
+  template <typename T>
+  void set(DW3KRegisterAddress a, T v, int n = sizeof(T)) {
+    memcpy(reg(a.file, a.offset), &v, n);
+  }
+
+  uint64_t status() { return get<uint64_t>(DW3K_SYS_STATUS_64, 6); }
+  void raise(uint64_t bits) { set(DW3K_SYS_STATUS_64, status() | bits, 6); }
+
+  // Bumps an event counter, if enabled (EVC_CTRL EVC_EN)
+  void count(DW3KRegisterAddress a) {
+    if (get<uint32_t>(DW3K_EVC_CTRL) & 0x1)
+      set(a, uint16_t(get<uint16_t>(a) + 1));
+  }
+
+  double t40_per_ns() const { return dw3k_time40_hz * 1e-9 * (1 + ppm * 1e-6); }
+  uint64_t t40_at(double ns) const {
+    return uint64_t((ns - epoch_ns) * t40_per_ns() + phase_t40) & mask40;
+  }
+
+  double symbol_ns();
+  double preamble_ns();
+  double payload_ns(int size);
+  double rx_dbm(AirFrame const&);
+  double margin_db(AirFrame const&);
+
+  void update_reset();
+  void boot();
+  void advance();
+  void receive(double now);
+  bool phy_matches(AirFrame const&);
+  bool filter_accepts(AirFrame const&);
+  bool collides(uint32_t seq, AirFrame const&);
+  void start_auto_ack(AirFrame const&, double end_ns);
+  void start_tx(bool delayed);
+  void start_rx(bool delayed);
+  void arm_rx_timeout();
+  void fast_command(int command);
+  void resolve_indirect(Transaction*);
+  void apply_write(Transaction const&);
+  void after_write(int file, int offset, int len);
+
+  Air* const air;
+  int32_t const id;
+  double const ppm;
+  double const distance_m;
+  double const loss;
+  double const epoch_ns;
+  double const phase_t40;
+
+  int rst_mode = 0;
+  int rst_value = 1;
+  bool in_reset = false;
+  bool cs_low = false;
+  Transaction txn;
+
+  Radio radio = Radio::Off;
+  double boot_ns = 0;
+  double pll_lock_ns = 0;
+  double rx_cal_ns = 0;
+  double rx_on_ns = 0;
+  double rx_timeout_ns = 0;  // RX_FWTO expiry, if enabled
+  uint32_t air_seen = 0;
+  TxJob tx;
+  bool rx_full[2] = {};     // Double buffer: filled, not yet toggled back
+  int rx_chip_buffer = 0;   // Buffer the next frame goes into
+  int rx_host_buffer = 0;   // Buffer DB_TOGGLE releases
+
+  uint8_t regs[file_count][file_size] = {};
+  uint32_t otp[0x80] = {};
+};
+
+Chip::Chip()
+    : air(open_air()),
+      id(getpid()),
+      ppm(env_double("DW3K_SIM_PPM", 0)),
+      distance_m(env_double("DW3K_SIM_DISTANCE", 3)),
+      loss(env_double("DW3K_SIM_LOSS", 0)),
+      epoch_ns(dw3k_sim_now_ns()),
+      phase_t40((id * 2654435761u) & mask40) {
+  otp[DW3K_OTP_EUID_LO.index] = 0x5100000 + id;
+  otp[DW3K_OTP_EUID_HI.index] = 0xDECA5100;
+  otp[DW3K_OTP_LDO_TUNE_LO.index] = 0x14161515;
+  otp[DW3K_OTP_LDO_TUNE_HI.index] = 0x0E0C1515;
+  otp[DW3K_OTP_CHIP_ID.index] = 0x51000000 | (id & 0xFFFF);
+  otp[DW3K_OTP_LOT_ID.index] = 0x5151;
+  otp[DW3K_OTP_BIAS_TUNE.index] = 0x00110000;
+  otp[DW3K_OTP_XTAL_TRIM.index] = 0x2E;
+  otp[DW3K_OTP_REVISION.index] = 0x1;
+}
+
+double Chip::symbol_ns() {
+  auto const chan_ctrl = get<uint16_t>(DW3K_CHAN_CTRL);
+  return (chan_ctrl & 0xF8) <= 0x40 ? 993.59 : 1017.63;
+}
+
+double Chip::preamble_ns() {
+  int const pre_sym = preamble_symbols(get<uint16_t>(DW3K_TX_FCTRL_64));
+  auto const sfd_sym = (get<uint16_t>(DW3K_CHAN_CTRL) & 0x6) == 0x4 ? 16 : 8;
+  return (pre_sym + sfd_sym) * symbol_ns();
+}
+
+double Chip::payload_ns(int size) {
+  auto const sys_cfg = get<uint32_t>(DW3K_SYS_CFG);
+  auto const fast = get<uint32_t>(DW3K_TX_FCTRL_64) & 0x400;  // TXBR
+  double const phr_ns = 21 / ((fast && (sys_cfg & 0x20)) ? 6.8e-3 : 0.85e-3);
+  double const bits = (size + 2) * 8 * 1.2;  // Roughly Reed-Solomon overhead
+  return phr_ns + bits / (fast ? 6.8e-3 : 0.85e-3);
+}
+
+void Chip::pin_mode(int pin, int mode) {
+  if (pin == DW3K_RSTn_PIN) {
+    rst_mode = mode;
+    update_reset();
+  }
+}
+
+void Chip::pin_write(int pin, int value) {
+  if (pin == DW3K_RSTn_PIN) {
+    rst_value = value;
+    update_reset();
+  }
+
+  if (pin == DW3K_CSn_PIN) {
+    if (!value && !cs_low) {
+      cs_low = true;
+      txn = Transaction();
+      advance();
+      ++caller_usage().transactions;
+    } else if (value && cs_low) {
+      cs_low = false;
+      if (txn.fast) {
+        fast_command((txn.header0 >> 1) & 0x1F);
+      } else if (txn.write && txn.count > txn.header_len) {
+        apply_write(txn);
+      }
+      advance();
+    }
+  }
+}
+
+int Chip::pin_read(int pin) {
+  if (pin != DW3K_IRQ_PIN) return 0;
+  advance();
+  if (in_reset || radio == Radio::Off) return 0;
+  return (status() & get<uint64_t>(DW3K_SYS_ENABLE_64, 6)) != 0;
+}
+
+uint8_t Chip::spi_byte(uint8_t mosi) {
+  if (!cs_low || in_reset || radio == Radio::Off) return 0xFF;
+  ++caller_usage().bytes;
+
+  // DW3000 User Manual 2.3.1.2. "Transaction formats of the SPI interface"
+  int const i = txn.count++;
+  if (i == 0) {
+    txn.header0 = mosi;
+    txn.fast = (mosi & 0xC1) == 0x81;
+    txn.write = mosi & 0x80;
+    txn.file = (mosi >> 1) & 0x1F;
+    txn.header_len = (txn.fast || !(mosi & 0x40)) ? 1 : 2;
+    if (txn.header_len == 1) resolve_indirect(&txn);
+    return 0;
+  }
+
+  if (txn.fast) return 0;
+  if (i == 1 && txn.header_len == 2) {
+    txn.offset = ((txn.header0 & 1) << 6) | (mosi >> 2);
+    txn.mode = mosi & 0x3;
+    resolve_indirect(&txn);
+    return 0;
+  }
+
+  int const at = txn.offset + i - txn.header_len;
+  if (txn.write) {
+    txn.data.push_back(mosi);
+    return 0;
+  }
+  return at < file_size ? regs[txn.file][at] : 0;
+}
+
+void Chip::resolve_indirect(Transaction* t) {
+  if (t->file == DW3K_INDIRECT_PTR_A.file) {
+    t->file = get<uint32_t>(DW3K_PTR_ADDR_A) & 0x1F;
+    t->offset += get<uint32_t>(DW3K_PTR_OFFSET_A) & 0x7FFF;
+  } else if (t->file == DW3K_INDIRECT_PTR_B.file) {
+    t->file = get<uint32_t>(DW3K_PTR_ADDR_B) & 0x1F;
+    t->offset += get<uint32_t>(DW3K_PTR_OFFSET_B) & 0x7FFF;
+  }
+}
+
+void Chip::apply_write(Transaction const& t) {
+  if (t.mode) {
+    // Masked write: AND bytes then OR bytes, 1/2/4 bytes each
+    int const width = t.mode == 3 ? 4 : t.mode;
+    if (int(t.data.size()) < 2 * width) return;
+    for (int i = 0; i < width && t.offset + i < file_size; ++i) {
+      uint8_t* const b = reg(t.file, t.offset + i);
+      *b = (*b & t.data[i]) | t.data[width + i];
+    }
+    after_write(t.file, t.offset, width);
+    return;
+  }
+
+  auto const status = DW3K_SYS_STATUS_64;
+  auto const rdb_status = DW3K_RDB_STATUS;
+  int const len = t.data.size();
+  for (int i = 0; i < len && t.offset + i < file_size; ++i) {
+    int const at = t.offset + i;
+    uint8_t* const b = reg(t.file, at);
+    bool const w1c =  // Write 1 to clear
+        (t.file == status.file && at >= status.offset &&
+         at < status.offset + 8) ||
+        (t.file == rdb_status.file && at == rdb_status.offset);
+    if (w1c)
+      *b &= ~t.data[i];
+    else
+      *b = t.data[i];
+  }
+  after_write(t.file, t.offset, len);
+}
+
+void Chip::after_write(int file, int offset, int len) {
+  auto const hit = [&](DW3KRegisterAddress a) {
+    return a.file == file && a.offset >= offset && a.offset < offset + len;
+  };
+
+  if (hit(DW3K_SEQ_CTRL) && (get<uint32_t>(DW3K_SEQ_CTRL) & 0x100)) {
+    if (radio == Radio::Init && !pll_lock_ns)
+      pll_lock_ns = dw3k_sim_now_ns() + 20e3;
+  }
+
+  if (hit(DW3K_RX_CAL) && (get<uint32_t>(DW3K_RX_CAL) & 0x10)) {
+    set(DW3K_RX_CAL_STS, uint8_t(0));
+    rx_cal_ns = dw3k_sim_now_ns() + 10e3;
+  }
+
+  if (hit(DW3K_SYS_CFG) && (get<uint32_t>(DW3K_SYS_CFG) & 0x8)) {
+    rx_full[0] = rx_full[1] = false;  // DIS_DRXB, both buffers back to radio
+    rx_chip_buffer = rx_host_buffer = 0;
+  }
+
+  if (hit(DW3K_OTP_CFG) && (get<uint16_t>(DW3K_OTP_CFG) & 0x2)) {
+    set(DW3K_OTP_RDATA, otp[get<uint16_t>(DW3K_OTP_ADDR) & 0x7F]);
+  }
+}
+
+void Chip::update_reset() {
+  bool const now_reset = (rst_mode == OUTPUT && !rst_value);
+  if (now_reset == in_reset) return;
+  in_reset = now_reset;
+  if (in_reset) {
+    radio = Radio::Off;
+    boot_ns = pll_lock_ns = rx_cal_ns = 0;
+    tx = TxJob();
+    rx_full[0] = rx_full[1] = false;
+    rx_chip_buffer = rx_host_buffer = 0;
+  } else {
+    boot_ns = dw3k_sim_now_ns() + 50e3;
+  }
+}
+
+void Chip::boot() {
+  memset(regs, 0, sizeof(regs));
+  set(DW3K_DEV_ID, uint32_t(0xDECA0302));
+  set(DW3K_SYS_ENABLE_64, uint32_t(0x800000));  // SPIRDY
+  set(DW3K_SYS_STATUS_64, uint32_t(0x1800000));  // SPIRDY, RCINIT
+  set(DW3K_TX_FCTRL_64, uint32_t(0x0C000C));
+  set(DW3K_CHAN_CTRL, uint16_t(0x094E));
+  set(DW3K_PLL_CAL, uint16_t(0x0081));
+  radio = Radio::Init;
+  air_seen = air->next_seq.load() - 1;
+}
+
+void Chip::advance() {
+  double const now = dw3k_sim_now_ns();
+  if (in_reset) return;
+  if (radio == Radio::Off) {
+    if (!boot_ns || now < boot_ns) return;
+    boot();
+  }
+
+  if (pll_lock_ns && now >= pll_lock_ns) {
+    pll_lock_ns = 0;
+    set(DW3K_PLL_CAL, uint16_t(get<uint16_t>(DW3K_PLL_CAL) & ~0x100));
+    raise(0x2);  // CPLOCK
+    radio = Radio::Idle;
+  }
+
+  if (rx_cal_ns && now >= rx_cal_ns) {
+    rx_cal_ns = 0;
+    set(DW3K_RX_CAL_STS, uint8_t(1));
+    set(DW3K_RX_CAL_RESI, uint32_t(0x00001234));
+    set(DW3K_RX_CAL_RESQ, uint32_t(0x00001432));
+  }
+
+  if (radio == Radio::TxWait && !tx.stuck && now >= tx.preamble_ns) {
+    raise(0x30);  // TXFRB, TXPRS
+    radio = Radio::Tx;
+  }
+
+  if (radio == Radio::Tx && !tx.published) {
+    uint32_t const seq = air->next_seq.fetch_add(1);
+    AirFrame& f = air->frames[seq % 16];
+    f.seq.store(0);
+    f.sender = id;
+    f.ppm = ppm;
+    f.preamble_ns = tx.preamble_ns;
+    f.rmarker_ns = tx.rmarker_ns;
+    f.end_ns = tx.end_ns;
+    f.long_phr = get<uint32_t>(DW3K_SYS_CFG) & 0x10;
+    f.chan_ctrl = get<uint16_t>(DW3K_CHAN_CTRL);
+    f.tx_fctrl = get<uint16_t>(DW3K_TX_FCTRL_64);
+    f.size = get<uint16_t>(DW3K_TX_FCTRL_64) & (f.long_phr ? 0x3FF : 0x7F);
+    f.size = f.size >= 2 ? f.size - 2 : 0;
+    memcpy(f.data, reg(DW3K_TX_BUFFER.file, 0), f.size);
+    if (tx.ack_sequence >= 0) {
+      f.size = 3;
+      f.data[0] = 0x02;  // Frame type ACK
+      f.data[1] = 0x00;
+      f.data[2] = tx.ack_sequence;
+    }
+    f.seq.store(seq);
+    tx.published = true;
+  }
+
+  if (radio == Radio::Tx && now >= tx.rmarker_ns) raise(0x40);  // TXPHS
+
+  if (radio == Radio::Tx && now >= tx.end_ns) {
+    set(DW3K_TX_STAMP_64, tx.stamp_t40, 5);
+    raise(0x80);  // TXFRS
+    count(DW3K_EVC_TXFS);
+    radio = Radio::Idle;
+    if (tx.then_rx) {
+      auto const w4r = get<uint32_t>(DW3K_ACK_RESP_T) & 0xFFFFF;
+      rx_on_ns = tx.end_ns + w4r * uus_ns;
+      arm_rx_timeout();
+      radio = Radio::RxWait;
+    }
+  }
+
+  if (radio == Radio::RxWait && now >= rx_on_ns) radio = Radio::Rx;
+  if (radio == Radio::Rx) receive(now);
+
+  set(DW3K_SYS_TIME, uint32_t(t40_at(now) >> 8) & ~1u);
+
+  uint32_t pmsc = 0x03;  // Idle
+  switch (radio) {
+    case Radio::Off: case Radio::Init: pmsc = 0x00; break;
+    case Radio::Idle: pmsc = 0x03; break;
+    case Radio::TxWait: pmsc = 0x08; break;
+    case Radio::Tx: pmsc = 0x0C; break;
+    case Radio::RxWait: case Radio::Rx: pmsc = 0x12; break;
+  }
+  set(DW3K_SYS_STATE, pmsc << 16);
+}
+
+void Chip::receive(double now) {
+  double const flight_ns = distance_m / light_m_per_ns;
+  uint32_t const next = air->next_seq.load();
+  for (uint32_t seq = air_seen + 1; seq != next; ++seq) {
+    AirFrame const& f = air->frames[seq % 16];
+    if (f.seq.load() != seq || f.sender == id) {
+      air_seen = seq;
+      continue;
+    }
+
+    if (f.preamble_ns + flight_ns < rx_on_ns) {
+      air_seen = seq;  // Started before we were listening
+      continue;
+    }
+
+    if (rx_timeout_ns && f.end_ns + flight_ns > rx_timeout_ns) break;
+    if (f.end_ns + flight_ns > now) return;  // Still in the air
+
+    air_seen = seq;
+    if (!phy_matches(f)) continue;  // Not heard at all
+    double const margin = margin_db(f);
+    if (margin < -6) continue;  // Too weak to detect
+
+    // Acquisition with our PAC (DTUNE0) needs a few PACs of the sender's
+    // preamble, and then its SFD within our RX_SFD_TOC symbols
+    static constexpr int pacs[] = {8, 16, 32, 4};
+    int const pac = pacs[get<uint16_t>(DW3K_DTUNE0) & 0x3];
+    int const preamble = preamble_symbols(f.tx_fctrl);
+    int const sfd_symbols = ((f.chan_ctrl >> 1) & 0x3) == 2 ? 16 : 8;
+    if (preamble < 4 * pac) continue;  // Not detected
+    if (preamble + sfd_symbols - pac > get<uint16_t>(DW3K_RX_SFD_TOC)) {
+      raise(0x4000000);  // RXSTO, the chip hunts for a preamble again
+      count(DW3K_EVC_STO);
+      continue;
+    }
+    if (f.long_phr != bool(get<uint32_t>(DW3K_SYS_CFG) & 0x10)) {
+      raise(0x1000);  // RXPHE, PHR modes differ
+      count(DW3K_EVC_PHE);
+      continue;
+    }
+    // Near the sensitivity, more and more frames fail (50% right at it)
+    double const fading_loss = 1 / (1 + exp(margin / 1.5));
+    if (collides(seq, f) || rand() < (loss + fading_loss) * RAND_MAX) {
+      raise(0x8000);  // RXFCE
+      count(DW3K_EVC_FCE);
+      continue;
+    }
+    if ((get<uint32_t>(DW3K_SYS_CFG) & 0x1) && !filter_accepts(f)) {
+      raise(0x20000000);  // ARFE, keep listening
+      count(DW3K_EVC_FFR);
+      continue;
+    }
+
+    bool const double_buffer = !(get<uint32_t>(DW3K_SYS_CFG) & 0x8);
+    int const buffer = double_buffer ? rx_chip_buffer : 0;
+    if (double_buffer && rx_full[buffer]) {
+      raise(0x100000);  // RXOVRR, frame lost
+      count(DW3K_EVC_OVR);
+      continue;
+    }
+
+    int const file = buffer ? DW3K_RX_BUFFER1.file : DW3K_RX_BUFFER0.file;
+    memcpy(reg(file, 0), f.data, f.size);
+    memset(reg(file, f.size), 0, 2);  // CRC
+    uint64_t const stamp_t40 = t40_at(f.rmarker_ns + flight_ns);
+    set(DW3K_RX_FINFO, uint32_t(f.size + 2));
+    set(DW3K_RX_STAMP_64, stamp_t40, 5);
+    set(DW3K_IP_TS_64, stamp_t40, 5);
+
+    // A clean line-of-sight CIR: the first path is the peak, with the
+    // amplitude that gives rx_dbm() (see dw3k_first_path_dbm())
+    int const accumulated = std::min(preamble_symbols(f.tx_fctrl), 0xFFF);
+    int const rx_pcode = (get<uint16_t>(DW3K_CHAN_CTRL) >> 8) & 0x1F;
+    double const a_db = rx_pcode <= 8 ? 113.8 : 121.7;
+    uint32_t const fp = accumulated *
+        sqrt(pow(10, (rx_dbm(f) + a_db) / 10) / 3);
+    set(DW3K_IP_DIAG0, uint32_t((fp & 0x1FFFFF) | 740u << 21));  // Peak
+    set(DW3K_IP_DIAG1, uint32_t(fp / 64 & 0x1FFFF));  // CIR power, roughly
+    set(DW3K_IP_DIAG2, fp & 0x3FFFFF);
+    set(DW3K_IP_DIAG3, fp & 0x3FFFFF);
+    set(DW3K_IP_DIAG4, fp & 0x3FFFFF);
+    set(DW3K_IP_DIAG8, uint32_t(740 << 6));  // First path index, 10.6
+    set(DW3K_IP_DIAG12, uint32_t(accumulated & 0xFFF));
+
+    // Carrier integrator, see dw3k_rx_clock_offset()
+    int32_t const car_int = (f.ppm - ppm) * 1e-6 / 0.5731e-9;
+    set(DW3K_DRX_CAR_INT, uint32_t(car_int & 0x1FFFFF), 3);
+
+    raise(0x6F00);  // RXPRD, RXSFDD, CIADONE, RXPHD, RXFR, RXFCG
+    count(DW3K_EVC_FCG);
+    if (!double_buffer) {
+      radio = Radio::Idle;
+      auto const sys_cfg = get<uint32_t>(DW3K_SYS_CFG);
+      bool const ack_request = f.size >= 3 && (f.data[0] & 0x20);
+      if ((sys_cfg & 0x801) == 0x801 && ack_request) {
+        raise(0x8);  // AAT
+        start_auto_ack(f, f.end_ns + flight_ns);
+      }
+      return;
+    }
+
+    // Per-buffer copies; COE_PPM in 2^-26 units, local minus remote (the
+    // opposite sign to DRX_CAR_INT, as on the chip)
+    auto const info = buffer ? DW3K_BUF1_RX_FINFO : DW3K_BUF0_RX_FINFO;
+    int32_t const coe = (ppm - f.ppm) * 1e-6 * (1 << 26);
+    set(info, uint32_t(f.size + 2));
+    set({info.file, uint16_t(info.offset + 0x4)}, stamp_t40, 5);
+    set({info.file, uint16_t(info.offset + 0xC)}, uint32_t(coe & 0x1FFF));
+    set(DW3K_RDB_STATUS,
+        uint8_t(get<uint8_t>(DW3K_RDB_STATUS) | (0x7 << (4 * buffer))));
+    rx_full[buffer] = true;
+    rx_chip_buffer ^= 1;  // Keep listening into the other buffer
+  }
+
+  if (rx_timeout_ns && now >= rx_timeout_ns) {
+    raise(0x20000);  // RXFTO
+    count(DW3K_EVC_FWTO);
+    radio = Radio::Idle;
+  }
+}
+
+bool Chip::collides(uint32_t seq, AirFrame const& f) {
+  // Any other sender on the air at the same time garbles the frame
+  for (AirFrame const& other : air->frames) {
+    uint32_t const other_seq = other.seq.load();
+    if (other_seq == seq || other.sender == f.sender || other.sender == id)
+      continue;
+    if ((other.chan_ctrl ^ f.chan_ctrl) & 0x1) continue;  // Other channel
+    if (other.preamble_ns < f.end_ns && f.preamble_ns < other.end_ns)
+      return true;
+  }
+  return false;
+}
+
+double Chip::rx_dbm(AirFrame const& f) {
+  // Free space from EIRP -41.3dBm/MHz over 500MHz, at 6489.6MHz (ch5) or
+  // 7987.2MHz (ch9)
+  double const mhz = (f.chan_ctrl & 0x1) ? 7987.2 : 6489.6;
+  double const d = distance_m > 0.1 ? distance_m : 0.1;
+  return -14.3 - (20 * log10(d) + 20 * log10(mhz) - 27.55);
+}
+
+double Chip::margin_db(AirFrame const& f) {
+  // Over the sender's profile's sensitivity, as dw3k_phy.h reckons it
+  auto const profile = dw3k_phy_profile(
+      "", (f.chan_ctrl & 0x1) ? 9 : 5, preamble_symbols(f.tx_fctrl),
+      (f.chan_ctrl >> 3) & 0x1F, f.tx_fctrl & 0x400);
+  return rx_dbm(f) - profile.sensitivity_dbm;
+}
+
+bool Chip::phy_matches(AirFrame const& f) {
+  // Same channel and SFD, and the sender's TX_PCODE is our RX_PCODE (the
+  // preamble length and data rate are the receiver's to detect)
+  auto const chan_ctrl = get<uint16_t>(DW3K_CHAN_CTRL);
+  return ((f.chan_ctrl ^ chan_ctrl) & 0x7) == 0 &&
+      ((f.chan_ctrl >> 3) & 0x1F) == ((chan_ctrl >> 8) & 0x1F);
+}
+
+bool Chip::filter_accepts(AirFrame const& f) {
+  // Simplified rules: frame type, PAN ID and destination address only
+  auto const allow = get<uint16_t>(DW3K_FF_CFG);
+  if (f.size < 3) return false;
+  int const control = f.data[0] | (f.data[1] << 8);
+  int const type = control & 0x7;
+  if (!(allow & (1 << type))) return false;
+
+  int const dest_mode = (control >> 10) & 0x3;
+  if (dest_mode == 0) return type == 0 || type == 2;  // Beacon, ACK
+  if (f.size < (dest_mode == 3 ? 13 : 7)) return false;
+
+  auto const panadr = get<uint32_t>(DW3K_PANADR);
+  int const pan = f.data[3] | (f.data[4] << 8);
+  if (pan != 0xFFFF && pan != int(panadr >> 16)) return false;
+  if (dest_mode == 3) {
+    uint64_t dest;
+    memcpy(&dest, &f.data[5], 8);
+    return dest == get<uint64_t>(DW3K_EUI_64);
+  }
+  int const dest = f.data[5] | (f.data[6] << 8);
+  return dest == 0xFFFF || dest == int(panadr & 0xFFFF);
+}
+
+void Chip::start_auto_ack(AirFrame const& f, double end_ns) {
+  // Broadcasts are never acknowledged
+  int const dest_mode = (f.data[1] >> 2) & 0x3;
+  if (dest_mode == 2 && f.data[5] == 0xFF && f.data[6] == 0xFF) return;
+
+  auto const ack_tim = get<uint32_t>(DW3K_ACK_RESP_T) >> 24;
+  auto const antd_t40 = get<uint16_t>(DW3K_TX_ANTD);
+  tx = TxJob();
+  tx.ack_sequence = f.data[2];
+  tx.preamble_ns = end_ns + ack_tim * symbol_ns();
+  tx.rmarker_ns = tx.preamble_ns + preamble_ns();
+  tx.stamp_t40 = t40_at(tx.rmarker_ns);
+  tx.rmarker_ns += antd_t40 / t40_per_ns();
+  tx.preamble_ns += antd_t40 / t40_per_ns();
+  tx.end_ns = tx.rmarker_ns + payload_ns(3);
+  radio = Radio::TxWait;
+}
+
+void Chip::start_tx(bool delayed) {
+  double const now = dw3k_sim_now_ns();
+  double const pre_ns = preamble_ns();
+  auto const antd_t40 = get<uint16_t>(DW3K_TX_ANTD);
+  uint64_t rmarker_t40;
+
+  tx = TxJob();
+  if (delayed) {
+    rmarker_t40 = uint64_t(get<uint32_t>(DW3K_DX_TIME) & ~1u) << 8;
+    uint64_t const ahead_t40 = (rmarker_t40 - t40_at(now)) & mask40;
+    if (ahead_t40 >= (mask40 >> 1)) {
+      raise(0x8000000);  // HPDWARN
+      count(DW3K_EVC_HPW);
+      tx.stuck = true;
+    }
+    tx.rmarker_ns = now + ahead_t40 / t40_per_ns();
+  } else {
+    tx.rmarker_ns = now + 1e3 + pre_ns;
+    rmarker_t40 = t40_at(tx.rmarker_ns);
+  }
+
+  tx.stamp_t40 = (rmarker_t40 + antd_t40) & mask40;
+  tx.rmarker_ns += antd_t40 / t40_per_ns();
+  tx.preamble_ns = tx.rmarker_ns - pre_ns;
+  int const size = get<uint16_t>(DW3K_TX_FCTRL_64) & 0x3FF;
+  tx.end_ns = tx.rmarker_ns + payload_ns(size >= 2 ? size - 2 : 0);
+  radio = Radio::TxWait;
+}
+
+void Chip::start_rx(bool delayed) {
+  double const now = dw3k_sim_now_ns();
+  rx_on_ns = now;
+  if (delayed) {
+    uint64_t const on_t40 = uint64_t(get<uint32_t>(DW3K_DX_TIME) & ~1u) << 8;
+    uint64_t const ahead_t40 = (on_t40 - t40_at(now)) & mask40;
+    if (ahead_t40 >= (mask40 >> 1)) {
+      raise(0x8000000);  // HPDWARN, on only once the clock comes round
+      count(DW3K_EVC_HPW);
+    }
+    rx_on_ns += ahead_t40 / t40_per_ns();
+  }
+  arm_rx_timeout();
+  radio = Radio::RxWait;
+}
+
+void Chip::arm_rx_timeout() {
+  bool const enabled = get<uint32_t>(DW3K_SYS_CFG) & 0x200;  // RXWTOE
+  auto const fwto = get<uint32_t>(DW3K_RX_FWTO) & 0xFFFFF;
+  rx_timeout_ns = enabled && fwto ? rx_on_ns + fwto * uus_ns : 0;
+}
+
+void Chip::fast_command(int command) {
+  // DW3000 User Manual 9. "Fast Commands"
+  if (radio == Radio::Off || radio == Radio::Init) return;
+  switch (command) {
+    case DW3K_TXRXOFF.bits:
+      tx = TxJob();
+      radio = Radio::Idle;
+      break;
+    case DW3K_TX.bits: start_tx(false); break;
+    case DW3K_DTX.bits: start_tx(true); break;
+    case DW3K_RX.bits: start_rx(false); break;
+    case DW3K_DRX.bits: start_rx(true); break;
+    case DW3K_TX_W4R.bits: start_tx(false); tx.then_rx = true; break;
+    case DW3K_DTX_W4R.bits: start_tx(true); tx.then_rx = true; break;
+    case DW3K_CLR_IRQS.bits: set(DW3K_SYS_STATUS_64, uint64_t(0), 6); break;
+    case DW3K_DB_TOGGLE.bits:
+      rx_full[rx_host_buffer] = false;
+      rx_host_buffer ^= 1;
+      break;
+    default:
+      fprintf(stderr, "DW3K SIM: Fast command 0x%02x not modeled\n", command);
+      break;
+  }
+}
+
+Chip& chip() {
+  static auto* const chip = new Chip;
+  return *chip;
+}
+
+void count_call(char const* name) { ++(*usage_map())[name].calls; }
+
+struct InstallHook {
+  InstallHook() { dw3k_spi_caller_hook = count_call; }
+} install_hook;
+
+}  // namespace
+
+double dw3k_sim_now_ns() {
+  using namespace std::chrono;
+  return duration<double, std::nano>(steady_clock::now().time_since_epoch())
+      .count();
+}
+
+void dw3k_sim_pin_mode(int pin, int mode) { chip().pin_mode(pin, mode); }
+void dw3k_sim_pin_write(int pin, int value) { chip().pin_write(pin, value); }
+int dw3k_sim_pin_read(int pin) { return chip().pin_read(pin); }
+uint8_t dw3k_sim_spi_byte(uint8_t mosi) { return chip().spi_byte(mosi); }
+
+void dw3k_sim_report() {
+  printf("\n=== Simulated SPI usage ===\n");
+  printf("%-24s %9s %9s %10s %8s %8s\n",
+         "call", "calls", "xfers", "bytes", "xfers/c", "bytes/c");
+  Usage total;
+  for (auto const& name_usage : *usage_map()) {
+    auto const& u = name_usage.second;
+    printf("%-24s %9ld %9ld %10ld %8.2f %8.1f\n",
+           name_usage.first.c_str(), u.calls, u.transactions, u.bytes,
+           u.calls ? double(u.transactions) / u.calls : 0.0,
+           u.calls ? double(u.bytes) / u.calls : 0.0);
+    total.transactions += u.transactions;
+    total.bytes += u.bytes;
+  }
+  printf("%-24s %9s %9ld %10ld\n", "(total)", "", total.transactions,
+         total.bytes);
+}
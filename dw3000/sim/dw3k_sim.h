@@ -0,0 +1,27 @@
+#pragma once
+
+// Host-side model of a DW3000 at the SPI wire level, for building the dw3k
+// driver and apps on Linux without hardware. The Arduino shims in arduino/
+// route pins and SPIClass bytes here.
+//
+// Several processes can share one simulated "air" (a memory-mapped file), so
+// e.g. sim_test_ping and sim_test_pong can talk to each other.
+//
+// Environment variables:
+//   DW3K_SIM_AIR=path       shared air file (default /tmp/dw3k_sim_air)
+//   DW3K_SIM_PPM=x          this chip's clock error in ppm (default 0)
+//   DW3K_SIM_DISTANCE=m     distance to the other chips in meters (default 3;
+//                           past ~25m, 64-symbol 6.8Mbps frames start failing)
+//   DW3K_SIM_LOSS=x         extra fraction of frames failing CRC (default 0)
+
+#include <stdint.h>
+
+double dw3k_sim_now_ns();
+
+void dw3k_sim_pin_mode(int pin, int mode);
+void dw3k_sim_pin_write(int pin, int value);
+int dw3k_sim_pin_read(int pin);
+uint8_t dw3k_sim_spi_byte(uint8_t mosi);
+
+// Prints SPI transactions and bytes for each public dw3k_* call.
+void dw3k_sim_report();
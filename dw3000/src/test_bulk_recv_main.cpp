@@ -0,0 +1,49 @@
+#include <Arduino.h>
+#include <avr/dtostrf.h>
+
+#include "dw3k.h"
+#include "dw3k_link.h"
+
+// Receives and checks messages from test_bulk_send over dw3k_link
+static uint8_t message[32 * 1024];
+
+void setup() {
+  Serial.begin(115200);
+  while (!Serial) delay(10);
+  Serial.printf("Resetting DW3K...\n");
+  dw3k_reset();
+  dw3k_wait_verbose(DW3KStatus::Ready);
+}
+
+void loop() {
+  Serial.printf("\nWaiting for message...\n");
+  dw3k_link_receive(message, sizeof(message));
+  DW3KLinkStatus status;
+  do {
+    delayMicroseconds(10);
+    status = dw3k_link_poll();
+  } while (status == DW3KLinkStatus::Receiving);
+
+  if (status != DW3KLinkStatus::Done) {
+    Serial.printf("*** %s\n", dw3k_link_status_text());
+    dw3k_link_abort();
+    dw3k_reset();
+    dw3k_wait_verbose(DW3KStatus::Ready);
+    return;
+  }
+
+  auto const size = dw3k_link_received_size();
+  int bad = 0;
+  for (uint32_t i = 0; i < size; ++i) {
+    bad += message[i] != uint8_t(i * 31 + message[0]);
+  }
+
+  auto const s = dw3k_link_stats();
+  char goodput[20];
+  Serial.printf(
+      "Received %lu bytes in %lu us = %s kB/s (%lu frames, %lu dups, "
+      "%lu acks), %d bad bytes\n",
+      (unsigned long) size, (unsigned long) s.micros,
+      dtostrf(s.goodput * 1e-3, 0, 1, goodput), (unsigned long) s.frames,
+      (unsigned long) s.retransmits, (unsigned long) s.acks, bad);
+}
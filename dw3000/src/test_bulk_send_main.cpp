@@ -0,0 +1,48 @@
+#include <Arduino.h>
+#include <avr/dtostrf.h>
+
+#include "dw3k.h"
+#include "dw3k_link.h"
+
+// Sends a test pattern to test_bulk_recv over dw3k_link, repeatedly
+static uint8_t message[32 * 1024];
+
+void setup() {
+  Serial.begin(115200);
+  while (!Serial) delay(10);
+  Serial.printf("Resetting DW3K...\n");
+  dw3k_reset();
+  dw3k_wait_verbose(DW3KStatus::Ready);
+}
+
+void loop() {
+  static uint8_t pass = 0;
+  for (size_t i = 0; i < sizeof(message); ++i) {
+    message[i] = uint8_t(i * 31 + pass);
+  }
+  ++pass;
+
+  Serial.printf("\nSending %d bytes...\n", int(sizeof(message)));
+  dw3k_link_send(message, sizeof(message));
+  DW3KLinkStatus status;
+  do {
+    delayMicroseconds(10);
+    status = dw3k_link_poll();
+  } while (status == DW3KLinkStatus::Sending);
+
+  auto const s = dw3k_link_stats();
+  char goodput[20];
+  Serial.printf(
+      "%s: %lu bytes in %lu us = %s kB/s (%lu frames, %lu resent, "
+      "%lu acks, %lu timeouts)\n",
+      dw3k_link_status_text(), (unsigned long) s.bytes,
+      (unsigned long) s.micros, dtostrf(s.goodput * 1e-3, 0, 1, goodput),
+      (unsigned long) s.frames, (unsigned long) s.retransmits,
+      (unsigned long) s.acks, (unsigned long) s.timeouts);
+  if (status != DW3KLinkStatus::Done) {
+    dw3k_link_abort();
+    dw3k_reset();
+    dw3k_wait_verbose(DW3KStatus::Ready);
+  }
+  delay(500);
+}
@@ -0,0 +1,74 @@
+#include <Arduino.h>
+#include <avr/dtostrf.h>
+
+#include "dw3k.h"
+#include "dw3k_spi.h"
+
+// Answers test_filter_send with the chip's frame filter and auto-ACK, in
+// IRQ mode so that dw3k_poll() only reads the chip for frames the filter
+// let through; reports the SPI transactions that cost per frame (build with
+// -DDW3K_SPI_PROFILE=1, as the sim does) against the frames the chip dropped
+static constexpr DW3KFrameFilter filter = {0xDECA, 0x0002, 0, 0x2};
+
+static uint32_t received = 0;
+
+static void start() {
+  dw3k_set_long_frames(false);  // Standard PHR, as test_filter_send
+  dw3k_set_frame_filter(filter);
+  dw3k_set_auto_ack(true);
+  dw3k_start_rx();
+}
+
+void setup() {
+  Serial.begin(115200);
+  while (!Serial) delay(10);
+  dw3k_use_irq({nullptr, [] { ++received; }, nullptr});
+  Serial.printf("Resetting DW3K...\n");
+  dw3k_reset();
+  dw3k_wait_verbose(DW3KStatus::Ready);
+  start();
+  dw3k_spi_profile_reset();
+}
+
+void loop() {
+  static uint32_t last_received = 0, last_filtered = 0;
+  static unsigned long report_millis = millis();
+
+  delayMicroseconds(10);
+  switch (dw3k_poll()) {
+    case DW3KStatus::ReceiveListen:
+    case DW3KStatus::ReceiveAnalyze:
+      break;
+    case DW3KStatus::ReceiveDone:
+      dw3k_end_txrx();  // The ACK is out by now
+      dw3k_start_rx();
+      break;
+    default:
+      Serial.printf("*** %s\n", dw3k_status_text());
+      dw3k_reset();
+      dw3k_wait_verbose(DW3KStatus::Ready);
+      start();
+      break;
+  }
+
+  if (millis() - report_millis < 1000) return;
+  report_millis = millis();
+  uint32_t const transactions = dw3k_spi_profile_transactions();
+  dw3k_end_txrx();
+  DW3KDiagnostics diag = {};
+  dw3k_read_diagnostics(&diag, false);
+  uint32_t const frames = received - last_received;
+  uint32_t const filtered = diag.evc[4] - last_filtered;  // FFR
+  last_received = received;
+  last_filtered = diag.evc[4];
+
+  char n1[20];
+  Serial.printf(
+      "%lu frames ACKed, %lu filtered out; %lu SPI transactions "
+      "(%s per ACKed frame)\n",
+      (unsigned long) frames, (unsigned long) filtered,
+      (unsigned long) transactions,
+      dtostrf(frames ? float(transactions) / frames : 0, 0, 1, n1));
+  dw3k_start_rx();
+  dw3k_spi_profile_reset();
+}
@@ -0,0 +1,103 @@
+#include <Arduino.h>
+#include <avr/dtostrf.h>
+
+#include "dw3k.h"
+#include "dw3k_time.h"
+
+// Sends test_filter_recv one data frame asking for an ACK after every
+// others_per_round frames to another address (which its frame filter drops),
+// and reports how soon the chip's auto-ACK comes back
+static constexpr uint16_t pan_id = 0xDECA;
+static constexpr uint16_t recv_address = 0x0002;
+static constexpr uint16_t other_address = 0x0003;
+static constexpr uint16_t send_address = 0x0001;
+static constexpr int others_per_round = 3;
+static constexpr uint32_t ack_timeout_micros = 1000;
+
+struct FilterFrame {
+  DW3KMacHeader mac;
+  uint32_t round;
+};
+
+static uint8_t sequence = 0;
+
+// Polls until "wanted" or any other settled status (or 100ms pass)
+static DW3KStatus wait_for(DW3KStatus wanted) {
+  auto const start_millis = millis();
+  DW3KStatus status;
+  do {
+    delayMicroseconds(10);
+    status = dw3k_poll();
+  } while (status != wanted && millis() - start_millis < 100 &&
+           (status == DW3KStatus::TransmitWait ||
+            status == DW3KStatus::TransmitActive ||
+            status == DW3KStatus::ReceiveListen ||
+            status == DW3KStatus::ReceiveAnalyze));
+  return status;
+}
+
+static void send(uint16_t dest, uint32_t round, bool ack) {
+  FilterFrame const frame = {
+      {uint16_t(dw3k_mac_data | (ack ? dw3k_mac_ack_request : 0)), sequence++,
+       pan_id, dest, send_address},
+      round};
+  dw3k_buffer_tx(&frame, sizeof(frame));
+  dw3k_schedule_tx(dw3k_clock_t32() + dw3k_tx_leadtime_t32(), ack);
+}
+
+void setup() {
+  Serial.begin(115200);
+  while (!Serial) delay(10);
+  Serial.printf("Resetting DW3K...\n");
+  dw3k_reset();
+  dw3k_wait_verbose(DW3KStatus::Ready);
+  dw3k_set_long_frames(false);  // Standard PHR, as 802.15.4 nodes use
+  dw3k_set_rx_after_tx(0);
+  dw3k_set_rx_timeout(ack_timeout_micros);
+}
+
+void loop() {
+  static uint32_t round = 0, acked = 0, lost = 0;
+  static float latency_sum = 0, latency_min = 0, latency_max = 0;
+  static unsigned long report_millis = millis();
+
+  for (int i = 0; i < others_per_round; ++i) {
+    send(other_address, round, false);
+    if (wait_for(DW3KStatus::TransmitDone) != DW3KStatus::TransmitDone)
+      Serial.printf("*** Not sent (%s)\n", dw3k_status_text());
+    dw3k_end_txrx();
+  }
+
+  uint8_t const ack_sequence = sequence;
+  send(recv_address, round, true);
+  auto const status = wait_for(DW3KStatus::ReceiveDone);
+  uint8_t ack[dw3k_mac_ack_size] = {};
+  if (status == DW3KStatus::ReceiveDone && dw3k_rx_size() == sizeof(ack))
+    dw3k_retrieve_rx(0, sizeof(ack), ack);
+  if (ack[0] == 0x02 && ack[2] == ack_sequence) {
+    // RMARKER to RMARKER, so including the data frame's payload on air
+    auto const span_t40 = dw3k_t40(dw3k_rx_timestamp_t40()) -
+        dw3k_t40(dw3k_tx_timestamp_t40());
+    float const latency = dw3k_t40_ns(span_t40) * 1e-3f;
+    latency_sum += latency;
+    if (!acked || latency < latency_min) latency_min = latency;
+    if (!acked || latency > latency_max) latency_max = latency;
+    ++acked;
+  } else {
+    ++lost;
+  }
+  dw3k_end_txrx();
+  ++round;
+  delay(10);
+
+  if (millis() - report_millis < 1000) return;
+  report_millis = millis();
+  char n1[20], n2[20], n3[20];
+  Serial.printf(
+      "%lu rounds: %lu ACKed, %lu not; ACK %s/%s/%s us min/avg/max after "
+      "the data frame\n",
+      (unsigned long) round, (unsigned long) acked, (unsigned long) lost,
+      dtostrf(latency_min, 0, 1, n1),
+      dtostrf(acked ? latency_sum / acked : 0, 0, 1, n2),
+      dtostrf(latency_max, 0, 1, n3));
+}
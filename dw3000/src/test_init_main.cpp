@@ -4,6 +4,7 @@
 #include "dw3k.h"
 #include "dw3k_registers.h"
 #include "dw3k_spi.h"
+#include "dw3k_time.h"
 
 void setup() {
   Serial.begin(115200);
@@ -13,27 +14,33 @@ void setup() {
   dw3k_reset();
   dw3k_wait_verbose(DW3KStatus::ResetWaitPLL);
   Serial.printf("Registers:\n");
-  Serial.printf("DEV_ID      %08x\n", dw3k_read<uint32_t>(DW3K_DEV_ID));
-  Serial.printf("SYS_CFG     %08x\n", dw3k_read<uint32_t>(DW3K_SYS_CFG));
-  Serial.printf("TX_FCTRL    %012x\n", dw3k_read<uint64_t>(DW3K_TX_FCTRL_64));
-  Serial.printf("TX_ANTD     %04x\n", dw3k_read<uint16_t>(DW3K_TX_ANTD));
-  Serial.printf("CHAN_CTRL   %04x\n", dw3k_read<uint16_t>(DW3K_CHAN_CTRL));
-  Serial.printf("DGC_CFG     %04x\n", dw3k_read<uint16_t>(DW3K_DGC_CFG));
-  Serial.printf("RX_CAL_RESI %08x\n", dw3k_read<uint32_t>(DW3K_RX_CAL_RESI));
-  Serial.printf("RX_CAL_RESQ %08x\n", dw3k_read<uint32_t>(DW3K_RX_CAL_RESQ));
-  Serial.printf("DTUNE0      %04x\n", dw3k_read<uint16_t>(DW3K_DTUNE0));
-  Serial.printf("RX_SFD_TOC  %04x\n", dw3k_read<uint16_t>(DW3K_RX_SFD_TOC));
-  Serial.printf("PRE_TOC     %04x\n", dw3k_read<uint16_t>(DW3K_PRE_TOC));
-  Serial.printf("DTUNE3      %08x\n", dw3k_read<uint32_t>(DW3K_DTUNE3));
-  Serial.printf("RF_RX_CTRL2 %02x\n", dw3k_read<uint32_t>(DW3K_RF_RX_CTRL2));
-  Serial.printf("RF_TX_CTRL1 %02x\n", dw3k_read<uint8_t>(DW3K_RF_TX_CTRL1));
-  Serial.printf("RF_TX_CTRL2 %08x\n", dw3k_read<uint32_t>(DW3K_RF_TX_CTRL2));
-  Serial.printf("OTP_CFG     %08x\n", dw3k_read<uint32_t>(DW3K_OTP_CFG));
-  Serial.printf("LDO_TUNE    %016x\n", dw3k_read<uint64_t>(DW3K_LDO_TUNE_64));
-  Serial.printf("LDO_CTRL    %08x\n", dw3k_read<uint32_t>(DW3K_LDO_CTRL));
-  Serial.printf("SEQ_CTRL    %08x\n", dw3k_read<uint32_t>(DW3K_SEQ_CTRL));
-  Serial.printf("CIA_CONF    %08x\n", dw3k_read<uint32_t>(DW3K_CIA_CONF));
-  Serial.printf("BIAS_CTRL   %08x\n", dw3k_read<uint32_t>(DW3K_BIAS_CTRL));
+  Serial.printf("DEV_ID      %08x\n", dw3k_read(DW3K_DEV_ID));
+  Serial.printf("SYS_CFG     %08x\n", dw3k_read(DW3K_SYS_CFG));
+  auto const tx_fctrl = dw3k_read(DW3K_TX_FCTRL_64);
+  auto const ldo_tune = dw3k_read(DW3K_LDO_TUNE_64);
+  Serial.printf(
+      "TX_FCTRL    %04x%08x\n", unsigned(tx_fctrl >> 32), unsigned(tx_fctrl)
+  );
+  Serial.printf("TX_ANTD     %04x\n", dw3k_read(DW3K_TX_ANTD));
+  Serial.printf("CHAN_CTRL   %04x\n", dw3k_read(DW3K_CHAN_CTRL));
+  Serial.printf("DGC_CFG     %04x\n", dw3k_read(DW3K_DGC_CFG));
+  Serial.printf("RX_CAL_RESI %08x\n", dw3k_read(DW3K_RX_CAL_RESI));
+  Serial.printf("RX_CAL_RESQ %08x\n", dw3k_read(DW3K_RX_CAL_RESQ));
+  Serial.printf("DTUNE0      %04x\n", dw3k_read(DW3K_DTUNE0));
+  Serial.printf("RX_SFD_TOC  %04x\n", dw3k_read(DW3K_RX_SFD_TOC));
+  Serial.printf("PRE_TOC     %04x\n", dw3k_read(DW3K_PRE_TOC));
+  Serial.printf("DTUNE3      %08x\n", dw3k_read(DW3K_DTUNE3));
+  Serial.printf("RF_RX_CTRL2 %08x\n", dw3k_read(DW3K_RF_RX_CTRL2));
+  Serial.printf("RF_TX_CTRL1 %02x\n", dw3k_read(DW3K_RF_TX_CTRL1));
+  Serial.printf("RF_TX_CTRL2 %08x\n", dw3k_read(DW3K_RF_TX_CTRL2));
+  Serial.printf("OTP_CFG     %04x\n", dw3k_read(DW3K_OTP_CFG));
+  Serial.printf(
+      "LDO_TUNE    %08x%08x\n", unsigned(ldo_tune >> 32), unsigned(ldo_tune)
+  );
+  Serial.printf("LDO_CTRL    %08x\n", dw3k_read(DW3K_LDO_CTRL));
+  Serial.printf("SEQ_CTRL    %08x\n", dw3k_read(DW3K_SEQ_CTRL));
+  Serial.printf("CIA_CONF    %08x\n", dw3k_read(DW3K_CIA_CONF));
+  Serial.printf("BIAS_CTRL   %04x\n", dw3k_read(DW3K_BIAS_CTRL));
   Serial.printf("\n");
   Serial.printf("OTP:\n");
   Serial.printf("CHIP_ID     %08x\n", dw3k_read_otp(DW3K_OTP_CHIP_ID));
@@ -55,7 +62,7 @@ void loop() {
   dw3k_buffer_tx(msg, sizeof(msg));
 
   auto const lead_t32 = dw3k_tx_leadtime_t32();
-  auto const extra_t32 = 100e-6 * dw3k_time32_hz;
+  auto const extra_t32 = dw3k_micros_t32(100);
   auto const start_t32 = dw3k_clock_t32();
   auto const sched_t32 = start_t32 + lead_t32 + extra_t32;
   auto const expect_t40 = dw3k_tx_expected_t40(sched_t32);
@@ -2,6 +2,12 @@
 #include <avr/dtostrf.h>
 
 #include "dw3k.h"
+#include "dw3k_adapt.h"
+#include "dw3k_drift.h"
+#include "dw3k_phy.h"
+#include "dw3k_spi.h"
+#include "dw3k_task.h"
+#include "dw3k_time.h"
 
 struct PingPong {
   char type[8];
@@ -9,79 +15,218 @@ struct PingPong {
   uint64_t ping_rx_t40;
   float ping_offset;
   uint64_t pong_tx_t40;
+  uint8_t phy;  // Index in dw3k_phy_profiles, for PONG to reply with
 };
 
+// PONG goes out this long after PING arrives (see test_pong_main.cpp); the
+// receiver opens partway there by itself and gives up well after.
+static constexpr uint32_t pong_delay_micros = 2000;
+static constexpr uint16_t pong_peer = 1;  // For dw3k_drift; just the one
+
+// Prints a PING/PONG exchange just received
+static void report(PingPong const& m) {
+  char n1[40], n2[40], n3[40];
+  Serial.printf(
+      "\nPING %ss --> %ss %sppm offset\n",
+      dtostrf(m.ping_tx_t40 / dw3k_time40_hz, 15, 12, n1),
+      dtostrf(m.ping_rx_t40 / dw3k_time40_hz, 15, 12, n2),
+      dtostrf(m.ping_offset * 1e6, 8, 3, n3)
+  );
+
+  uint64_t const pong_rx_t40 = dw3k_rx_timestamp_t40();
+  auto const local_t40 = dw3k_t40(pong_rx_t40) - dw3k_t40(m.ping_tx_t40);
+  auto const remote_t40 = dw3k_t40(m.pong_tx_t40) - dw3k_t40(m.ping_rx_t40);
+  auto const local_s = local_t40 / dw3k_time40_hz;
+  auto const remote_s = remote_t40 / dw3k_time40_hz;
+  Serial.printf(
+      " dt  %ss  -  %ss = %ss (raw)\n",
+      dtostrf(local_s, 15, 12, n1), dtostrf(remote_s, 15, 12, n2),
+      dtostrf(local_s - remote_s, 15, 12, n3)
+  );
+
+  // Both carrier offsets, and the exchange's midpoints as a time pair
+  // (the flight times cancel), refine the filtered offset
+  float const pong_offset = dw3k_rx_clock_offset();
+  dw3k_drift_observe_offset(pong_peer, m.ping_tx_t40, -m.ping_offset);
+  dw3k_drift_observe_offset(pong_peer, pong_rx_t40, pong_offset);
+  dw3k_drift_observe_pair(
+      pong_peer, (dw3k_t40(m.ping_tx_t40) + local_t40 / 2).ticks,
+      (dw3k_t40(m.ping_rx_t40) + remote_t40 / 2).ticks);
+
+  DW3KDriftPeer peer = {};
+  dw3k_drift_peer(pong_peer, &peer);
+  auto const remote_adj_s = dw3k_drift_local_span(pong_peer, remote_s);
+  Serial.printf(
+      " dt  %ss  -  %ss = %ss (adjusted)\n",
+      dtostrf(local_s, 15, 12, n1),
+      dtostrf(remote_adj_s, 15, 12, n2),
+      dtostrf(local_s - remote_adj_s, 15, 12, n3)
+  );
+  Serial.printf(
+      " filtered %s+-%sppm offset, %sppm/s drift (%lu seen)\n",
+      dtostrf(peer.offset * 1e6, 0, 4, n1),
+      dtostrf(peer.offset_sigma * 1e6, 0, 4, n2),
+      dtostrf(peer.drift * 1e6, 0, 5, n3),
+      (unsigned long) peer.observations
+  );
+
+  Serial.printf(
+      "PONG %ss <-- %ss %sppm offset\n\n",
+      dtostrf(pong_rx_t40 / dw3k_time40_hz, 15, 12, n1),
+      dtostrf(m.pong_tx_t40 / dw3k_time40_hz, 15, 12, n2),
+      dtostrf(pong_offset * 1e6, 8, 3, n3)
+  );
+}
+
+// Where a profile is in dw3k_phy_profiles (by name, as dw3k_phy() is a copy)
+static uint8_t phy_index(DW3KPhyProfile const& p) {
+  uint8_t i = 0;
+  for (auto const* q : dw3k_phy_profiles) {
+    if (!strcmp(q->name, p.name)) return i;
+    ++i;
+  }
+  return 0;
+}
+
+// Prints how link adaptation stands with PONG
+static void report_adapt() {
+  DW3KAdaptPeer a = {};
+  if (!dw3k_adapt_peer(pong_peer, &a)) return;
+  char n1[40], n2[40], n3[40];
+  Serial.printf(
+      "ADAPT step %d (%luns/frame) %sdBm first path, %s LOS, %s errors; "
+      "%lu/%lu lost, %lu/%lu probes failed, %lu RX errors\n",
+      a.step, (unsigned long) a.airtime_ns,
+      dtostrf(a.first_path_dbm, 0, 1, n1), dtostrf(a.line_of_sight, 0, 2, n2),
+      dtostrf(a.errors, 0, 3, n3), (unsigned long) a.failures,
+      (unsigned long) a.exchanges, (unsigned long) a.probe_failures,
+      (unsigned long) a.probes, (unsigned long) a.rx_errors
+  );
+}
+
+enum Step { Reset, Send, Receive, Finish, Pause };
+
+static bool adapt = true;  // Else the console picks the profile
+static DW3KPhyProfile const* next_phy = nullptr;  // From the console
+
+static void ping(DW3KTask* task) {
+  using DS = DW3KStatus;
+  if (task->status == DS::ChipError || task->status == DS::CodeBug) {
+    Serial.printf("*** %s\n", dw3k_status_text());
+    task->step = Reset;
+  }
+
+  switch (task->step) {
+    case Reset:
+      Serial.printf("Resetting DW3K...\n");
+      dw3k_reset();
+      task->step = Send;
+      dw3k_task_wait_status(task, DS::Ready, 1000000);
+      return;
+
+    case Send: {
+      if (task->status != DS::Ready) {
+        Serial.printf("*** Not ready (%s)\n", dw3k_status_text());
+        task->step = Reset;
+        dw3k_task_yield(task);
+        return;
+      }
+      if (adapt) next_phy = &dw3k_adapt_profile(pong_peer);
+      if (next_phy && strcmp(next_phy->name, dw3k_phy().name)) {
+        dw3k_set_phy(*next_phy);
+        Serial.printf("\nPHY profile: %s\n", dw3k_phy().name);
+      }
+      next_phy = nullptr;
+
+      // PONG comes back with the same profile, its preamble starting a
+      // frame's airtime before its RX time (as PING's did before ours)
+      PingPong m = {};
+      uint32_t const frame_micros =
+          dw3k_phy_frame_ns(dw3k_phy(), sizeof(m)) / 1000;
+      dw3k_set_rx_after_tx((pong_delay_micros - frame_micros) / 2);
+      dw3k_set_rx_timeout(pong_delay_micros);
+
+      strcpy(m.type, "PING");
+      m.phy = phy_index(dw3k_phy());
+      Serial.printf("\nSending PING...\n");
+
+      auto const lead_t32 = dw3k_tx_leadtime_t32();
+      uint32_t const extra_t32 = dw3k_micros_t32(200);
+      uint32_t const sched_t32 = dw3k_clock_t32() + lead_t32 + extra_t32;
+      m.ping_tx_t40 = dw3k_tx_expected_t40(sched_t32);
+      dw3k_buffer_tx(&m, sizeof(m));
+      dw3k_schedule_tx(sched_t32, true);  // Then listen for PONG
+      task->step = Receive;
+      dw3k_task_wait_status(task, DS::ReceiveDone, 200000);
+      return;
+    }
+
+    case Receive: {
+      PingPong m = {};
+      bool delivered = false;
+      if (task->status != DS::ReceiveDone) {
+        Serial.printf("*** No response (%s)\n", dw3k_status_text());
+      } else if (dw3k_rx_size() != sizeof(m)) {
+        Serial.printf("*** Size=%d != %d\n", dw3k_rx_size(), sizeof(m));
+      } else {
+        dw3k_retrieve_rx(0, sizeof(m), &m);
+        if (strncmp(m.type, "PONG", sizeof(m.type))) {
+          Serial.printf("*** Type [%.8s] != PONG\n", m.type);
+        } else {
+          report(m);
+          delivered = true;
+        }
+      }
+
+      if (adapt) {
+        DW3KDiagnostics diag = {};
+        if (delivered) dw3k_read_diagnostics(&diag);
+        dw3k_adapt_result(pong_peer, delivered, delivered ? &diag : nullptr);
+        report_adapt();
+      }
+      dw3k_end_txrx();
+      task->step = Finish;
+      dw3k_task_wait_status(task, DS::Ready, 1000000);
+      return;
+    }
+
+    case Finish:
+      task->step = task->status == DS::Ready ? Pause : Reset;
+      dw3k_task_wait_micros(task, 500000);
+      return;
+
+    case Pause:
+      task->step = Send;
+      dw3k_task_wait_status(task, DS::Ready, 1000000);
+      return;
+  }
+}
+
+// Serial commands, alongside the radio: 'p' dumps the SPI profile, '0'-'3'
+// pick the channel 5 PHY profile for PINGs (PONG replies in kind) and 'a'
+// goes back to adapting it to the link
+static void console(DW3KTask* task) {
+  int const c = Serial.available() ? Serial.read() : -1;
+  if (c == 'p') dw3k_spi_profile_dump();
+  if (c == 'a') adapt = true;
+  if (c >= '0' && c <= '3') {
+    next_phy = dw3k_phy_profiles[c - '0'];
+    adapt = false;
+  }
+  dw3k_task_wait_micros(task, 10000);
+}
+
+static DW3KTask ping_task;
+static DW3KTask console_task;
+
 void setup() {
   Serial.begin(115200);
   while (!Serial) delay(10);
-  Serial.printf("Resetting DW3K...\n");
-  dw3k_reset();
-  dw3k_wait_verbose(DW3KStatus::Ready);
+  dw3k_task_start(&ping_task, ping);
+  dw3k_task_start(&console_task, console);
 }
 
 void loop() {
-  PingPong m = {};
-  strcpy(m.type, "PING");
-  Serial.printf("\nSending PING...\n", m.type);
-
-  auto const lead_t32 = dw3k_tx_leadtime_t32();
-  uint32_t const extra_t32 = 200e-6 * dw3k_time32_hz;
-  uint32_t const sched_t32 = dw3k_clock_t32() + lead_t32 + extra_t32;
-  m.ping_tx_t40 = dw3k_tx_expected_t40(sched_t32);
-  dw3k_buffer_tx(&m, sizeof(m));
-  dw3k_schedule_tx(sched_t32);
-  dw3k_wait_verbose(DW3KStatus::TransmitDone);
-  dw3k_end_txrx();
-  dw3k_wait_verbose(DW3KStatus::Ready);
-
-  Serial.printf("\nWaiting for PONG...\n");
-  dw3k_start_rx();
-  if (!dw3k_wait_verbose(DW3KStatus::ReceiveDone, 200)) {
-    Serial.printf("*** No response\n");
-  } else if (dw3k_rx_size() != sizeof(m)) {
-    Serial.printf("*** Size=%d != %d\n", dw3k_rx_size(), sizeof(m));
-  } else {
-    dw3k_retrieve_rx(0, sizeof(m), &m);
-    if (strncmp(m.type, "PONG", sizeof(m.type))) {
-      Serial.printf("*** Type [%.8s] != PONG\n", m.type);
-    } else {
-      char n1[40], n2[40], n3[40];
-      Serial.printf(
-          "\nPING %ss --> %ss %sppm offset\n",
-          dtostrf(m.ping_tx_t40 / dw3k_time40_hz, 15, 12, n1),
-          dtostrf(m.ping_rx_t40 / dw3k_time40_hz, 15, 12, n2),
-          dtostrf(m.ping_offset * 1e6, 8, 3, n3)
-      );
-
-      uint64_t const pong_rx_t40 = dw3k_rx_timestamp_t40();
-      auto const local_s = (pong_rx_t40 - m.ping_tx_t40) / dw3k_time40_hz;
-      auto const remote_s = (m.pong_tx_t40 - m.ping_rx_t40) / dw3k_time40_hz;
-      Serial.printf(
-          " dt  %ss  -  %ss = %ss (raw)\n",
-          dtostrf(local_s, 15, 12, n1), dtostrf(remote_s, 15, 12, n2),
-          dtostrf(local_s - remote_s, 15, 12, n3)
-      );
-
-      float const pong_offset = dw3k_rx_clock_offset();
-      auto const offset = (pong_offset - m.ping_offset) / 2;
-      auto const remote_adj_s = remote_s + remote_s * offset;
-      Serial.printf(
-          " dt  %ss  -  %ss = %ss (adjusted)\n",
-          dtostrf(local_s, 15, 12, n1),
-          dtostrf(remote_adj_s, 15, 12, n2),
-          dtostrf(local_s - remote_adj_s, 15, 12, n3)
-      );
-
-      Serial.printf(
-          "PONG %ss <-- %ss %sppm offset\n\n",
-          dtostrf(pong_rx_t40 / dw3k_time40_hz, 15, 12, n1),
-          dtostrf(m.pong_tx_t40 / dw3k_time40_hz, 15, 12, n2),
-          dtostrf(pong_offset * 1e6, 8, 3, n3)
-      );
-    }
-  }
-
-  dw3k_end_txrx();
-  dw3k_wait_verbose(DW3KStatus::Ready);
-  delay(500);
+  delayMicroseconds(10);
+  dw3k_task_run();
 }
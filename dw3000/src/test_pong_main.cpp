@@ -2,6 +2,11 @@
 #include <avr/dtostrf.h>
 
 #include "dw3k.h"
+#include "dw3k_adapt.h"
+#include "dw3k_phy.h"
+#include "dw3k_task.h"
+#include "dw3k_telemetry.h"
+#include "dw3k_time.h"
 
 struct PingPong {
   char type[8];
@@ -9,45 +14,145 @@ struct PingPong {
   uint64_t ping_rx_t40;
   float ping_offset;
   uint64_t pong_tx_t40;
+  uint8_t phy;  // Index in dw3k_phy_profiles, for PONG to reply with
 };
 
-void setup() {
-  Serial.begin(115200);
-  while (!Serial) delay(10);
-  Serial.printf("Resetting DW3K...\n");
-  dw3k_reset();
-  dw3k_wait_verbose(DW3KStatus::Ready);
+// Reply delay from PING arrival, which PING's receiver timing relies on
+static constexpr uint32_t pong_delay_micros = 2000;
+
+// With -DPONG_IRQ=1 in build_flags (env test_pong_irq), dw3k_poll() only
+// reads the chip once its IRQ line rises; these count what raised it
+#if PONG_IRQ
+static int irq_transmits = 0, irq_receives = 0, irq_errors = 0;
+static DW3KCallbacks const irq_callbacks = {
+    [] { ++irq_transmits; }, [] { ++irq_receives; },
+    [](DW3KStatus) { ++irq_errors; }};
+#endif
+
+#if DW3K_TELEMETRY
+// With DW3K_TELEMETRY, each PING's RX and PONG's TX time is also logged
+static void log_stamp(char kind, uint64_t t40) {
+  DW3KTelemetryTimestamp const r = {uint8_t(kind), t40};
+  dw3k_telemetry_log(DW3KTelemetryType::Timestamp, &r, sizeof(r));
 }
+#endif
+
+// Answers test_ping, as a dw3k_task (so loop() stays free for other work)
+enum Step { Reset, Listen, Receive, Sent };
+
+static void pong(DW3KTask* task) {
+  using DS = DW3KStatus;
+  if (task->status == DS::ChipError || task->status == DS::CodeBug) {
+    Serial.printf("*** %s\n", dw3k_status_text());
+    task->step = Reset;
+  }
+
+  switch (task->step) {
+    case Reset:
+      Serial.printf("Resetting DW3K...\n");
+      dw3k_set_phy(dw3k_adapt_ch5_listen);
+      dw3k_reset();
+      task->step = Listen;
+      dw3k_task_wait_status(task, DS::Ready, 1000000);
+      return;
+
+    case Listen:
+      if (task->status != DS::Ready) {
+        Serial.printf("*** Not ready (%s)\n", dw3k_status_text());
+        task->step = Reset;
+        dw3k_task_yield(task);
+        return;
+      }
+      // Back from replying with PING's profile to one that hears them all
+      if (strcmp(dw3k_phy().name, dw3k_adapt_ch5_listen.name))
+        dw3k_set_phy(dw3k_adapt_ch5_listen);
+      Serial.printf("\nWaiting for PING...\n");
+      dw3k_start_rx();
+      task->step = Receive;
+      dw3k_task_wait_status(task, DS::ReceiveDone);
+      return;
+
+    case Receive: {
+      PingPong message = {};
+      DW3KRxInfo const* rx = nullptr;
+      if (task->status != DS::ReceiveDone || !(rx = dw3k_rx_info())) {
+        Serial.printf("*** Not received (%s)\n", dw3k_status_text());
+        break;
+      }
+      if (rx->size != sizeof(message)) {
+        Serial.printf("*** Size=%d != %d\n", rx->size, sizeof(message));
+        break;
+      }
+      dw3k_retrieve_rx(0, sizeof(message), &message);
+      if (strncmp(message.type, "PING", sizeof(message.type))) {
+        Serial.printf("*** Type [%.8s] != PING\n", message.type);
+        break;
+      }
 
-void loop() {
-  Serial.printf("\nWaiting for PING...\n");
-
-  PingPong message = {};
-  dw3k_start_rx();
-  dw3k_wait_verbose(DW3KStatus::ReceiveDone);
-  if (dw3k_rx_size() != sizeof(message)) {
-    Serial.printf("*** Size=%d != %d\n", dw3k_rx_size(), sizeof(message));
-  } else {
-    dw3k_retrieve_rx(0, sizeof(message), &message);
-    if (strncmp(message.type, "PING", sizeof(message.type))) {
-      Serial.printf("*** Type [%.8s] != PING\n", message.type);
-    } else {
       strcpy(message.type, "PONG");
-      message.ping_rx_t40 = dw3k_rx_timestamp_t40();
-      message.ping_offset = dw3k_rx_clock_offset();
+      message.ping_rx_t40 = rx->rx_t40;
+#if DW3K_TELEMETRY
+      log_stamp('R', message.ping_rx_t40);
+#endif
+      message.ping_offset = rx->clock_offset;
       dw3k_end_txrx();
 
-      auto const lead_t32 = dw3k_tx_leadtime_t32();
-      uint32_t const extra_t32 = 1e-3 * dw3k_time32_hz;
-      uint32_t const sched_t32 = dw3k_clock_t32() + lead_t32 + extra_t32;
+      // Reply with PING's profile, so test_ping can adapt it to the link
+      static constexpr int phy_count = sizeof(dw3k_phy_profiles) /
+          sizeof(dw3k_phy_profiles[0]);
+      if (message.phy < phy_count) {
+        auto const& phy = *dw3k_phy_profiles[message.phy];
+        if (phy.channel == dw3k_phy().channel &&
+            strcmp(phy.name, dw3k_phy().name))
+          dw3k_set_phy(phy);
+      }
+
+      uint32_t const delay_t32 = dw3k_micros_t32(pong_delay_micros);
+      uint32_t const sched_t32 = (message.ping_rx_t40 >> 8) + delay_t32;
       message.pong_tx_t40 = dw3k_tx_expected_t40(sched_t32);
       dw3k_buffer_tx(&message, sizeof(message));
       dw3k_schedule_tx(sched_t32);
       Serial.printf("Replying with PONG...\n");
-      dw3k_wait_verbose(DW3KStatus::TransmitDone);
+      task->step = Sent;
+      dw3k_task_wait_status(task, DS::TransmitDone, 100000);
+      return;
     }
+
+    case Sent:
+      if (task->status != DS::TransmitDone)
+        Serial.printf("*** PONG not sent (%s)\n", dw3k_status_text());
+#if DW3K_TELEMETRY
+      if (task->status == DS::TransmitDone)
+        log_stamp('T', dw3k_tx_timestamp_t40());
+#endif
+#if PONG_IRQ
+      Serial.printf(
+          "IRQ: %d transmit, %d receive, %d error\n", irq_transmits,
+          irq_receives, irq_errors);
+#endif
+      break;
   }
 
   dw3k_end_txrx();
-  dw3k_wait_verbose(DW3KStatus::Ready);
+  task->step = Listen;
+  dw3k_task_wait_status(task, DS::Ready, 1000000);
+}
+
+static DW3KTask pong_task;
+
+void setup() {
+  Serial.begin(115200);
+  while (!Serial) delay(10);
+#if PONG_IRQ
+  dw3k_use_irq(irq_callbacks);
+#endif
+  dw3k_task_start(&pong_task, pong);
+}
+
+void loop() {
+  delayMicroseconds(10);
+  dw3k_task_run();
+#if DW3K_TELEMETRY
+  dw3k_telemetry_drain();
+#endif
 }
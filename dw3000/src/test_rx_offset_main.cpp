@@ -0,0 +1,60 @@
+#include <Arduino.h>
+#include <avr/dtostrf.h>
+#include <math.h>
+
+#include "dw3k.h"
+
+// Checks that single-buffer reception (dw3k_rx_clock_offset(), from the
+// carrier integrator) and continuous reception (DW3KRxFrame::clock_offset,
+// from the CIA's COE_PPM) agree on the sender's clock offset, taking
+// alternate frames from any sender (e.g. test_ping) each way.
+static constexpr float max_difference = 0.5e-6;  // About both estimates' noise
+
+static uint8_t data[dw3k_packet_size];
+static DW3KRxFrame ring[1] = {{data, sizeof(data), 0, 0, 0}};
+static int good = 0, bad = 0;
+
+void setup() {
+  Serial.begin(115200);
+  while (!Serial) delay(10);
+  Serial.printf("Resetting DW3K...\n");
+  dw3k_reset();
+  dw3k_wait_verbose(DW3KStatus::Ready);
+}
+
+void loop() {
+  Serial.printf("\nReceiving (single buffer)...\n");
+  dw3k_start_rx();
+  if (!dw3k_wait_verbose(DW3KStatus::ReceiveDone, 2000)) {
+    dw3k_end_txrx();
+    return;
+  }
+  float const single = dw3k_rx_clock_offset();
+  dw3k_end_txrx();
+
+  Serial.printf("Receiving (continuous)...\n");
+  dw3k_start_rx_continuous(ring, 1);
+  auto const start_millis = millis();
+  DW3KRxFrame const* frame = nullptr;
+  while (!frame && millis() - start_millis < 2000) {
+    delayMicroseconds(10);
+    if (dw3k_poll() != DW3KStatus::ReceiveContinuous) break;
+    frame = dw3k_rx_frame();
+  }
+  float const continuous = frame ? frame->clock_offset : 0;
+  if (frame) dw3k_release_rx_frame();
+  dw3k_end_txrx();
+  if (!frame) {
+    Serial.printf("*** No continuous frame (%s)\n", dw3k_status_text());
+    return;
+  }
+
+  bool const ok = fabsf(single - continuous) <= max_difference;
+  ++(ok ? good : bad);
+  char n1[20], n2[20];
+  Serial.printf(
+      "%s single %sppm, continuous %sppm (%d agreed, %d not)\n",
+      ok ? "OK" : "*** MISMATCH", dtostrf(single * 1e6, 0, 3, n1),
+      dtostrf(continuous * 1e6, 0, 3, n2), good, bad
+  );
+}
@@ -0,0 +1,86 @@
+#include <Arduino.h>
+#include <avr/dtostrf.h>
+
+#include "dw3k.h"
+
+// Retrieves frames from any sender (e.g. test_bulk_send, whose frames are
+// ~1 KB) alternately with dw3k_stream_rx(), summing each chunk while the
+// next one is read, and with dw3k_start_retrieve_rx() in one go before
+// summing; reports how long each way takes per frame
+static constexpr int chunk_size = 128;
+
+static uint8_t scratch[2 * chunk_size];
+static uint8_t frame[dw3k_packet_size];
+static uint32_t sum;
+static volatile bool retrieved;
+
+struct Way {
+  char const* name;
+  uint32_t frames, bytes, micros;
+};
+
+static Way ways[2] = {{"streamed", 0, 0, 0}, {"retrieved", 0, 0, 0}};
+
+static void add(void const* data, int /*offset*/, int size) {
+  auto const* const bytes = static_cast<uint8_t const*>(data);
+  for (int i = 0; i < size; ++i) sum += bytes[i];
+}
+
+void setup() {
+  Serial.begin(115200);
+  while (!Serial) delay(10);
+  Serial.printf("Resetting DW3K...\n");
+  dw3k_reset();
+  dw3k_wait_verbose(DW3KStatus::Ready);
+}
+
+void loop() {
+  static int next_way = 0;
+  static unsigned long report_millis = millis();
+
+  dw3k_start_rx();
+  auto const start_millis = millis();
+  DW3KStatus status;
+  do {
+    delayMicroseconds(10);
+    status = dw3k_poll();
+  } while ((status == DW3KStatus::ReceiveListen ||
+            status == DW3KStatus::ReceiveAnalyze) &&
+           millis() - start_millis < 1000);
+
+  if (status == DW3KStatus::ReceiveDone) {
+    int const size = dw3k_rx_size();
+    auto& way = ways[next_way];
+    auto const start_micros = micros();
+    sum = 0;
+    if (next_way == 0) {
+      dw3k_stream_rx(size, chunk_size, scratch, add);
+    } else {
+      retrieved = false;
+      dw3k_start_retrieve_rx(0, size, frame, [] { retrieved = true; });
+      while (!retrieved) {}
+      add(frame, 0, size);
+    }
+    way.micros += micros() - start_micros;
+    way.bytes += size;
+    ++way.frames;
+    next_way ^= 1;
+  } else if (status != DW3KStatus::ReceiveListen &&
+             status != DW3KStatus::ReceiveAnalyze) {
+    Serial.printf("*** %s\n", dw3k_status_text());
+  }
+  dw3k_end_txrx();
+
+  if (millis() - report_millis < 1000) return;
+  report_millis = millis();
+  for (auto& way : ways) {
+    if (!way.frames) continue;
+    char n1[20], n2[20];
+    Serial.printf(
+        "%s: %lu frames of %s bytes in %s us each\n", way.name,
+        (unsigned long) way.frames,
+        dtostrf(float(way.bytes) / way.frames, 0, 0, n1),
+        dtostrf(float(way.micros) / way.frames, 0, 1, n2));
+    way = {way.name, 0, 0, 0};
+  }
+}
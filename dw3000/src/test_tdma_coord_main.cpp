@@ -0,0 +1,58 @@
+#include <Arduino.h>
+#include <avr/dtostrf.h>
+
+#include "dw3k.h"
+#include "dw3k_tdma.h"
+
+// Runs a superframe of 16 slots for test_tdma_node (built with TDMA_SLOT
+// 1-15), listening in every slot, and reports per-slot use once a second
+static constexpr int slots = 16;
+static constexpr DW3KTdmaConfig config = {
+    0x0001, true, slots, dw3k_tdma_slot_micros, dw3k_tdma_guard_micros, 0,
+    ~uint64_t(0)};
+
+void setup() {
+  Serial.begin(115200);
+  while (!Serial) delay(10);
+  Serial.printf("Resetting DW3K...\n");
+  dw3k_reset();
+  dw3k_wait_verbose(DW3KStatus::Ready);
+  dw3k_tdma_start(config);
+}
+
+void loop() {
+  static uint32_t last_value[slots] = {};
+  static unsigned long report_millis = millis();
+  delayMicroseconds(10);
+  auto const status = dw3k_tdma_poll();
+  if (status == DW3KTdmaStatus::Failed) {
+    Serial.printf("*** %s\n", dw3k_tdma_status_text());
+    dw3k_reset();
+    dw3k_wait_verbose(DW3KStatus::Ready);
+    dw3k_tdma_start(config);
+  } else if (status == DW3KTdmaStatus::Received) {
+    auto const& f = dw3k_tdma_frame();
+    if (f.size == sizeof(uint32_t))
+      memcpy(&last_value[f.slot], f.data, sizeof(uint32_t));
+  }
+
+  if (millis() - report_millis < 1000) return;
+  report_millis = millis();
+  auto const s = dw3k_tdma_stats();
+  char n1[20];
+  Serial.printf(
+      "\n%lu superframes, %lu frames, %s%% of slots used "
+      "(%lu errors, %lu misplaced, %lu late)\n",
+      (unsigned long) s.superframes, (unsigned long) s.rx_frames,
+      dtostrf(s.rx_utilisation * 100, 0, 1, n1), (unsigned long) s.rx_errors,
+      (unsigned long) s.misplaced, (unsigned long) s.late);
+  for (int slot = 1; slot < slots; ++slot) {
+    auto const ss = dw3k_tdma_slot_stats(slot);
+    if (!ss.frames && !ss.errors && !ss.misplaced) continue;
+    Serial.printf(
+        "  slot %2d: %lu/%lu frames, %lu errors, %lu misplaced, #%lu\n",
+        slot, (unsigned long) ss.frames, (unsigned long) ss.windows,
+        (unsigned long) ss.errors, (unsigned long) ss.misplaced,
+        (unsigned long) last_value[slot]);
+  }
+}
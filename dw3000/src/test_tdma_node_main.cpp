@@ -0,0 +1,49 @@
+#include <Arduino.h>
+#include <avr/dtostrf.h>
+
+#include "dw3k.h"
+#include "dw3k_tdma.h"
+
+// Follows test_tdma_coord and sends a counter in slot TDMA_SLOT (add
+// -DTDMA_SLOT=n to build_flags for each further node), reporting once a second
+#ifndef TDMA_SLOT
+#define TDMA_SLOT 1
+#endif
+
+static constexpr DW3KTdmaConfig config = {
+    0x0100 + TDMA_SLOT, false, 0, 0, 0, uint64_t(1) << TDMA_SLOT, 0};
+
+void setup() {
+  Serial.begin(115200);
+  while (!Serial) delay(10);
+  Serial.printf("Resetting DW3K...\n");
+  dw3k_reset();
+  dw3k_wait_verbose(DW3KStatus::Ready);
+  dw3k_tdma_start(config);
+}
+
+void loop() {
+  static uint32_t counter = 0;
+  static unsigned long report_millis = millis();
+  delayMicroseconds(10);
+  auto const status = dw3k_tdma_poll();
+  if (status == DW3KTdmaStatus::Failed) {
+    Serial.printf("*** %s\n", dw3k_tdma_status_text());
+    dw3k_reset();
+    dw3k_wait_verbose(DW3KStatus::Ready);
+    dw3k_tdma_start(config);
+  }
+  if (dw3k_tdma_send(&counter, sizeof(counter))) ++counter;
+
+  if (millis() - report_millis < 1000) return;
+  report_millis = millis();
+  auto const s = dw3k_tdma_stats();
+  char n1[20];
+  Serial.printf(
+      "%s: %lu sent in %lu slots, %s%% (%lu beacons missed, %lu searches, "
+      "%lu late)\n",
+      dw3k_tdma_status_text(), (unsigned long) s.tx_frames,
+      (unsigned long) s.tx_slots, dtostrf(s.tx_utilisation * 100, 0, 1, n1),
+      (unsigned long) s.beacons_missed, (unsigned long) s.searches,
+      (unsigned long) s.late);
+}
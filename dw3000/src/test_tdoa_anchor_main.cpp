@@ -0,0 +1,61 @@
+#include <Arduino.h>
+#include <avr/dtostrf.h>
+
+#include "dw3k.h"
+#include "dw3k_tdoa.h"
+
+// TDOA anchor: the reference (address 0x0001, TDOA_ANCHOR 0, the default)
+// sends syncs, others (add -DTDOA_ANCHOR=n and -DTDOA_REFERENCE_M=distance
+// to build_flags) follow it; all print test_tdoa_tag blinks in its timebase,
+// as host/dw3k_locate reads them
+#ifndef TDOA_ANCHOR
+#define TDOA_ANCHOR 0
+#endif
+#ifndef TDOA_REFERENCE_M
+#define TDOA_REFERENCE_M 3.0f
+#endif
+
+static constexpr DW3KTdoaConfig config = {
+    0x0001 + TDOA_ANCHOR,
+    TDOA_ANCHOR ? DW3KTdoaRole::Anchor : DW3KTdoaRole::Reference,
+    dw3k_tdoa_sync_micros, 0x0001, TDOA_REFERENCE_M};
+
+void setup() {
+  Serial.begin(115200);
+  while (!Serial) delay(10);
+  Serial.printf("Resetting DW3K...\n");
+  dw3k_reset();
+  dw3k_wait_verbose(DW3KStatus::Ready);
+  dw3k_tdoa_start(config);
+}
+
+void loop() {
+  static unsigned long report_millis = millis();
+  delayMicroseconds(10);
+  auto const status = dw3k_tdoa_poll();
+  if (status == DW3KTdoaStatus::Failed) {
+    Serial.printf("*** %s\n", dw3k_tdoa_status_text());
+    dw3k_reset();
+    dw3k_wait_verbose(DW3KStatus::Ready);
+    dw3k_tdoa_start(config);
+  } else if (status == DW3KTdoaStatus::Blink) {
+    auto const& b = dw3k_tdoa_blink();
+    char n1[20];
+    Serial.printf(
+        "tdoa %04x %u %04x %010llx (sync %lums ago, %sppm)\n", b.tag,
+        b.sequence, b.anchor, (unsigned long long) b.ref_t40,
+        (unsigned long) b.sync_age_micros / 1000,
+        dtostrf(b.clock_offset * 1e6, 0, 3, n1));
+  }
+
+  if (millis() - report_millis < 1000) return;
+  report_millis = millis();
+  auto const s = dw3k_tdoa_stats();
+  char n1[20], n2[20];
+  Serial.printf(
+      "%s blinks/s (%lu blinks, %lu syncs, %lu unsynced, %lu dropped, "
+      "%sppm)\n",
+      dtostrf(s.rate, 0, 1, n1), (unsigned long) s.blinks,
+      (unsigned long) s.syncs, (unsigned long) s.unsynced,
+      (unsigned long) s.dropped, dtostrf(s.clock_offset * 1e6, 0, 3, n2));
+}
@@ -0,0 +1,42 @@
+#include <Arduino.h>
+#include <avr/dtostrf.h>
+
+#include "dw3k.h"
+#include "dw3k_tdoa.h"
+
+// TDOA tag: one blink every 100ms for test_tdoa_anchor to timestamp (add
+// -DTDOA_TAG=n to build_flags for each further tag)
+#ifndef TDOA_TAG
+#define TDOA_TAG 0
+#endif
+
+static constexpr DW3KTdoaConfig config = {
+    0x0200 + TDOA_TAG, DW3KTdoaRole::Tag, 100000, 0, 0};
+
+void setup() {
+  Serial.begin(115200);
+  while (!Serial) delay(10);
+  Serial.printf("Resetting DW3K...\n");
+  dw3k_reset();
+  dw3k_wait_verbose(DW3KStatus::Ready);
+  dw3k_tdoa_start(config);
+}
+
+void loop() {
+  static unsigned long report_millis = millis();
+  delayMicroseconds(10);
+  if (dw3k_tdoa_poll() == DW3KTdoaStatus::Failed) {
+    Serial.printf("*** %s\n", dw3k_tdoa_status_text());
+    dw3k_reset();
+    dw3k_wait_verbose(DW3KStatus::Ready);
+    dw3k_tdoa_start(config);
+  }
+
+  if (millis() - report_millis < 1000) return;
+  report_millis = millis();
+  auto const s = dw3k_tdoa_stats();
+  char n1[20];
+  Serial.printf(
+      "%s blinks/s (%lu blinks)\n", dtostrf(s.rate, 0, 1, n1),
+      (unsigned long) s.blinks);
+}
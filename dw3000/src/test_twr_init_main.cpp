@@ -0,0 +1,92 @@
+#include <Arduino.h>
+#include <avr/dtostrf.h>
+
+#include "dw3k.h"
+#include "dw3k_telemetry.h"
+#include "dw3k_twr.h"
+
+// Ranges with up to four test_twr_resp (built with TWR_SLOT 0-3) at once, as
+// fast as DS-TWR allows, reporting once a second every range from one
+// exchange together (as host/dw3k_locate groups them, by sequence); with
+// DW3K_TELEMETRY, logs every range as a record instead (host/dw3k_telemetry
+// turns them into the same lines)
+static constexpr int slots = 4;
+static constexpr DW3KTwrConfig config = {
+    0x0001, dw3k_twr_broadcast, dw3k_twr_reply_micros, 0, slots, 0,
+    dw3k_twr_slot_micros};
+
+void setup() {
+  Serial.begin(115200);
+  while (!Serial) delay(10);
+  Serial.printf("Resetting DW3K...\n");
+  dw3k_reset();
+  dw3k_wait_verbose(DW3KStatus::Ready);
+  dw3k_twr_initiate(config);
+}
+
+// Prints the statistics and the ranges of one exchange
+static void report(DW3KTwrResult const* exchange) {
+  auto const s = dw3k_twr_stats();
+  char n1[20], n2[20], n3[20];
+  Serial.printf(
+      "\n%s ranges/s (%lu ranges, %lu polls, %lu missed, %lu late)\n",
+      dtostrf(s.rate, 0, 1, n1), (unsigned long) s.ranges,
+      (unsigned long) s.attempts, (unsigned long) s.timeouts,
+      (unsigned long) s.late);
+  for (int i = 0; i < slots; ++i) {
+    auto const& r = exchange[i];
+    if (!r.peer) continue;
+    Serial.printf(
+        "range %04x %d %04x %sm q=%s %sppm\n", config.address, r.sequence,
+        r.peer, dtostrf(r.distance_m, 0, 3, n1), dtostrf(r.quality, 0, 2, n2),
+        dtostrf(r.clock_offset * 1e6, 0, 3, n3));
+  }
+}
+
+void loop() {
+  // One exchange's results (all with the same sequence) come in together,
+  // so the first result of the next one completes it
+  static DW3KTwrResult exchange[slots] = {};
+  static int exchange_sequence = -1;
+  static bool report_due = false;
+  static unsigned long report_millis = millis();
+  delayMicroseconds(10);
+  auto const status = dw3k_twr_poll();
+  if (status == DW3KTwrStatus::Failed) {
+#if DW3K_TELEMETRY
+    dw3k_telemetry_text(dw3k_twr_status_text());
+#else
+    Serial.printf("*** %s\n", dw3k_twr_status_text());
+#endif
+    dw3k_reset();
+    dw3k_wait_verbose(DW3KStatus::Ready);
+    dw3k_twr_initiate(config);
+  } else if (status == DW3KTwrStatus::Result) {
+    auto const& r = dw3k_twr_result();
+    if (r.sequence != exchange_sequence) {
+      if (report_due && exchange_sequence >= 0) {
+        report(exchange);
+        report_due = false;
+      }
+      for (auto& e : exchange) e = {};
+      exchange_sequence = r.sequence;
+    }
+    int const slot = r.peer - 0x0100;  // test_twr_resp addresses
+    if (slot >= 0 && slot < slots) exchange[slot] = r;
+#if DW3K_TELEMETRY
+    DW3KTelemetryRange const t = {
+        config.address, r.peer, r.sequence, r.distance_m, r.quality,
+        r.clock_offset};
+    dw3k_telemetry_log(DW3KTelemetryType::Range, &t, sizeof(t));
+#endif
+  }
+
+#if DW3K_TELEMETRY
+  dw3k_telemetry_drain();
+  return;
+#endif
+
+  if (millis() - report_millis < 1000) return;
+  report_millis = millis();
+  report_due = true;  // With the next complete exchange
+}
@@ -0,0 +1,48 @@
+#include <Arduino.h>
+#include <avr/dtostrf.h>
+
+#include "dw3k.h"
+#include "dw3k_twr.h"
+
+// Answers test_twr_init in slot TWR_SLOT (add -DTWR_SLOT=n to build_flags
+// for each further responder), reporting the latest range once a second
+#ifndef TWR_SLOT
+#define TWR_SLOT 0
+#endif
+
+static constexpr DW3KTwrConfig config = {
+    0x0100 + TWR_SLOT, 0, dw3k_twr_reply_micros, 0, 0, TWR_SLOT, 0};
+
+void setup() {
+  Serial.begin(115200);
+  while (!Serial) delay(10);
+  Serial.printf("Resetting DW3K...\n");
+  dw3k_reset();
+  dw3k_wait_verbose(DW3KStatus::Ready);
+  dw3k_twr_respond(config);
+}
+
+void loop() {
+  static unsigned long report_millis = millis();
+  delayMicroseconds(10);
+  if (dw3k_twr_poll() == DW3KTwrStatus::Failed) {
+    Serial.printf("*** %s\n", dw3k_twr_status_text());
+    dw3k_reset();
+    dw3k_wait_verbose(DW3KStatus::Ready);
+    dw3k_twr_respond(config);
+  }
+
+  if (millis() - report_millis < 1000) return;
+  report_millis = millis();
+  auto const& r = dw3k_twr_result();
+  auto const s = dw3k_twr_stats();
+  char n1[20], n2[20], n3[20], n4[20];
+  Serial.printf(
+      "#%d %sm q=%s %sppm | %s ranges/s (%lu ranges, %lu answered, "
+      "%lu timeouts, %lu late)\n",
+      r.sequence, dtostrf(r.distance_m, 0, 3, n1),
+      dtostrf(r.quality, 0, 2, n2), dtostrf(r.clock_offset * 1e6, 0, 3, n3),
+      dtostrf(s.rate, 0, 1, n4), (unsigned long) s.ranges,
+      (unsigned long) s.attempts, (unsigned long) s.timeouts,
+      (unsigned long) s.late);
+}